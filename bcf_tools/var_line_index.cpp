@@ -0,0 +1,53 @@
+#include <iostream>
+#include "CLI11.hpp"
+#include "var_line_index.hpp"
+#include "time.hpp"
+
+class GlobalAppOptions {
+public:
+    GlobalAppOptions() {
+        app.add_option("-f,--file", filename, "Input (main var) VCF/BCF file name");
+        app.add_option("-o,--output", ofname, "Index file name, default is the input file name with .lidx appended");
+    }
+
+    CLI::App app{"Variant to VCF line index app"};
+    std::string filename = "-";
+    std::string ofname = "-";
+};
+
+GlobalAppOptions global_app_options;
+
+int main(int argc, char**argv) {
+    auto begin_time = std::chrono::steady_clock::now();
+
+    CLI::App& app = global_app_options.app;
+    auto& filename = global_app_options.filename;
+    auto& ofname = global_app_options.ofname;
+    CLI11_PARSE(app, argc, argv);
+
+    if (filename.compare("-") == 0) {
+        std::cerr << "Requires input filename\n";
+        exit(app.exit(CLI::CallForHelp()));
+    }
+
+    if (ofname.compare("-") == 0) {
+        ofname = VarLineIndex::default_filename(filename);
+    }
+
+    std::cout << "Indexing " << filename << " ...\n" << std::endl;
+
+    VarLineIndexBuilder builder;
+    builder.build(filename, ofname);
+
+    std::cout << "Indexed " << builder.num_entries << " variants";
+    if (builder.duplicates) {
+        std::cout << " (" << builder.duplicates << " duplicates)";
+    }
+    std::cout << " to " << ofname << std::endl;
+
+    std::cout << "Done !" << std::endl;
+
+    printElapsedTime(begin_time, std::chrono::steady_clock::now());
+
+    return 0;
+}
@@ -73,24 +73,27 @@ int main(int argc, char**argv) {
     size_t diffs = 0;
     size_t commons = 0;
     for (auto idx : common_idx) {
-        auto his1 = himm_1.get_het_info_for_nth(map1.at(idx));
-        auto his2 = himm_2.get_het_info_for_nth(map2.at(idx));
+        const auto his1 = himm_1.get_span_of_nth(map1.at(idx));
+        const auto his2 = himm_2.get_span_of_nth(map2.at(idx));
         if (his1.size() != his2.size()) {
             vector_diffs++;
-            continue;
         } else {
             for (size_t i = 0; i < his1.size(); ++i) {
-                if (his1[i] != his2[i]) {
+                const HetInfo hi1 = his1.het_info(i);
+                const HetInfo hi2 = his2.het_info(i);
+                if (hi1 != hi2) {
                     diffs++;
                     if (extra) {
-                        std::cout << his1[i].to_string() << " " << his1[i].vcf_line << std::endl;
-                        std::cout << his2[i].to_string() << " " << his2[i].vcf_line << std::endl;
+                        std::cout << hi1.to_string() << " " << hi1.vcf_line << std::endl;
+                        std::cout << hi2.to_string() << " " << hi2.vcf_line << std::endl;
                     }
                 } else {
                     commons++;
                 }
             }
         }
+        himm_1.release_nth(map1.at(idx));
+        himm_2.release_nth(map2.at(idx));
     }
 
     std::cout << "There are " << vector_diffs << " samples that don't have the same amount of variants" << std::endl;
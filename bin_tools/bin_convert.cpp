@@ -0,0 +1,205 @@
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "CLI11.hpp"
+#include "het_info.hpp"
+#include "het_info_loader.hpp"
+#include "het_info_compressed.hpp"
+#include "het_info_compact.hpp"
+#include "het_info_columnar.hpp"
+#include "het_info_sample_table.hpp"
+#include "het_info_skip_index.hpp"
+#include "het_info_writer.hpp"
+
+/* Compresses the sample blocks in parallel, they are held in memory until the file is written */
+void compress_file(const HetInfoMemoryMap& himm, const std::string& ofname, const std::vector<char>& sections, const bool checksums, const int level, const size_t threads) {
+    std::vector<std::vector<char> > blocks(himm.num_samples);
+    HetInfoFileWriter::parallel_for(threads, blocks.size(), [&](const size_t i) {
+        blocks[i] = HetInfoCompression::compress_block(himm.get_orig_idx_of_nth(i), himm.get_het_info_for_nth(i), level);
+    });
+    std::vector<uint64_t> block_sizes(blocks.size());
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        block_sizes[i] = blocks[i].size();
+    }
+    HetInfoFileWriter writer(ofname, block_sizes, HetInfoCompression::FILE_MARK, sections, checksums);
+    writer.for_all_blocks(threads, [&](const size_t i) {
+        writer.write_raw_block(i, blocks[i].data(), blocks[i].size());
+    });
+}
+
+/* Fixed size blocks, written directly (throws if a genotype is not bi-allelic) */
+void compact_file(const HetInfoMemoryMap& himm, const std::string& ofname, const std::vector<char>& sections, const bool checksums, const size_t threads) {
+    std::vector<uint64_t> block_sizes(himm.num_samples);
+    for (size_t i = 0; i < block_sizes.size(); ++i) {
+        block_sizes[i] = HetInfoCompact::block_size((himm.get_size_of_nth(i) - HetInfoFileWriter::SAMPLE_BLOCK_HEADER_SIZE) / sizeof(HetInfo));
+    }
+    HetInfoFileWriter writer(ofname, block_sizes, HetInfoCompact::FILE_MARK, sections, checksums);
+    writer.for_all_blocks(threads, [&](const size_t i) {
+        const auto block = HetInfoCompact::encode_block(himm.get_orig_idx_of_nth(i), himm.get_het_info_for_nth(i));
+        writer.write_raw_block(i, block.data(), block_sizes[i]);
+    });
+}
+
+/* Same size as the original layout, the het infos are transposed into columns */
+void columnar_file(const HetInfoMemoryMap& himm, const std::string& ofname, const std::vector<char>& sections, const bool checksums, const size_t threads) {
+    std::vector<uint64_t> block_sizes(himm.num_samples);
+    for (size_t i = 0; i < block_sizes.size(); ++i) {
+        block_sizes[i] = himm.get_size_of_nth(i);
+    }
+    HetInfoFileWriter writer(ofname, block_sizes, HetInfoColumnar::FILE_MARK, sections, checksums);
+    writer.for_all_blocks(threads, [&](const size_t i) {
+        const auto block = HetInfoColumnar::encode_block(himm.get_orig_idx_of_nth(i), himm.get_het_info_for_nth(i));
+        writer.write_raw_block(i, block.data(), block_sizes[i]);
+    });
+}
+
+/* The sample blocks are decoded one at a time by each thread */
+void decompress_file(const HetInfoMemoryMap& himm, const std::string& ofname, const std::vector<char>& sections, const bool checksums, const size_t threads) {
+    std::vector<uint64_t> block_sizes(himm.num_samples);
+    for (size_t i = 0; i < block_sizes.size(); ++i) {
+        block_sizes[i] = himm.get_size_of_nth(i);
+    }
+    HetInfoFileWriter writer(ofname, block_sizes, HetInfoFileWriter::ENDIANNESS_MARK, sections, checksums);
+    writer.for_all_blocks(threads, [&](const size_t i) {
+        writer.write_raw_block(i, himm.get_ptr_on_nth(i), block_sizes[i]);
+        himm.release_nth(i);
+    });
+}
+
+/* Sample names of the original samples (first column, one per line, e.g., bcftools query -l) */
+std::vector<std::string> read_sample_names(const std::string& filename) {
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        std::cerr << "Error opening file: " << filename << std::endl;
+        throw "Error opening file";
+    }
+    std::vector<std::string> names;
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream iss(line);
+        std::string name;
+        iss >> name;
+        if (!name.empty()) {
+            names.push_back(name);
+        }
+    }
+    return names;
+}
+
+/* Sample table of the output, the one of the input (unless dropped) unless it is added (IDs of the sample blocks, names from the file if given) */
+std::vector<char> output_sample_table(const HetInfoMemoryMap& himm, const bool add, const std::string& names_fname, const bool drop) {
+    std::vector<uint32_t> nths(himm.num_samples);
+    std::iota(nths.begin(), nths.end(), 0);
+    if (names_fname.empty() && !add) {
+        return drop ? std::vector<char>() : himm.get_sample_table_of(nths);
+    }
+    if (names_fname.empty() && himm.has_sample_names()) {
+        return himm.get_sample_table_of(nths);
+    }
+    const auto all_names = names_fname.empty() ? std::vector<std::string>() : read_sample_names(names_fname);
+    std::vector<uint32_t> ids;
+    std::vector<std::string> names;
+    for (const auto n : nths) {
+        ids.push_back(himm.get_orig_idx_of_nth(n));
+        if (!all_names.empty()) {
+            if (ids.back() >= all_names.size()) {
+                std::cerr << "Sample " << ids.back() << " is not in " << names_fname << " (" << all_names.size() << " samples)" << std::endl;
+                throw "Sample not in sample names";
+            }
+            names.push_back(all_names[ids.back()]);
+        }
+    }
+    return HetInfoSampleTable::encode(ids, names);
+}
+
+/* Skip index of the output, the one of the input (unless dropped) unless an interval is given (checkpoints of the sample blocks) */
+std::vector<char> output_skip_index(const HetInfoMemoryMap& himm, const uint32_t interval, const bool drop, const size_t threads) {
+    std::vector<uint32_t> nths(himm.num_samples);
+    std::iota(nths.begin(), nths.end(), 0);
+    if (!interval) {
+        return drop ? std::vector<char>() : himm.get_skip_index_of(nths);
+    }
+    std::vector<std::vector<uint32_t> > checkpoints(himm.num_samples);
+    HetInfoFileWriter::parallel_for(threads, checkpoints.size(), [&](const size_t i) {
+        checkpoints[i] = HetInfoSkipIndex::checkpoints_of(himm.get_span_of_nth(i), interval);
+        himm.release_nth(i);
+    });
+    return HetInfoSkipIndex::encode(checkpoints, interval);
+}
+
+int main(int argc, char**argv) {
+    CLI::App app{"Binary file format converter"};
+    std::string bin_fname = "-";
+    app.add_option("-b,--input", bin_fname, "Binary file to convert (either version)");
+    std::string bin_ofname = "-";
+    app.add_option("-o,--output", bin_ofname, "Converted binary file name (output)");
+    int version = 2;
+    app.add_option("--to", version, "Version of the output, 1 (uncompressed, can be modified in place), 2 (compressed)\n"
+                   "    3 (compact 8-byte het infos, bi-allelic only, PP on 1/10000, can be modified in place)\n"
+                   "    or 4 (columnar, het infos stored by column, can be modified in place), default is 2");
+    int level = HetInfoCompression::DEFAULT_LEVEL;
+    app.add_option("-l,--level", level, "zstd compression level for version 2, default is 3");
+    size_t threads = 1;
+    app.add_option("-t,--threads", threads, "Number of threads converting the sample blocks");
+    bool sample_table = false;
+    app.add_flag("--sample-table", sample_table, "Add a sample table (original sample IDs) to the output, the one of the input is kept otherwise");
+    std::string sample_names_fname;
+    app.add_option("--sample-names", sample_names_fname, "Add a sample table with the names of the samples to the output, file with the names of\n"
+                   "    all the original samples in order (e.g., bcftools query -l <file.vcf|bcf>)");
+    uint32_t skip_interval = 0;
+    app.add_option("--skip-index", skip_interval, "Add a skip index with a checkpoint every this many het sites (e.g., 256) to the output, for the queries\n"
+                   "    by VCF line range, the one of the input is kept otherwise");
+    bool checksums = false;
+    app.add_flag("--checksums", checksums, "Add the CRC32C checksums of the sample blocks to the output, kept if the input has them");
+    bool drop_sections = false;
+    app.add_flag("--drop-sections", drop_sections, "Don't keep the sample table, skip index and checksums of the input (the ones requested are added)");
+
+    CLI11_PARSE(app, argc, argv);
+
+    if (bin_fname.compare("-") == 0 || bin_ofname.compare("-") == 0) {
+        std::cerr << "Requires input and output binary filenames\n";
+        exit(app.exit(CLI::CallForHelp()));
+    }
+
+    if (bin_fname.compare(bin_ofname) == 0) {
+        std::cerr << "Input and Output files must have different names !" << std::endl;
+        exit(-1);
+    }
+
+    if (version < 1 || version > 4) {
+        std::cerr << "Unknown binary file version " << version << std::endl;
+        exit(app.exit(CLI::CallForHelp()));
+    }
+
+    try {
+        HetInfoMemoryMap himm(bin_fname);
+        if (!himm.integrity_check_pass(threads)) {
+            std::cerr << "File " << bin_fname << " doesn't pass integrity checks" << std::endl;
+            exit(-1);
+        }
+        auto sections = output_sample_table(himm, sample_table, sample_names_fname, drop_sections);
+        const auto index = output_skip_index(himm, skip_interval, drop_sections, threads);
+        sections.insert(sections.end(), index.begin(), index.end());
+        checksums = checksums || (himm.has_checksums() && !drop_sections);
+        if (version == 2) {
+            compress_file(himm, bin_ofname, sections, checksums, level, threads);
+        } else if (version == 3) {
+            compact_file(himm, bin_ofname, sections, checksums, threads);
+        } else if (version == 4) {
+            columnar_file(himm, bin_ofname, sections, checksums, threads);
+        } else {
+            decompress_file(himm, bin_ofname, sections, checksums, threads);
+        }
+    } catch (const char *e) {
+        std::cerr << "Failed to convert " << bin_fname << " : " << e << std::endl;
+        exit(-1);
+    }
+
+    std::cout << "Done writing version " << version << " file " << bin_ofname << std::endl;
+    return 0;
+}
@@ -59,18 +59,19 @@ public:
         }
     }
 
+    /* Only the het infos with a VCF line in [begin_line, end_line) are compared */
+    void set_vcf_lines(const uint32_t begin, const uint32_t end) {
+        begin_line = begin;
+        end_line = end;
+    }
+
     void fill_internal_data_from_files() {
         /* For all samples */
         for (const auto& sample_idx : ids) {
             data.push_back({});
 
-            HetInfoMemoryMap::HetInfoPtrContainer orig_hipc(himm_original, sample_idx);
-            HetInfoMemoryMap::HetInfoPtrContainer reph_hipc(himm_rephased, sample_idx);
-
-            std::vector<HetInfo> orig_hi;
-            std::vector<HetInfo> reph_hi;
-            orig_hipc.fill_het_info(orig_hi);
-            reph_hipc.fill_het_info(reph_hi);
+            const HetInfoSpan orig_hi = himm_original.get_span_of_nth_in_lines(sample_idx, begin_line, end_line);
+            const HetInfoSpan reph_hi = himm_rephased.get_span_of_nth_in_lines(sample_idx, begin_line, end_line);
 
             if (orig_hi.size() != reph_hi.size()) {
                 std::cerr << "Binary files do not match !" << std::endl;
@@ -78,17 +79,21 @@ public:
             }
 
             for (size_t i = 0; i < orig_hi.size(); ++i) {
-                if (!std::isnan(orig_hi.at(i).pp) && orig_hi.at(i).pp < 0.99) {
+                const float orig_pp = orig_hi[i].pp();
+                if (!std::isnan(orig_pp) && orig_pp < 0.99) {
+                    const HetInfo reph = reph_hi.het_info(i);
                     data.back().emplace_back(Data(
-                        orig_hi.at(i).vcf_line,
-                        orig_hi.at(i).pp,
-                        orig_hi.at(i).a0 != reph_hi.at(i).a0,
-                        (reph_hi.at(i).pp > 1.0) ? (size_t)(reph_hi.at(i).pp - 1.0) : 0,
-                        reph_hi.at(i).a0,
-                        reph_hi.at(i).a1
+                        orig_hi[i].vcf_line(),
+                        orig_pp,
+                        orig_hi[i].a0() != reph.a0,
+                        (reph.pp > 1.0) ? (size_t)(reph.pp - 1.0) : 0,
+                        reph.a0,
+                        reph.a1
                     ));
                 }
             }
+            himm_original.release_nth(sample_idx);
+            himm_rephased.release_nth(sample_idx);
         }
     }
 
@@ -165,6 +170,8 @@ public:
     HetInfoMemoryMap himm_rephased;
     std::vector<std::vector<Data> > data;
     std::vector<size_t> ids;
+    uint32_t begin_line = 0;
+    uint32_t end_line = -1;
 };
 
 int main(int argc, char**argv) {
@@ -187,6 +194,8 @@ int main(int argc, char**argv) {
     app.add_flag("--ac", ac, "Added allele count field");
     size_t ac_threshold = 0;
     app.add_option("--ac-threshold", ac_threshold, "AC threshold filtering value (0 means no filtering)");
+    std::string region;
+    app.add_option("-r,--region", region, "Only compare the het sites in the region CHROM:BEG-END (1 based, inclusive), requires the variant file");
 
     CLI11_PARSE(app, argc, argv);
 
@@ -202,6 +211,21 @@ int main(int argc, char**argv) {
 
     BinDiffExtractor bde(bin1_fname, bin2_fname, vcf_fname, samples_fname, sub_fname);
 
+    if (!region.empty()) {
+        if (vcf_fname.compare("-") == 0) {
+            std::cerr << "Requires variant VCF/BCF filename for the region\n";
+            exit(app.exit(CLI::CallForHelp()));
+        }
+        uint32_t begin_line = 0;
+        uint32_t end_line = 0;
+        try {
+            VarInfoLoader(vcf_fname).find_vcf_lines_of_region(region, begin_line, end_line);
+        } catch (const char *e) {
+            exit(-1);
+        }
+        bde.set_vcf_lines(begin_line, end_line);
+    }
+
     bde.fill_internal_data_from_files();
 
     if (ac_threshold) {
@@ -21,7 +21,11 @@ int main(int argc, char**argv) {
     std::string bin_fname = "-";
     std::string bin_ofname = "-";
     app.add_option("-b,--input", bin_fname, "Binary file prefix");
-    app.add_option("-o,--output", bin_ofname, "Merged binary file name (output)");
+    app.add_option("-o,--output", bin_ofname, "Merged binary file name (output), \"-\" for stdout with --stream");
+    bool stream = false;
+    app.add_flag("--stream", stream, "Write the streaming layout (offset table at the end), can be piped");
+    size_t threads = 1;
+    app.add_option("-t,--threads", threads, "Number of threads used to copy the sample blocks");
     bool verbose = false;
     app.add_flag("-v,--verbose", verbose, "Be more verbose");
     bool more = false;
@@ -35,7 +39,7 @@ int main(int argc, char**argv) {
         exit(app.exit(CLI::CallForHelp()));
     }
 
-    if (bin_ofname.compare("-") == 0) {
+    if (bin_ofname.compare("-") == 0 && !stream) {
         std::cerr << "Requires output binary filename\n";
         exit(app.exit(CLI::CallForHelp()));
     }
@@ -54,21 +58,31 @@ int main(int argc, char**argv) {
         file = bin_fname + "_" + std::to_string(++suffix_number);
     }
 
+    if (stream) {
+        if (bin_ofname.compare("-") == 0) {
+            HetInfoMemoryMapMerger::merge_files_to_stream(filenames, std::cout);
+        } else {
+            std::ofstream ofs(bin_ofname, std::ios_base::binary | std::ios_base::out | std::ios_base::trunc);
+            if (!ofs.is_open()) {
+                std::cerr << "Cannot open file " << bin_ofname << std::endl;
+                exit(-1);
+            }
+            HetInfoMemoryMapMerger::merge_files_to_stream(filenames, ofs);
+        }
+        return 0;
+    }
+
     auto num_samples = HetInfoMemoryMapMerger::get_num_samples_from_filenames(filenames);
 
     if (verbose) {
         std::cout << "Total number of samples : " << num_samples << std::endl;
     }
 
-    // Merge file in smaller scope (destructor closes file)
-    {
-        HetInfoMemoryMapMerger himmm(bin_ofname, num_samples);
-        for (const auto& file : filenames) {
-            himmm.merge(file);
-        }
-    }
+    // The output is pre-sized, the sample blocks are copied in parallel
+    HetInfoMemoryMapMerger::merge_files(filenames, bin_ofname, threads);
+
     HetInfoMemoryMap himm(bin_ofname);
-    if (!himm.integrity_check_pass()) {
+    if (!himm.integrity_check_pass(threads)) {
         std::cerr << "Generated file " << bin_ofname << " has problems" << std::endl;
     }
 
@@ -16,11 +16,73 @@
 #include "synced_bcf_reader.h"
 #include "vcf.h"
 
-void write_to_file(uint32_t i, uint32_t start_id, uint32_t size, const std::string& bin_ofname, const HetInfoMemoryMap& himm) {
+void write_to_file(uint32_t i, uint32_t start_id, uint32_t size, const std::string& bin_ofname, const HetInfoMemoryMap& himm, size_t threads) {
     std::vector<uint32_t> ids_to_extract(size);
     std::iota(ids_to_extract.begin(), ids_to_extract.end(), start_id);
     auto nth_bin_ofname = bin_ofname + "_" + std::to_string(i);
-    himm.write_sub_file(ids_to_extract, nth_bin_ofname);
+    himm.write_sub_file(ids_to_extract, nth_bin_ofname, threads);
+}
+
+/* Sample table and skip index of a sub file, if the input has them */
+std::vector<char> sub_file_sections(const HetInfoStreamReader& reader, const std::vector<uint32_t>& ids) {
+    const auto& table = reader.get_sample_table();
+    const auto& index = reader.get_skip_index();
+    std::vector<char> sections = table.empty() ? std::vector<char>() : table.encode_subset(ids);
+    if (!index.empty()) {
+        const auto sub_index = index.encode_subset(ids);
+        sections.insert(sections.end(), sub_index.begin(), sub_index.end());
+    }
+    return sections;
+}
+
+/**
+ * @brief Splits a binary file read sequentially from a stream, sub file f gets
+ *        the samples at the (increasing) positions sub_file_ids[f], the sample
+ *        blocks of a sub file are kept in memory until its last one is read.
+ */
+void split_stream(HetInfoStreamReader& reader, const std::vector<std::vector<uint32_t> >& sub_file_ids, const std::vector<std::string>& sub_file_names, size_t threads) {
+    const int NONE = -1;
+    std::vector<int> destination(reader.num_samples, NONE);
+    for (size_t f = 0; f < sub_file_ids.size(); ++f) {
+        for (auto idx : sub_file_ids[f]) {
+            if (idx >= reader.num_samples) {
+                std::cerr << "Sample " << idx << " is not in the binary file" << std::endl;
+                throw "Sample not in binary file";
+            }
+            destination[idx] = f;
+        }
+    }
+
+    for (size_t f = 0; f < sub_file_ids.size(); ++f) {
+        if (sub_file_ids[f].empty()) {
+            HetInfoFileWriter(sub_file_names[f], {}, HetInfoFileWriter::ENDIANNESS_MARK, sub_file_sections(reader, sub_file_ids[f]),
+                              reader.has_checksums());
+        }
+    }
+
+    std::vector<std::vector<std::pair<uint32_t, std::vector<HetInfo> > > > blocks(sub_file_ids.size());
+    uint32_t id;
+    std::vector<HetInfo> his;
+    for (uint32_t n = 0; reader.next_block(id, his); ++n) {
+        if (destination[n] == NONE) {
+            continue;
+        }
+        auto& sub_file_blocks = blocks[destination[n]];
+        sub_file_blocks.push_back({id, his});
+        if (sub_file_blocks.size() == sub_file_ids[destination[n]].size()) {
+            std::vector<uint64_t> block_sizes;
+            for (const auto& b : sub_file_blocks) {
+                block_sizes.push_back(HetInfoFileWriter::block_size(b.second.size()));
+            }
+            HetInfoFileWriter writer(sub_file_names[destination[n]], block_sizes, HetInfoFileWriter::ENDIANNESS_MARK,
+                                     sub_file_sections(reader, sub_file_ids[destination[n]]), reader.has_checksums());
+            writer.for_all_blocks(threads, [&](const size_t i) {
+                writer.write_block(i, sub_file_blocks[i].first, sub_file_blocks[i].second);
+            });
+            sub_file_blocks.clear();
+            sub_file_blocks.shrink_to_fit();
+        }
+    }
 }
 
 int main(int argc, char**argv) {
@@ -35,6 +97,10 @@ int main(int argc, char**argv) {
     app.add_option("-l,--sample-list", sub_fname, "Unordered sub sample list (text file)");
     uint32_t split_size = 0;
     app.add_option("-n,--split-size", split_size, "Split in subfiles of this size, if 0 (default) use sub sample list");
+    size_t threads = 1;
+    app.add_option("-t,--threads", threads, "Number of threads used to copy the sample blocks");
+    bool from_stdin = false;
+    app.add_flag("--stdin", from_stdin, "Read the binary file sequentially from stdin (e.g., piped from pp_extract --stream)");
     bool verbose = false;
     app.add_flag("-v,--verbose", verbose, "Be more verbose");
     bool more = false;
@@ -43,7 +109,7 @@ int main(int argc, char**argv) {
 
     CLI11_PARSE(app, argc, argv);
 
-    if (bin_fname.compare("-") == 0) {
+    if (bin_fname.compare("-") == 0 && !from_stdin) {
         std::cerr << "Requires binary filename\n";
         exit(app.exit(CLI::CallForHelp()));
     }
@@ -68,10 +134,27 @@ int main(int argc, char**argv) {
         exit(app.exit(CLI::CallForHelp()));
     }
 
-    if (split_size) {
+    if (split_size && from_stdin) {
+        HetInfoStreamReader reader(std::cin);
+
+        std::vector<std::vector<uint32_t> > sub_file_ids;
+        std::vector<std::string> sub_file_names;
+        for (uint32_t start_id = 0; start_id < reader.num_samples; start_id += split_size) {
+            sub_file_ids.emplace_back(std::min(split_size, reader.num_samples - start_id));
+            std::iota(sub_file_ids.back().begin(), sub_file_ids.back().end(), start_id);
+            sub_file_names.push_back(bin_ofname + "_" + std::to_string(sub_file_names.size()));
+        }
+
+        if (verbose) {
+            std::cout << "Num samples : " << reader.num_samples << std::endl;
+            std::cout << "Splitting into " << sub_file_ids.size() << " chunks of size up to " << split_size << std::endl;
+        }
+
+        split_stream(reader, sub_file_ids, sub_file_names, threads);
+    } else if (split_size) {
         HetInfoMemoryMap himm(bin_fname);
 
-        if (!himm.integrity_check_pass()) {
+        if (!himm.integrity_check_pass(threads)) {
             std::cout << "Input file " << bin_fname << " seems to have some issues" << std::endl;
         }
 
@@ -91,13 +174,13 @@ int main(int argc, char**argv) {
         }
 
         for (uint32_t i = 0; i < full_chunks; ++i) {
-            write_to_file(i, i * split_size, split_size, bin_ofname, himm);
+            write_to_file(i, i * split_size, split_size, bin_ofname, himm, threads);
             if (more) {
                 std::cout << "Splitted chunk " << i << std::endl;
             }
         }
         if (last_chunk_size) {
-           write_to_file(full_chunks, full_chunks * split_size, last_chunk_size, bin_ofname, himm);
+           write_to_file(full_chunks, full_chunks * split_size, last_chunk_size, bin_ofname, himm, threads);
         }
     } else {
         SampleInfoLoader all_sil(samples_fname);
@@ -140,17 +223,22 @@ int main(int argc, char**argv) {
 
         // Extract the binary file
 
-        if (verbose) {
-            std::cout << "Memory mapping the binary file" << std::endl;
-        }
+        if (from_stdin) {
+            HetInfoStreamReader reader(std::cin);
+            split_stream(reader, {idx_to_extract}, {bin_ofname}, threads);
+        } else {
+            if (verbose) {
+                std::cout << "Memory mapping the binary file" << std::endl;
+            }
 
-        HetInfoMemoryMap himm(bin_fname);
+            HetInfoMemoryMap himm(bin_fname);
 
-        if (verbose) {
-            std::cout << "Writing the sub binary file" << std::endl;
-        }
+            if (verbose) {
+                std::cout << "Writing the sub binary file" << std::endl;
+            }
 
-        himm.write_sub_file(idx_to_extract, bin_ofname);
+            himm.write_sub_file(idx_to_extract, bin_ofname, threads);
+        }
 
         if (verbose) {
             std::cout << "Extracted binary data for " << idx_to_extract.size() << " samples to file : " << bin_ofname << std::endl;
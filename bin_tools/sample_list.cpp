@@ -49,7 +49,7 @@ std::string cram_filename(const std::string& sample_name, const std::string& cra
 int main(int argc, char**argv) {
     CLI::App app{"Sample list"};
     std::string filename = "-";
-    app.add_option("-f,--file", filename, "Sample file name (extract with bcftools query -l <file.vcf|bcf>)");
+    app.add_option("-f,--file", filename, "Sample file name (extract with bcftools query -l <file.vcf|bcf>), not needed if the binary file has sample names");
     std::string bfname = "-";
     app.add_option("-b,--binary", bfname, "Binary file name");
     std::string cram_path;
@@ -61,33 +61,38 @@ int main(int argc, char**argv) {
 
     CLI11_PARSE(app, argc, argv);
 
-    if (filename.compare("-") == 0) {
-        std::cerr << "Requires filename\n";
-        exit(app.exit(CLI::CallForHelp()));
-    }
-
     if (bfname.compare("-") == 0) {
         std::cerr << "Requires binary filename\n";
         exit(app.exit(CLI::CallForHelp()));
     }
 
-    auto samples = read_first_column(filename);
-
     HetInfoMemoryMap himm(bfname);
 
+    // The names in the sample table of the binary file are used if there is no sample file
+    const bool names_from_binary = (filename.compare("-") == 0);
+    if (names_from_binary && !himm.has_sample_names()) {
+        std::cerr << "Requires filename (the binary file has no sample names)\n";
+        exit(app.exit(CLI::CallForHelp()));
+    }
+
+    auto samples = names_from_binary ? std::vector<std::string>() : read_first_column(filename);
+
     if (verbose) {
-        std::cout << "There are " << samples.size() << " samples" << std::endl;
+        if (!names_from_binary) {
+            std::cout << "There are " << samples.size() << " samples" << std::endl;
+        }
         std::cout << "There are " << himm.num_samples << " samples in the binary file" << std::endl;
     }
 
     for (uint32_t himm_idx = 0; himm_idx < himm.num_samples; ++himm_idx) {
         // Because the himm is subsampled we need the original index wrt sample list
         uint32_t orig_idx = himm.get_orig_idx_of_nth(himm_idx);
+        const std::string sample = names_from_binary ? himm.get_sample_name_of_nth(himm_idx) : samples[orig_idx];
         if (verbose) {
-            std::cout << "Sample number : " << himm_idx << " : " << samples[orig_idx] << std::endl;
+            std::cout << "Sample number : " << himm_idx << " : " << sample << std::endl;
         }
-        std::cout << cram_filename(samples[orig_idx], cram_path, project_id) << std::endl;
-        std::cout << cram_filename(samples[orig_idx], cram_path, project_id) + ".crai" << std::endl;
+        std::cout << cram_filename(sample, cram_path, project_id) << std::endl;
+        std::cout << cram_filename(sample, cram_path, project_id) + ".crai" << std::endl;
     }
 
     return 0;
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cmath>
 #include <cstddef>
 #include <fcntl.h>
@@ -22,6 +23,8 @@ int main(int argc, char**argv) {
     std::string bin_ofname = "-";
     app.add_option("-b,--input", bin_fname, "Binary file prefix");
     app.add_option("-o,--output", bin_ofname, "Merged binary file name (output)");
+    size_t threads = 1;
+    app.add_option("-t,--threads", threads, "Number of threads");
     bool verbose = false;
     //app.add_flag("-v,--verbose", verbose, "Be more verbose");
     bool more = false;
@@ -57,7 +60,7 @@ int main(int argc, char**argv) {
     for (auto& filename : filenames) {
         himms.emplace_back(std::make_unique<HetInfoMemoryMap>(filename));
         auto& himm_p = himms.back();
-        if (!himm_p->integrity_check_pass()) {
+        if (!himm_p->integrity_check_pass(threads)) {
             std::cerr << "File " << filename << " doesn't pass integrity checks" << std::endl;
         }
         if (!num_samples) {
@@ -70,58 +73,73 @@ int main(int argc, char**argv) {
         }
     }
 
-    std::fstream ofs(bin_ofname, std::ios_base::binary | std::ios_base::out | std::ios_base::trunc);
-    if (!ofs.is_open()) {
-        std::cerr << "Cannot open file " << bin_ofname << std::endl;
-        exit(-1);
-    }
-
-    const uint32_t endianness = 0xaabbccdd;
-    // Write endianness
-    ofs.write(reinterpret_cast<const char*>(&endianness), sizeof(uint32_t));
-    // Write number of samples
-    ofs.write(reinterpret_cast<const char*>(&num_samples), sizeof(uint32_t));
-    // Write offset table
-    uint64_t dummy_offset = 0xdeadc0dedeadc0de;
-    auto table_seek = ofs.tellp();
-    for (size_t i = 0; i < num_samples; ++i) {
-        ofs.write(reinterpret_cast<const char*>(&dummy_offset), sizeof(uint64_t));
-    }
-
-    std::vector<uint64_t> offset_table(num_samples);
-
-    /* For all samples concatenate vertically */
-    for (uint32_t i = 0; i < num_samples; ++i) {
+    /* Concatenates vertically the het infos of sample i from all files */
+    auto merged_het_info = [&](const uint32_t i) {
         std::vector<HetInfo> his;
-        offset_table[i] = ofs.tellp();
         /* For all files memory maps */
         for (auto& h : himms) {
-            auto h_his = h->get_het_info_for_nth(i);
+            const auto h_his = h->get_span_of_nth(i);
             if (his.size()) {
                 auto last_line = his.back().vcf_line;
                 /* Conditionally append Het Information wrt overlap */
-                for (auto hi : h_his) {
-                    if (hi.vcf_line > last_line) {
-                        his.push_back(hi);
+                for (const auto hi : h_his) {
+                    if (hi.vcf_line() > last_line) {
+                        his.push_back(hi.to_het_info());
                     }
                 }
             } else {
                 /* Append first Het Information */
-                his.insert(his.end(), h_his.begin(), h_his.end());
+                for (const auto hi : h_his) {
+                    his.push_back(hi.to_het_info());
+                }
             }
+            h->release_nth(i);
         }
-        SampleBlock::write_to_stream(ofs, his, i);
+        return his;
+    };
+
+    /* First pass computes the size of all sample blocks so that the output can be pre-sized
+     * (and their skip index checkpoints if the first file has a skip index) */
+    const uint32_t skip_interval = himms.empty() ? 0 : himms.front()->get_skip_index().get_interval();
+    std::vector<uint64_t> block_sizes(num_samples);
+    std::vector<std::vector<uint32_t> > checkpoints(num_samples);
+    HetInfoFileWriter::parallel_for(threads, num_samples, [&](const size_t i) {
+        const auto his = merged_het_info(i);
+        block_sizes[i] = HetInfoFileWriter::block_size(his.size());
+        if (skip_interval) {
+            checkpoints[i] = HetInfoSkipIndex::checkpoints_of(his, skip_interval);
+        }
+    });
+
+    /* The sample table (names) and skip index of the first file are kept */
+    std::vector<char> sections;
+    if (!himms.empty() && himms.front()->has_sample_table()) {
+        std::vector<uint32_t> ids(num_samples);
+        std::vector<std::string> names;
+        for (uint32_t i = 0; i < num_samples; ++i) {
+            ids[i] = i;
+            if (himms.front()->has_sample_names()) {
+                names.push_back(himms.front()->get_sample_name_of_nth(i));
+            }
+        }
+        sections = HetInfoSampleTable::encode(ids, names);
     }
-
-    // Rewrite the offset table
-    ofs.seekp(table_seek);
-    for (size_t i = 0; i < num_samples; ++i) {
-        ofs.write(reinterpret_cast<const char*>(&offset_table[i]), sizeof(decltype(offset_table.front())));
+    if (skip_interval) {
+        const auto index = HetInfoSkipIndex::encode(checkpoints, skip_interval);
+        sections.insert(sections.end(), index.begin(), index.end());
     }
 
-    std::cout << "Done writing file " << bin_ofname << std::endl;
+    /* Second pass writes the sample blocks in place */
+    /* Checksums if all the files have them */
+    const bool with_checksums = !himms.empty() &&
+        std::all_of(himms.begin(), himms.end(), [](const auto& himm) { return himm->has_checksums(); });
+    HetInfoFileWriter writer(bin_ofname, block_sizes, HetInfoFileWriter::ENDIANNESS_MARK, sections, with_checksums);
+    writer.for_all_blocks(threads, [&](const size_t i) {
+        writer.write_block(i, i, merged_het_info(i));
+    });
+    writer.close();
 
-    ofs.close();
+    std::cout << "Done writing file " << bin_ofname << std::endl;
 
     return 0;
 }
@@ -29,7 +29,8 @@ ifeq ($(STATIC_BINS),y)
 A_LIBS := $(HTSLIB_PATH)/libhts.a $(ZSTD_PATH)/libzstd.a
 LDLIBS+=-llzma -lbz2 -lz -lm -lcurl -pthread
 else
-LDLIBS+=-lhts -pthread
+# The compressed binary files (het_info_compressed.hpp) and the xSqueezeIt accessor use zstd
+LDLIBS+=-lhts -lzstd -pthread
 endif
 
 LDFLAGS+=-O$(OLEVEL) $(EXTRA_FLAGS)
@@ -0,0 +1,115 @@
+#ifndef __CRC32C_HPP__
+#define __CRC32C_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CRC32C_X86 1
+#else
+#define CRC32C_X86 0
+#endif
+
+/**
+ * @brief CRC32C (Castagnoli) of byte ranges, as in iSCSI, ext4 or LevelDB,
+ *        used as the checksums of the sample blocks of het info binary files.
+ *
+ *        The SSE4.2 crc32 instruction kernel is compiled with a target
+ *        attribute and selected at runtime given the CPU (as the het scan
+ *        kernels), a table based kernel is used otherwise, both give the same
+ *        values. extend() continues a CRC, so extend(extend(0, a), b) is the
+ *        CRC of a followed by b.
+ */
+namespace crc32c {
+
+/* Reflected Castagnoli polynomial */
+constexpr uint32_t POLY = 0x82f63b78;
+
+typedef uint32_t (*kernel_fn)(uint32_t crc, const uint8_t *p, size_t size);
+
+static inline const uint32_t *table() {
+    static const struct Table {
+        Table() {
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t c = i;
+                for (int k = 0; k < 8; ++k) {
+                    c = (c & 1) ? (c >> 1) ^ POLY : c >> 1;
+                }
+                values[i] = c;
+            }
+        }
+        uint32_t values[256];
+    } t;
+    return t.values;
+}
+
+static uint32_t extend_scalar(uint32_t crc, const uint8_t *p, size_t size) {
+    const uint32_t *t = table();
+    for (size_t i = 0; i < size; ++i) {
+        crc = t[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#if CRC32C_X86
+/* 8 bytes per instruction, the head and tail bytes one by one */
+__attribute__((target("sse4.2")))
+static uint32_t extend_sse42(uint32_t crc, const uint8_t *p, size_t size) {
+    while (size && (reinterpret_cast<uintptr_t>(p) & 7)) {
+        crc = _mm_crc32_u8(crc, *p++);
+        size--;
+    }
+#if defined(__x86_64__)
+    uint64_t crc64 = crc;
+    for (; size >= 8; size -= 8, p += 8) {
+        uint64_t word;
+        memcpy(&word, p, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = uint32_t(crc64);
+#endif
+    for (; size >= 4; size -= 4, p += 4) {
+        uint32_t word;
+        memcpy(&word, p, sizeof(word));
+        crc = _mm_crc32_u32(crc, word);
+    }
+    while (size--) {
+        crc = _mm_crc32_u8(crc, *p++);
+    }
+    return crc;
+}
+#endif
+
+static inline bool has_hardware() {
+#if CRC32C_X86
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse4.2");
+#else
+    return false;
+#endif
+}
+
+static inline kernel_fn select_kernel(const bool hardware) {
+#if CRC32C_X86
+    if (hardware) {
+        return extend_sse42;
+    }
+#endif
+    return extend_scalar;
+}
+
+/* CRC of the bytes following the ones of crc (0 for the first bytes) */
+static inline uint32_t extend(const uint32_t crc, const void *data, const size_t size) {
+    static const kernel_fn kernel = select_kernel(has_hardware());
+    return ~kernel(~crc, static_cast<const uint8_t*>(data), size);
+}
+
+static inline uint32_t value(const void *data, const size_t size) {
+    return extend(0, data, size);
+}
+
+} /* namespace crc32c */
+
+#endif /* __CRC32C_HPP__ */
@@ -0,0 +1,98 @@
+#ifndef __HET_INFO_CHECKSUMS_HPP__
+#define __HET_INFO_CHECKSUMS_HPP__
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "crc32c.hpp"
+
+/**
+ * @brief Checksums of het info binary files (see
+ *        pp_extractor/doc/Binary_Format.md), an optional section after the
+ *        offset table (and the other sections). It holds the CRC32C of every
+ *        sample block as stored (header included, compressed or not) and the
+ *        CRC32C of the file before the section (header, offset table and
+ *        other sections), so corrupted blocks are found by checking each
+ *        block on its own, in parallel or when it is first accessed. The
+ *        sample blocks modified in place get their checksum updated.
+ *
+ *        Layout (little endian, the section size is a multiple of 8) :
+ *        uint32_t mark, uint32_t CRC32C of the file before the section,
+ *        uint64_t section size, uint32_t crcs[n], padding to 8.
+ */
+class HetInfoChecksums {
+public:
+    static constexpr uint32_t MARK = 0xd00dc3c2;
+    static constexpr uint64_t HEADER_SIZE = 2 * sizeof(uint32_t) + sizeof(uint64_t); /* Mark, table CRC, size */
+
+    /* No checksums */
+    HetInfoChecksums() {}
+
+    /* Checksums of n samples at p (the mark must be there), available is the number of bytes after p,
+     * the checksums are updated in place at p */
+    HetInfoChecksums(char *p, const uint32_t n, const uint64_t available) {
+        const uint32_t *header = reinterpret_cast<const uint32_t*>(p);
+        table_crc = header[1];
+        memcpy(&section_size, p + 2 * sizeof(uint32_t), sizeof(uint64_t));
+        if (header[0] != MARK || section_size > available || section_size != size_of(n)) {
+            std::cerr << "Bad checksums" << std::endl;
+            throw "Bad checksums";
+        }
+        crcs = reinterpret_cast<uint32_t*>(p + HEADER_SIZE);
+    }
+
+    static bool is_at(const char *p, const uint64_t available) {
+        return available >= HEADER_SIZE && *reinterpret_cast<const uint32_t*>(p) == MARK;
+    }
+
+    /* Size of the section of n samples */
+    static uint64_t size_of(const uint32_t n) {
+        return padded(HEADER_SIZE + uint64_t(n) * sizeof(uint32_t));
+    }
+
+    /* Section with the checksums of the sample blocks, table_crc is the CRC32C of the file before it */
+    static std::vector<char> encode(const std::vector<uint32_t>& crcs, const uint32_t table_crc) {
+        const uint64_t size = size_of(crcs.size());
+        std::vector<char> section(size, 0);
+        const uint32_t header[2] = {MARK, table_crc};
+        memcpy(section.data(), header, sizeof(header));
+        memcpy(section.data() + sizeof(header), &size, sizeof(size));
+        memcpy(section.data() + HEADER_SIZE, crcs.data(), crcs.size() * sizeof(uint32_t));
+        return section;
+    }
+
+    bool empty() const {
+        return !crcs;
+    }
+
+    /* Size of the section in bytes, 0 if there are no checksums */
+    uint64_t size() const {
+        return section_size;
+    }
+
+    uint32_t get_table_crc() const {
+        return table_crc;
+    }
+
+    uint32_t crc_of_nth(const uint32_t i) const {
+        return crcs[i];
+    }
+
+    /* Only if the section is in a writable memory map */
+    void set_crc_of_nth(const uint32_t i, const uint32_t crc) const {
+        crcs[i] = crc;
+    }
+
+protected:
+    static uint64_t padded(const uint64_t size) {
+        return (size + 7) & ~uint64_t(7);
+    }
+
+    uint32_t table_crc = 0;
+    uint64_t section_size = 0;
+    uint32_t *crcs = nullptr;
+};
+
+#endif /* __HET_INFO_CHECKSUMS_HPP__ */
@@ -0,0 +1,94 @@
+#ifndef __HET_INFO_COLUMNAR_HPP__
+#define __HET_INFO_COLUMNAR_HPP__
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "het_info.hpp"
+#include "het_info_compact.hpp"
+
+/**
+ * @brief Columnar (v4) layout of het info binary files (see
+ *        pp_extractor/doc/Binary_Format.md). Same header, offset table and
+ *        sample block header as the original layout and same size, but the
+ *        het infos of a sample block are stored by column : the VCF lines,
+ *        then the alleles (a0, a1 pairs), then the PP. Scans that only need
+ *        a column (e.g., the PP) read a fraction of the pages and can be
+ *        vectorized, the file can still be modified in place (HetInfoRef).
+ */
+class HetInfoColumnar {
+public:
+    static constexpr uint32_t FILE_MARK = 0xaabbcc04;
+    static constexpr uint32_t SAMPLE_BLOCK_MARK = 0xd00dc0d4;
+    static constexpr uint64_t SAMPLE_BLOCK_HEADER_SIZE = 3 * sizeof(uint32_t); /* Mark, id, size */
+
+    static uint64_t block_size(const size_t n_hets) {
+        return SAMPLE_BLOCK_HEADER_SIZE + n_hets * sizeof(HetInfo);
+    }
+
+    static uint64_t block_size(const uint32_t *block) {
+        return block_size(block[2]);
+    }
+
+    /* Columns of a sample block of n het infos (records is the block after its header) */
+    static uint32_t *vcf_lines(uint32_t *records, const size_t) {
+        return records;
+    }
+
+    static int *gts(uint32_t *records, const size_t n) {
+        return reinterpret_cast<int*>(records + n);
+    }
+
+    static float *pps(uint32_t *records, const size_t n) {
+        return reinterpret_cast<float*>(records + 3 * n);
+    }
+
+    static HetInfoRef nth(uint32_t *records, const size_t n, const size_t i) {
+        return HetInfoRef(vcf_lines(records, n) + i, gts(records, n) + 2 * i, pps(records, n) + i);
+    }
+
+    /* Encodes a sample block (header included) */
+    static std::vector<uint32_t> encode_block(const uint32_t id, const std::vector<HetInfo>& his) {
+        const size_t n = his.size();
+        std::vector<uint32_t> block(block_size(n) / sizeof(uint32_t));
+        block[0] = SAMPLE_BLOCK_MARK;
+        block[1] = id;
+        block[2] = n;
+        uint32_t *records = block.data() + 3;
+        for (size_t i = 0; i < n; ++i) {
+            vcf_lines(records, n)[i] = his[i].vcf_line;
+            gts(records, n)[2*i] = his[i].a0;
+            gts(records, n)[2*i+1] = his[i].a1;
+            pps(records, n)[i] = his[i].pp;
+        }
+        return block;
+    }
+
+    static void decode_block(const uint32_t *block, std::vector<HetInfo>& his) {
+        if (block[0] != SAMPLE_BLOCK_MARK) {
+            std::cerr << "Something is wrong, columnar sample block mark not found" << std::endl;
+            throw "Mark not found";
+        }
+        const size_t n = block[2];
+        uint32_t *records = const_cast<uint32_t*>(block + 3);
+        his.resize(n);
+        for (size_t i = 0; i < n; ++i) {
+            his[i] = HetInfo(vcf_lines(records, n)[i], gts(records, n)[2*i], gts(records, n)[2*i+1], pps(records, n)[i]);
+        }
+    }
+
+    /* Decodes a columnar sample block in the original sample block layout */
+    static void decode_to_raw_block(const uint32_t *block, std::vector<uint32_t>& raw_block) {
+        std::vector<HetInfo> his;
+        decode_block(block, his);
+        raw_block.resize(3 + his.size() * 4);
+        raw_block[0] = 0xd00dc0de;
+        raw_block[1] = block[1];
+        raw_block[2] = his.size();
+        memcpy(raw_block.data() + 3, his.data(), his.size() * sizeof(HetInfo));
+    }
+};
+
+#endif /* __HET_INFO_COLUMNAR_HPP__ */
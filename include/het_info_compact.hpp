@@ -0,0 +1,239 @@
+#ifndef __HET_INFO_COMPACT_HPP__
+#define __HET_INFO_COMPACT_HPP__
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "het_info.hpp"
+
+/* Het info of the compact layout, 8 bytes (bi-allelic genotypes only) */
+class CompactHetInfo {
+public:
+    static constexpr uint8_t A0_ALT = 0x01;
+    static constexpr uint8_t A1_ALT = 0x02;
+    static constexpr uint8_t A0_PHASED = 0x04;
+    static constexpr uint8_t A1_PHASED = 0x08;
+    /* Rephased with sequencing reads, the value is the number of reads instead of the PP */
+    static constexpr uint8_t VALIDATED = 0x10;
+    static constexpr uint8_t PP_MISSING = 0x20;
+
+    uint32_t vcf_line;
+    uint16_t value;
+    uint8_t flags;
+    uint8_t reserved;
+};
+
+/**
+ * @brief Compact (v3) layout of het info binary files (see
+ *        pp_extractor/doc/Binary_Format.md). Same header, offset table and
+ *        sample block header as the original layout, but the het infos are
+ *        8 bytes : VCF line, the two alleles and their phase as bits, and
+ *        either the PP quantized to 1/10000 or the number of reads that
+ *        validated the phase. Unlike the compressed layout the records have a
+ *        fixed size, so the file can still be modified in place (phase_caller,
+ *        bin_switch) through HetInfoRef.
+ */
+class HetInfoCompact {
+public:
+    static constexpr uint32_t FILE_MARK = 0xaabbcc03;
+    static constexpr uint32_t SAMPLE_BLOCK_MARK = 0xd00dc0d3;
+    static constexpr uint64_t SAMPLE_BLOCK_HEADER_SIZE = 3 * sizeof(uint32_t); /* Mark, id, size */
+    static constexpr float PP_SCALE = 10000.0f;
+    static constexpr uint16_t MAX_READS = 0xffff;
+
+    static uint64_t block_size(const size_t n_hets) {
+        return SAMPLE_BLOCK_HEADER_SIZE + n_hets * sizeof(CompactHetInfo);
+    }
+
+    static uint64_t block_size(const uint32_t *block) {
+        return block_size(block[2]);
+    }
+
+    /* Throws if the het info cannot be stored in the compact layout (multi-allelic or missing allele) */
+    static CompactHetInfo encode(const HetInfo& hi) {
+        CompactHetInfo c = {uint32_t(hi.vcf_line), 0, 0, 0};
+        c.flags |= encode_allele(hi.a0, CompactHetInfo::A0_ALT, CompactHetInfo::A0_PHASED);
+        c.flags |= encode_allele(hi.a1, CompactHetInfo::A1_ALT, CompactHetInfo::A1_PHASED);
+        if (std::isnan(hi.pp)) {
+            // NaN (no PP) or the BCF missing/vector end values (kept as is)
+            uint32_t bits;
+            memcpy(&bits, &hi.pp, sizeof(bits));
+            c.flags |= CompactHetInfo::PP_MISSING;
+            c.value = ((bits & 0xffff0000) == BCF_NAN_BITS) ? uint16_t(bits) : 0;
+        } else if (hi.pp > 1.0) {
+            // Rephased, PP was incremented by the number of reads + 1 (the original PP is lost)
+            c.flags |= CompactHetInfo::VALIDATED;
+            c.value = std::min(uint32_t(hi.pp) - 1, uint32_t(MAX_READS));
+        } else {
+            c.value = uint16_t(std::round(std::max(0.0f, hi.pp) * PP_SCALE));
+        }
+        return c;
+    }
+
+    static HetInfo decode(const CompactHetInfo& c) {
+        return HetInfo(c.vcf_line,
+                       decode_allele(c.flags, CompactHetInfo::A0_ALT, CompactHetInfo::A0_PHASED),
+                       decode_allele(c.flags, CompactHetInfo::A1_ALT, CompactHetInfo::A1_PHASED),
+                       decode_pp(c));
+    }
+
+    /* Same meaning as the PP of HetInfo, validated het infos give the number of reads + 1 */
+    static float decode_pp(const CompactHetInfo& c) {
+        if (c.flags & CompactHetInfo::VALIDATED) {
+            return c.value + 1.0f;
+        }
+        if (c.flags & CompactHetInfo::PP_MISSING) {
+            if (!c.value) {
+                return NAN;
+            }
+            const uint32_t bits = BCF_NAN_BITS | c.value;
+            float pp;
+            memcpy(&pp, &bits, sizeof(pp));
+            return pp;
+        }
+        return c.value / PP_SCALE;
+    }
+
+    /* Encodes a sample block (header included) */
+    static std::vector<uint32_t> encode_block(const uint32_t id, const std::vector<HetInfo>& his) {
+        static_assert(sizeof(CompactHetInfo) == 2 * sizeof(uint32_t), "CompactHetInfo is stored as is");
+        std::vector<uint32_t> block(block_size(his.size()) / sizeof(uint32_t));
+        block[0] = SAMPLE_BLOCK_MARK;
+        block[1] = id;
+        block[2] = his.size();
+        CompactHetInfo *records = reinterpret_cast<CompactHetInfo*>(block.data() + 3);
+        for (size_t i = 0; i < his.size(); ++i) {
+            records[i] = encode(his[i]);
+        }
+        return block;
+    }
+
+    static void decode_block(const uint32_t *block, std::vector<HetInfo>& his) {
+        if (block[0] != SAMPLE_BLOCK_MARK) {
+            std::cerr << "Something is wrong, compact sample block mark not found" << std::endl;
+            throw "Mark not found";
+        }
+        const CompactHetInfo *records = reinterpret_cast<const CompactHetInfo*>(block + 3);
+        his.resize(block[2]);
+        for (size_t i = 0; i < his.size(); ++i) {
+            his[i] = decode(records[i]);
+        }
+    }
+
+    /* Decodes a compact sample block in the original sample block layout */
+    static void decode_to_raw_block(const uint32_t *block, std::vector<uint32_t>& raw_block) {
+        std::vector<HetInfo> his;
+        decode_block(block, his);
+        raw_block.resize(3 + his.size() * 4);
+        raw_block[0] = 0xd00dc0de;
+        raw_block[1] = block[1];
+        raw_block[2] = his.size();
+        memcpy(raw_block.data() + 3, his.data(), his.size() * sizeof(HetInfo));
+    }
+
+    /* Allele and phase bits of an allele in BCF encoding */
+    static uint8_t encode_allele(const int a, const uint8_t alt_bit, const uint8_t phased_bit) {
+        const int allele = bcf_gt_allele(a);
+        if (bcf_gt_is_missing(a) || allele < 0 || allele > 1) {
+            std::cerr << "Allele " << allele << " cannot be stored in the compact layout (bi-allelic only)" << std::endl;
+            throw "Allele not bi-allelic";
+        }
+        return (allele ? alt_bit : 0) | (bcf_gt_is_phased(a) ? phased_bit : 0);
+    }
+
+    static int decode_allele(const uint8_t flags, const uint8_t alt_bit, const uint8_t phased_bit) {
+        const int allele = (flags & alt_bit) ? 1 : 0;
+        return (flags & phased_bit) ? bcf_gt_phased(allele) : bcf_gt_unphased(allele);
+    }
+
+    /* Upper bits of bcf_float_missing and bcf_float_vector_end */
+    static constexpr uint32_t BCF_NAN_BITS = 0x7f800000;
+    static constexpr uint8_t GT_BITS = CompactHetInfo::A0_ALT | CompactHetInfo::A1_ALT | CompactHetInfo::A0_PHASED | CompactHetInfo::A1_PHASED;
+};
+
+/**
+ * @brief Typed view on a het info in a memory mapped sample block (original,
+ *        compact or columnar layout) or on GT and PP arrays (as in BCF), it
+ *        reads and writes the het info in place.
+ */
+class HetInfoRef {
+public:
+    HetInfoRef() {}
+    /* Original layout (4 words) */
+    HetInfoRef(uint32_t *record) : gt((int*)record+1), pp_p((float*)record+3), vcf_line_p(record) {}
+    /* GT and PP arrays of a single sample (no VCF line) */
+    HetInfoRef(int *gt, float *pp) : gt(gt), pp_p(pp) {}
+    /* Columnar layout (see HetInfoColumnar) */
+    HetInfoRef(uint32_t *vcf_line, int *gt, float *pp) : gt(gt), pp_p(pp), vcf_line_p(vcf_line) {}
+    /* Compact layout */
+    HetInfoRef(CompactHetInfo *record) : compact(record) {}
+
+    /* Het info i of the records of a sample block (after its header) */
+    static HetInfoRef nth(uint32_t *records, const size_t i, const bool is_compact) {
+        if (is_compact) {
+            return HetInfoRef(reinterpret_cast<CompactHetInfo*>(records) + i);
+        }
+        return HetInfoRef(records + i * 4);
+    }
+
+    int vcf_line() const {
+        return compact ? compact->vcf_line : *vcf_line_p;
+    }
+
+    /* Alleles in BCF encoding */
+    int a0() const {
+        return compact ? HetInfoCompact::decode_allele(compact->flags, CompactHetInfo::A0_ALT, CompactHetInfo::A0_PHASED) : gt[0];
+    }
+
+    int a1() const {
+        return compact ? HetInfoCompact::decode_allele(compact->flags, CompactHetInfo::A1_ALT, CompactHetInfo::A1_PHASED) : gt[1];
+    }
+
+    void set_gt(const int a0, const int a1) {
+        if (compact) {
+            compact->flags = (compact->flags & ~HetInfoCompact::GT_BITS) |
+                HetInfoCompact::encode_allele(a0, CompactHetInfo::A0_ALT, CompactHetInfo::A0_PHASED) |
+                HetInfoCompact::encode_allele(a1, CompactHetInfo::A1_ALT, CompactHetInfo::A1_PHASED);
+        } else {
+            gt[0] = a0;
+            gt[1] = a1;
+        }
+    }
+
+    /* Swaps the alleles, the first allele is always unphased per VCF/BCF standard */
+    void switch_phase() {
+        const int allele0 = bcf_gt_allele(a0());
+        const int allele1 = bcf_gt_allele(a1());
+        set_gt(bcf_gt_unphased(allele1), bcf_gt_phased(allele0));
+    }
+
+    /* PP, NaN if missing, number of reads + 1 (plus the PP in the original layout) if validated */
+    float pp() const {
+        return compact ? HetInfoCompact::decode_pp(*compact) : *pp_p;
+    }
+
+    void set_validated(const size_t number_of_reads) {
+        if (compact) {
+            compact->flags = (compact->flags | CompactHetInfo::VALIDATED) & ~CompactHetInfo::PP_MISSING;
+            compact->value = std::min(number_of_reads, size_t(HetInfoCompact::MAX_READS));
+        } else {
+            *pp_p += number_of_reads+1;
+        }
+    }
+
+    HetInfo to_het_info() const {
+        return HetInfo(vcf_line(), a0(), a1(), pp());
+    }
+
+protected:
+    int *gt = nullptr;
+    float *pp_p = nullptr;
+    uint32_t *vcf_line_p = nullptr;
+    CompactHetInfo *compact = nullptr;
+};
+
+#endif /* __HET_INFO_COMPACT_HPP__ */
@@ -0,0 +1,219 @@
+#ifndef __HET_INFO_COMPRESSED_HPP__
+#define __HET_INFO_COMPRESSED_HPP__
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "zstd.h"
+#include "het_info.hpp"
+
+/**
+ * @brief Compressed (v2) sample blocks of het info binary files (see
+ *        pp_extractor/doc/Binary_Format.md). The file keeps the header and
+ *        offset table of the original layout, so any sample block can be
+ *        decoded on its own.
+ *
+ *        The het infos of a block are encoded by column then compressed with
+ *        zstd : the VCF lines as varints of their (zigzag) delta, the two
+ *        alleles packed in a byte (a nibble each, in BCF encoding), the PP
+ *        quantized on a grid of 1/1000 (the precision of the phasing
+ *        software). Values that don't fit (alleles above 6, PP off the grid)
+ *        are escaped and stored as is, the encoding is lossless.
+ */
+class HetInfoCompression {
+public:
+    static constexpr uint32_t FILE_MARK = 0xaabbcc02;
+    static constexpr uint32_t SAMPLE_BLOCK_MARK = 0xd00dc0d2;
+    /* Mark, id, number of het infos, encoded size, compressed size */
+    static constexpr uint64_t SAMPLE_BLOCK_HEADER_SIZE = 5 * sizeof(uint32_t);
+    static constexpr int DEFAULT_LEVEL = 3;
+
+    /* Encodes and compresses the het infos of a sample block (header included, padded to 4 bytes) */
+    static std::vector<char> compress_block(const uint32_t id, const HetInfo *his, const size_t n, const int level = DEFAULT_LEVEL) {
+        const std::vector<uint8_t> encoded = encode(his, n);
+        std::vector<char> block(SAMPLE_BLOCK_HEADER_SIZE + ZSTD_compressBound(encoded.size()));
+        const size_t compressed_size = ZSTD_compress(block.data() + SAMPLE_BLOCK_HEADER_SIZE, block.size() - SAMPLE_BLOCK_HEADER_SIZE,
+                                                     encoded.data(), encoded.size(), level);
+        if (ZSTD_isError(compressed_size)) {
+            std::cerr << "Failed to compress sample block : " << ZSTD_getErrorName(compressed_size) << std::endl;
+            throw "Failed to compress";
+        }
+        const uint32_t header[5] = {SAMPLE_BLOCK_MARK, id, uint32_t(n), uint32_t(encoded.size()), uint32_t(compressed_size)};
+        memcpy(block.data(), header, sizeof(header));
+        block.resize(SAMPLE_BLOCK_HEADER_SIZE + padded(compressed_size), 0);
+        return block;
+    }
+
+    static std::vector<char> compress_block(const uint32_t id, const std::vector<HetInfo>& his, const int level = DEFAULT_LEVEL) {
+        return compress_block(id, his.data(), his.size(), level);
+    }
+
+    /* Size of the compressed block in bytes, header and padding included */
+    static uint64_t block_size(const uint32_t *block) {
+        return SAMPLE_BLOCK_HEADER_SIZE + padded(block[4]);
+    }
+
+    /* Decodes a compressed sample block, the id and het infos are returned */
+    static void decompress_block(const uint32_t *block, uint32_t& id, std::vector<HetInfo>& his) {
+        if (block[0] != SAMPLE_BLOCK_MARK) {
+            std::cerr << "Something is wrong, compressed sample block mark not found" << std::endl;
+            throw "Mark not found";
+        }
+        id = block[1];
+        const uint32_t n = block[2];
+        std::vector<uint8_t> encoded(block[3]);
+        const size_t size = ZSTD_decompress(encoded.data(), encoded.size(), block + SAMPLE_BLOCK_HEADER_SIZE / sizeof(uint32_t), block[4]);
+        if (ZSTD_isError(size) || size != encoded.size()) {
+            std::cerr << "Failed to decompress sample block of sample " << id << std::endl;
+            throw "Failed to decompress";
+        }
+        decode(encoded, n, his);
+    }
+
+    /* Decodes a compressed sample block in the original (uncompressed) sample block layout */
+    static void decompress_to_raw_block(const uint32_t *block, std::vector<uint32_t>& raw_block) {
+        uint32_t id = 0;
+        std::vector<HetInfo> his;
+        decompress_block(block, id, his);
+        static_assert(sizeof(HetInfo) == 4 * sizeof(uint32_t), "HetInfo is stored as is");
+        raw_block.resize(3 + his.size() * 4);
+        raw_block[0] = 0xd00dc0de;
+        raw_block[1] = id;
+        raw_block[2] = his.size();
+        memcpy(raw_block.data() + 3, his.data(), his.size() * sizeof(HetInfo));
+    }
+
+protected:
+    static constexpr float PP_SCALE = 1000.0f;
+    static constexpr uint16_t PP_NAN = 0xffff;
+    static constexpr uint16_t PP_RAW = 0xfffe;
+    static constexpr uint8_t GT_RAW = 0xff;
+
+    static uint64_t padded(const uint64_t size) {
+        return (size + 3) & ~uint64_t(3);
+    }
+
+    static void put_varint(std::vector<uint8_t>& out, uint64_t v) {
+        while (v >= 0x80) {
+            out.push_back(uint8_t(v) | 0x80);
+            v >>= 7;
+        }
+        out.push_back(uint8_t(v));
+    }
+
+    static uint64_t get_varint(const uint8_t *&p, const uint8_t *end) {
+        uint64_t v = 0;
+        for (int shift = 0; p < end && shift < 64; shift += 7) {
+            const uint8_t byte = *p++;
+            v |= uint64_t(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                return v;
+            }
+        }
+        std::cerr << "Corrupted compressed sample block" << std::endl;
+        throw "Corrupted sample block";
+    }
+
+    /* PP on the grid (exactly as decoded) or escape code */
+    static uint16_t quantize_pp(const float pp) {
+        if (std::isnan(pp)) {
+            // Other NaN payloads are kept as is
+            const float nan = NAN;
+            return memcmp(&nan, &pp, sizeof(pp)) ? PP_RAW : PP_NAN;
+        }
+        const float scaled = std::round(pp * PP_SCALE);
+        if (scaled >= 0 && scaled < PP_RAW) {
+            const float decoded = uint16_t(scaled) / PP_SCALE;
+            if (!memcmp(&decoded, &pp, sizeof(pp))) {
+                return uint16_t(scaled);
+            }
+        }
+        return PP_RAW;
+    }
+
+    static std::vector<uint8_t> encode(const HetInfo *his, const size_t n) {
+        std::vector<uint8_t> out;
+        out.reserve(n * 5);
+        // VCF lines
+        int64_t previous = 0;
+        for (size_t i = 0; i < n; ++i) {
+            const int64_t delta = int64_t(his[i].vcf_line) - previous;
+            put_varint(out, (uint64_t(delta) << 1) ^ uint64_t(delta >> 63));
+            previous = his[i].vcf_line;
+        }
+        // Alleles
+        for (size_t i = 0; i < n; ++i) {
+            const uint32_t a0 = his[i].a0;
+            const uint32_t a1 = his[i].a1;
+            out.push_back((a0 < 0xf && a1 < 0xf) ? uint8_t(a0 | (a1 << 4)) : GT_RAW);
+        }
+        // PP
+        for (size_t i = 0; i < n; ++i) {
+            const uint16_t q = quantize_pp(his[i].pp);
+            out.push_back(uint8_t(q));
+            out.push_back(uint8_t(q >> 8));
+        }
+        // Escaped values, in the same order
+        for (size_t i = 0; i < n; ++i) {
+            if (!(uint32_t(his[i].a0) < 0xf && uint32_t(his[i].a1) < 0xf)) {
+                put_varint(out, uint32_t(his[i].a0));
+                put_varint(out, uint32_t(his[i].a1));
+            }
+        }
+        for (size_t i = 0; i < n; ++i) {
+            if (quantize_pp(his[i].pp) == PP_RAW) {
+                const uint8_t *p = reinterpret_cast<const uint8_t*>(&his[i].pp);
+                out.insert(out.end(), p, p + sizeof(float));
+            }
+        }
+        return out;
+    }
+
+    static void decode(const std::vector<uint8_t>& in, const size_t n, std::vector<HetInfo>& his) {
+        his.resize(n);
+        const uint8_t *p = in.data();
+        const uint8_t *end = in.data() + in.size();
+        int64_t line = 0;
+        for (size_t i = 0; i < n; ++i) {
+            const uint64_t zz = get_varint(p, end);
+            line += int64_t(zz >> 1) ^ -int64_t(zz & 1);
+            his[i].vcf_line = line;
+        }
+        if (size_t(end - p) < 3 * n) {
+            std::cerr << "Corrupted compressed sample block" << std::endl;
+            throw "Corrupted sample block";
+        }
+        const uint8_t *gt = p;
+        const uint8_t *pp = p + n;
+        p += 3 * n;
+        for (size_t i = 0; i < n; ++i) {
+            if (gt[i] == GT_RAW) {
+                his[i].a0 = get_varint(p, end);
+                his[i].a1 = get_varint(p, end);
+            } else {
+                his[i].a0 = gt[i] & 0xf;
+                his[i].a1 = gt[i] >> 4;
+            }
+        }
+        for (size_t i = 0; i < n; ++i) {
+            const uint16_t q = pp[2*i] | (uint16_t(pp[2*i+1]) << 8);
+            if (q == PP_NAN) {
+                his[i].pp = NAN;
+            } else if (q == PP_RAW) {
+                if (size_t(end - p) < sizeof(float)) {
+                    std::cerr << "Corrupted compressed sample block" << std::endl;
+                    throw "Corrupted sample block";
+                }
+                memcpy(&his[i].pp, p, sizeof(float));
+                p += sizeof(float);
+            } else {
+                his[i].pp = q / PP_SCALE;
+            }
+        }
+    }
+};
+
+#endif /* __HET_INFO_COMPRESSED_HPP__ */
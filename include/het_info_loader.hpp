@@ -1,6 +1,8 @@
 #ifndef __HET_INFO_LOADER_HPP__
 #define __HET_INFO_LOADER_HPP__
 
+#include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <cstddef>
 #include <fcntl.h>
@@ -8,10 +10,21 @@
 #include <iostream>
 #include <iterator>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <numeric>
 #include <sys/mman.h>
 
 #include "fs.hpp"
 #include "het_info.hpp"
+#include "het_info_writer.hpp"
+#include "het_info_checksums.hpp"
+#include "het_info_compressed.hpp"
+#include "het_info_compact.hpp"
+#include "het_info_columnar.hpp"
+#include "het_info_sample_table.hpp"
+#include "het_info_skip_index.hpp"
+#include "het_info_span.hpp"
 #include "var_info.hpp"
 
 const uint32_t ENDIANNESS = 0xaabbccdd;
@@ -19,7 +32,7 @@ const uint32_t ENDIANNESS = 0xaabbccdd;
 class HetInfoMemoryMap {
 public:
     HetInfoMemoryMap(std::string bfname) : HetInfoMemoryMap(bfname, PROT_READ) {}
-    HetInfoMemoryMap(std::string bfname, int mmflags) : file_size(fs::file_size(bfname)) {
+    HetInfoMemoryMap(std::string bfname, int mmflags) : file_size(fs::file_size(bfname)), writable(mmflags & PROT_WRITE) {
         fd = open(bfname.c_str(), (mmflags & PROT_WRITE) ? O_RDWR : O_RDONLY, 0);
         if (fd < 0) {
             std::cerr << "Failed to open file : " << bfname << std::endl;
@@ -35,13 +48,70 @@ public:
 
         // Test the memory map (first thing is the endianness in the file)
         uint32_t endianness = *(uint32_t*)(file_mmap_p);
-        if (endianness != ENDIANNESS) {
+        num_samples = *((uint32_t*)file_mmap_p+1);
+        if (endianness == ENDIANNESS) {
+            offset_table = ((uint64_t*)file_mmap_p+1);
+            layout_size = (num_samples + 1) * sizeof(uint64_t);
+        } else if (endianness == HetInfoCompression::FILE_MARK) {
+            // Compressed layout, the sample blocks are decoded when accessed
+            if (mmflags & PROT_WRITE) {
+                std::cerr << "File " << bfname << " is compressed and cannot be modified in place, decompress it with bin_convert" << std::endl;
+                throw "Compressed file is read only";
+            }
+            compressed = true;
+            offset_table = ((uint64_t*)file_mmap_p+1);
+            layout_size = (num_samples + 1) * sizeof(uint64_t);
+            decoded_blocks.resize(num_samples);
+            decode_mutexes = std::make_unique<std::mutex[]>(num_samples);
+        } else if (endianness == HetInfoCompact::FILE_MARK || endianness == HetInfoColumnar::FILE_MARK) {
+            // Compact and columnar layouts, modified in place through HetInfoRef, decoded for the other accesses
+            compact = (endianness == HetInfoCompact::FILE_MARK);
+            columnar = (endianness == HetInfoColumnar::FILE_MARK);
+            offset_table = ((uint64_t*)file_mmap_p+1);
+            layout_size = (num_samples + 1) * sizeof(uint64_t);
+            decoded_blocks.resize(num_samples);
+            decode_mutexes = std::make_unique<std::mutex[]>(num_samples);
+        } else if (endianness == HetInfoStreamWriter::STREAM_MARK) {
+            // Streaming layout, the offset table is in the footer
+            if (file_size < HetInfoStreamWriter::HEADER_SIZE + HetInfoStreamWriter::TRAILER_SIZE) {
+                std::cerr << "Bad trailer in memory map" << std::endl;
+                throw "Bad trailer";
+            }
+            const char *trailer = (char*)file_mmap_p + file_size - HetInfoStreamWriter::TRAILER_SIZE;
+            const uint64_t table_offset = *(uint64_t*)trailer;
+            if (*((uint32_t*)(trailer + sizeof(uint64_t)) + 1) != HetInfoStreamWriter::TRAILER_MARK ||
+                *(uint32_t*)(trailer + sizeof(uint64_t)) != num_samples ||
+                table_offset + num_samples * sizeof(uint64_t) + HetInfoStreamWriter::TRAILER_SIZE != file_size) {
+                std::cerr << "Bad trailer in memory map" << std::endl;
+                throw "Bad trailer";
+            }
+            streaming = true;
+            offset_table = (uint64_t*)((char*)file_mmap_p + table_offset);
+            layout_size = HetInfoStreamWriter::HEADER_SIZE + num_samples * sizeof(uint64_t) + HetInfoStreamWriter::TRAILER_SIZE;
+        } else {
             std::cerr << "Bad endianness in memory map" << std::endl;
             throw "Bad endianness";
         }
 
-        num_samples = *((uint32_t*)file_mmap_p+1);
-        offset_table = ((uint64_t*)file_mmap_p+1);
+        // Optional sections after the offset table (not in the streaming layout)
+        while (!streaming) {
+            char *section = (char*)file_mmap_p + layout_size;
+            const uint64_t available = file_size - std::min(file_size, layout_size);
+            if (sample_table.empty() && HetInfoSampleTable::is_at(section, available)) {
+                sample_table = HetInfoSampleTable(section, num_samples, available);
+                layout_size += sample_table.size();
+            } else if (skip_index.empty() && HetInfoSkipIndex::is_at(section, available)) {
+                skip_index = HetInfoSkipIndex(section, num_samples, available);
+                layout_size += skip_index.size();
+            } else if (checksums.empty() && HetInfoChecksums::is_at(section, available)) {
+                checksums = HetInfoChecksums(section, num_samples, available);
+                checksums_offset = layout_size;
+                layout_size += checksums.size();
+                checksum_states = std::make_unique<std::atomic<uint8_t>[]>(num_samples);
+            } else {
+                break;
+            }
+        }
     }
 
     ~HetInfoMemoryMap() {
@@ -56,8 +126,23 @@ public:
         }
     }
 
+    /* Sample block in the original layout, blocks of the other layouts are decoded once and kept until released
+     * (the decoded block is a copy, use HetInfoPtrContainer to modify a compact or columnar file in place) */
     uint32_t *get_ptr_on_nth(uint32_t n) const {
-        uint32_t *start = ((uint32_t*)(((char*)file_mmap_p) + offset_table[n]));
+        if (encoded()) {
+            std::lock_guard<std::mutex> lock(decode_mutexes[n]);
+            if (decoded_blocks[n].empty()) {
+                if (compressed) {
+                    HetInfoCompression::decompress_to_raw_block(get_stored_ptr_on_nth(n), decoded_blocks[n]);
+                } else if (compact) {
+                    HetInfoCompact::decode_to_raw_block(get_header_on_nth(n), decoded_blocks[n]);
+                } else {
+                    HetInfoColumnar::decode_to_raw_block(get_header_on_nth(n), decoded_blocks[n]);
+                }
+            }
+            return decoded_blocks[n].data();
+        }
+        uint32_t *start = get_stored_ptr_on_nth(n);
         if (*start != 0xd00dc0de) {
             std::cerr << "Something is wrong, mark not found for idx " << n << std::endl;
             return nullptr;
@@ -66,8 +151,89 @@ public:
         }
     }
 
+    /* Frees the decoded sample block (not in the original layout), the pointers on it are no longer valid */
+    void release_nth(uint32_t n) const {
+        if (encoded()) {
+            std::lock_guard<std::mutex> lock(decode_mutexes[n]);
+            decoded_blocks[n] = std::vector<uint32_t>();
+        }
+    }
+
+    bool is_compressed() const {
+        return compressed;
+    }
+
+    bool is_compact() const {
+        return compact;
+    }
+
+    bool is_columnar() const {
+        return columnar;
+    }
+
+    /* Sample block as accessed through HetInfoRef, in place (as stored) for the compact and columnar layouts */
+    uint32_t *get_ref_block_on_nth(uint32_t n) const {
+        return (compact || columnar) ? get_header_on_nth(n) : get_ptr_on_nth(n);
+    }
+
+    /* View on the het infos of sample n without copy, writable if the file is mapped with PROT_WRITE
+     * (compressed files : view on the decoded block, valid until release_nth()) */
+    HetInfoSpan get_span_of_nth(uint32_t n) const {
+        uint32_t *block = get_ref_block_on_nth(n);
+        if (!block) {
+            std::cerr << "Wrong mark on sample index" << n << std::endl;
+            throw "Wrong mark";
+        }
+        const HetInfoSpan::Layout layout = compact ? HetInfoSpan::COMPACT : columnar ? HetInfoSpan::COLUMNAR : HetInfoSpan::ORIGINAL;
+        return HetInfoSpan(block + 3, *(block + 2), layout, writable && !compressed);
+    }
+
+    /* Number of het infos of sample n whose PP satisfies pred, only the PP column is read in the columnar layout */
+    template <typename Pred>
+    size_t count_pp_if(uint32_t n, Pred pred) const {
+        size_t counter = 0;
+        const HetInfoSpan span = get_span_of_nth(n);
+        if (const float *pp = span.pp_column()) {
+            const size_t size = span.size();
+            for (size_t i = 0; i < size; ++i) {
+                counter += pred(pp[i]);
+            }
+        } else {
+            for (const auto hi : span) {
+                counter += pred(hi.pp());
+            }
+        }
+        release_nth(n);
+        return counter;
+    }
+
+    /* Calls f on the het infos of sample n whose PP satisfies pred, the others are not read beyond their PP in the columnar layout */
+    template <typename Pred, typename F>
+    void for_each_if_pp(uint32_t n, Pred pred, F f) const {
+        for (const auto hi : get_span_of_nth(n)) {
+            if (pred(hi.pp())) {
+                f(hi.to_het_info());
+            }
+        }
+        release_nth(n);
+    }
+
     std::vector<HetInfo> get_het_info_for_nth(uint32_t n) const {
         std::vector<HetInfo> his;
+        if (compressed) {
+            // Decoded directly, not kept
+            uint32_t id = 0;
+            HetInfoCompression::decompress_block(get_stored_ptr_on_nth(n), id, his);
+            return his;
+        }
+        if (compact) {
+            HetInfoCompact::decode_block(get_header_on_nth(n), his);
+            return his;
+        }
+        if (columnar) {
+            HetInfoColumnar::decode_block(get_header_on_nth(n), his);
+            return his;
+        }
         auto start = get_ptr_on_nth(n);
         auto size = *(start + 2); /* Skip Mark, id */
         auto p = start + 3; /* Skip Mark, id, size */
@@ -78,13 +244,18 @@ public:
         return his;
     }
 
+    /* Size of the sample block in the original layout (also for compressed files, without decoding) */
     uint32_t get_size_of_nth(uint32_t n) const {
-        const auto start = get_ptr_on_nth(n);
+        const auto start = get_header_on_nth(n);
         return *(start+2) * sizeof(uint32_t) * 4 /* Size of HetInfo */ + 3 * sizeof(uint32_t); /* Mark, id, size */
     }
 
+    /* From the sample table if any (the sample block is not read) */
     uint32_t get_orig_idx_of_nth(uint32_t n) const {
-        const auto start = get_ptr_on_nth(n);
+        if (!sample_table.empty()) {
+            return sample_table.orig_idx_of_nth(n);
+        }
+        const auto start = get_header_on_nth(n);
         return *(start+1);
     }
 
@@ -96,32 +267,154 @@ public:
         return map;
     }
 
-    bool integrity_check_pass() const {
-        size_t computed_size = (num_samples + 1) * sizeof(uint64_t);
+    bool has_sample_table() const {
+        return !sample_table.empty();
+    }
 
-        bool pass = true;
-        for (size_t i = 0; i < num_samples-1; ++i) {
-            computed_size += get_size_of_nth(i);
-            auto p1 = get_ptr_on_nth(i);
-            auto p2 = get_ptr_on_nth(i+1);
-            if (*p1 != 0xd00dc0de) pass = false;
-            if (*p2 != 0xd00dc0de) pass = false;
-            if (((uint32_t*)((uint8_t*)p1 + get_size_of_nth(i))) != p2) {
-                std::cerr << "Offset " << i << "and next one don't match up !" << std::endl;
-                pass = false;
+    bool has_sample_names() const {
+        return sample_table.has_names();
+    }
+
+    const HetInfoSampleTable& get_sample_table() const {
+        return sample_table;
+    }
+
+    /* Sample block of the original sample ID, binary search in the sample table, all the sample blocks are read without it */
+    bool find_nth_of_orig_idx(uint32_t id, uint32_t& n) const {
+        if (!sample_table.empty()) {
+            return sample_table.find_orig_idx(id, n);
+        }
+        for (uint32_t i = 0; i < num_samples; ++i) {
+            if (get_orig_idx_of_nth(i) == id) {
+                n = i;
+                return true;
             }
         }
-        computed_size += get_size_of_nth(num_samples-1);
-        if (computed_size != file_size) {
+        return false;
+    }
+
+    /* Sample block of the sample name, requires the sample names in the sample table */
+    bool find_nth_of_sample_name(const std::string& name, uint32_t& n) const {
+        return sample_table.find_name(name, n);
+    }
+
+    std::string get_sample_name_of_nth(uint32_t n) const {
+        if (!sample_table.has_names()) {
+            std::cerr << "The binary file has no sample names" << std::endl;
+            throw "No sample names";
+        }
+        return std::string(sample_table.name_of_nth(n));
+    }
+
+    /* Sample table for the given sample blocks of this file (in this order), empty if this file has none */
+    std::vector<char> get_sample_table_of(const std::vector<uint32_t>& nths) const {
+        return sample_table.empty() ? std::vector<char>() : sample_table.encode_subset(nths);
+    }
+
+    bool has_skip_index() const {
+        return !skip_index.empty();
+    }
+
+    const HetInfoSkipIndex& get_skip_index() const {
+        return skip_index;
+    }
+
+    /* Skip index for the given sample blocks of this file (in this order), empty if this file has none */
+    std::vector<char> get_skip_index_of(const std::vector<uint32_t>& nths) const {
+        return skip_index.empty() ? std::vector<char>() : skip_index.encode_subset(nths);
+    }
+
+    /* Optional sections (sample table, skip index) of a file with the given sample blocks of this file */
+    std::vector<char> get_sections_of(const std::vector<uint32_t>& nths) const {
+        std::vector<char> sections = get_sample_table_of(nths);
+        const std::vector<char> index = get_skip_index_of(nths);
+        sections.insert(sections.end(), index.begin(), index.end());
+        return sections;
+    }
+
+    /* First het info of the span of sample n with a VCF line of at least line (the het infos are in VCF line order),
+     * the skip index if any restricts the search to one interval */
+    size_t first_at_line(uint32_t n, const HetInfoSpan& span, uint32_t line) const {
+        size_t lo = 0;
+        size_t hi = span.size();
+        if (!skip_index.empty()) {
+            skip_index.window(n, line, span.size(), lo, hi);
+            lo = std::min(lo, hi);
+        }
+        return std::partition_point(span.begin() + lo, span.begin() + hi,
+                                    [line](const HetInfoRef& hi) { return uint32_t(hi.vcf_line()) < line; }) - span.begin();
+    }
+
+    /* View on the het infos of sample n with a VCF line in [begin_line, end_line), see get_span_of_nth() */
+    HetInfoSpan get_span_of_nth_in_lines(uint32_t n, uint32_t begin_line, uint32_t end_line) const {
+        const HetInfoSpan span = get_span_of_nth(n);
+        const size_t first = first_at_line(n, span, begin_line);
+        const size_t last = std::max(first, first_at_line(n, span, end_line));
+        return span.subspan(first, last - first);
+    }
+
+    /* Checks the marks, positions and sizes of the sample blocks and their checksums if any, the sample blocks are checked
+     * independently on n_threads threads */
+    bool integrity_check_pass(const size_t n_threads = 1) const {
+        if (!sections_check_pass()) {
+            return false;
+        }
+        std::vector<uint64_t> sizes(num_samples);
+        std::atomic<bool> pass(true);
+        HetInfoFileWriter::parallel_for(n_threads, num_samples, [&](const size_t i) {
+            if (!block_check_pass(i, sizes[i])) {
+                pass = false;
+            }
+        });
+        if (pass && std::accumulate(sizes.begin(), sizes.end(), uint64_t(layout_size)) != file_size) {
             std::cerr << "File has different size than it should be" << std::endl;
             pass = false;
         }
         return pass;
     }
 
+    bool has_checksums() const {
+        return !checksums.empty();
+    }
+
+    /* Checksum of sample n as stored, checked once (e.g., on first access to the sample block), true without checksums */
+    bool checksum_check_pass_of_nth(uint32_t n) const {
+        if (checksums.empty()) {
+            return true;
+        }
+        if (checksum_states[n] == CHECKSUM_UNKNOWN) {
+            uint64_t size = 0;
+            checksum_states[n] = (stored_size_of_nth(n, size) && crc32c::value(get_stored_ptr_on_nth(n), size) == checksums.crc_of_nth(n)) ?
+                                 CHECKSUM_PASS : CHECKSUM_FAIL;
+        }
+        if (checksum_states[n] == CHECKSUM_FAIL) {
+            std::cerr << "Sample block " << n << " doesn't match its checksum !" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    /* Recomputes the checksum of sample n after it was modified in place (file mapped with PROT_WRITE), the sample block
+     * should have been checked before it was modified, otherwise a corrupted block gets a valid checksum */
+    void update_checksum_of_nth(uint32_t n) {
+        if (checksums.empty()) {
+            return;
+        }
+        uint64_t size = 0;
+        if (!writable || !stored_size_of_nth(n, size)) {
+            std::cerr << "Cannot update the checksum of sample block " << n << std::endl;
+            throw "Cannot update checksum";
+        }
+        checksums.set_crc_of_nth(n, crc32c::value(get_stored_ptr_on_nth(n), size));
+        checksum_states[n] = CHECKSUM_PASS;
+    }
+
     void show_info() const {
         std::cout << "File size : " << file_size << std::endl;
         std::cout << "Number of samples : " << num_samples << std::endl;
+        std::cout << "Sample table : " << (sample_table.empty() ? "NO" : sample_table.has_names() ? "YES (IDs and names)" : "YES (IDs)") << std::endl;
+        std::cout << "Skip index : " << (skip_index.empty() ? "NO" : "YES (every " + std::to_string(skip_index.get_interval()) + " het sites)") << std::endl;
+        std::cout << "Checksums : " << (checksums.empty() ? "NO" : "YES (CRC32C)") << std::endl;
         for (size_t i = 0; i < num_samples; ++i) {
             std::cout << "Size of sample " << i << " : " << get_size_of_nth(i) << std::endl;
         }
@@ -129,49 +422,38 @@ public:
         std::cout << "File passes integrity check : " << (pass ? "YES" : "NO") << std::endl;
     }
 
-    void write_sub_file(const std::vector<uint32_t> ids_to_extract, const std::string& filename) const {
-        std::fstream ofs(filename, std::ios_base::binary | std::ios_base::out | std::ios_base::trunc);
-        if (!ofs.is_open()) {
-            std::cerr << "Cannot open file " << filename << std::endl;
-            throw "Cannot open file";
-        }
-
-        const uint32_t endianness = 0xaabbccdd;
-        // Write endianness
-        ofs.write(reinterpret_cast<const char*>(&endianness), sizeof(uint32_t));
-        // Write number of samples
-        uint32_t n = ids_to_extract.size();
-        ofs.write(reinterpret_cast<const char*>(&n), sizeof(uint32_t));
-        // Write offset table
-        std::vector<uint64_t> new_offset_table(n, 0xdeadc0dedeadc0de);
-        uint64_t dummy_offset = 0xdeadc0dedeadc0de;
-        auto table_seek = ofs.tellp();
+    void write_sub_file(const std::vector<uint32_t> ids_to_extract, const std::string& filename, const size_t n_threads = 1) const {
+        const uint32_t n = ids_to_extract.size();
+        std::vector<uint64_t> block_sizes(n);
+        std::vector<bool> valid(n, true);
         for (uint32_t i = 0; i < n; ++i) {
-            ofs.write(reinterpret_cast<const char*>(&dummy_offset), sizeof(uint64_t));
-        }
-
-        for (uint32_t i = 0; i < n; ++i) {
-            uint32_t *start = ((uint32_t*)(((char*)file_mmap_p) + offset_table[ids_to_extract[i]]));
-            if (*start != 0xd00dc0de) {
-                std::cerr << "Something is wrong, mark not found for idx " << i << std::endl;
+            uint32_t *start = get_header_on_nth(ids_to_extract[i]);
+            if (!start) {
+                std::cerr << "Something is wrong, mark not found for idx " << i << ", writing an empty block" << std::endl;
+                valid[i] = false;
+                block_sizes[i] = HetInfoFileWriter::block_size(0);
             } else {
                 uint32_t id = *(start+1);
-                uint32_t size = *(start+2);
                 if (id != ids_to_extract[i]) {
                     std::cerr << "Trying to extract id " << ids_to_extract[i] << " but found id " << id << std::endl;
                 }
-                new_offset_table[i] = ofs.tellp();
-                ofs.write(reinterpret_cast<const char*>(start), size * sizeof(uint32_t) * 4 /* Size of HetInfo */ + 3 * sizeof(uint32_t) /* Mark, id, size */);
+                block_sizes[i] = get_size_of_nth(ids_to_extract[i]);
             }
         }
 
-        // Rewrite the offset table
-        ofs.seekp(table_seek);
-        for (const auto& offset : new_offset_table) {
-            ofs.write(reinterpret_cast<const char*>(&offset), sizeof(decltype(offset)));
-        }
-
-        ofs.close();
+        // Blocks are copied as is to their final position, their checksums (if any) are checked as they are copied
+        HetInfoFileWriter writer(filename, block_sizes, HetInfoFileWriter::ENDIANNESS_MARK, get_sections_of(ids_to_extract), has_checksums());
+        writer.for_all_blocks(n_threads, [&](const size_t i) {
+            if (valid[i]) {
+                writer.write_raw_block(i, get_ptr_on_nth(ids_to_extract[i]), block_sizes[i]);
+                if (has_checksums() && !encoded() && writer.get_checksum(i) != checksums.crc_of_nth(ids_to_extract[i])) {
+                    std::cerr << "Sample block " << ids_to_extract[i] << " doesn't match its checksum !" << std::endl;
+                }
+                release_nth(ids_to_extract[i]);
+            } else {
+                writer.write_block(i, ids_to_extract[i], NULL, 0);
+            }
+        });
     }
 
     /// @note inspired by https://www.internalpointers.com/post/writing-custom-iterators-modern-cpp
@@ -209,13 +491,13 @@ public:
         using Iterator_type = Iterator<uint32_t, 4>;
     public:
         PositionContainer (HetInfoMemoryMap& parent, size_t sample) : parent(parent), sample(sample) {
-            uint32_t mark = *(uint32_t*)(((char*)parent.file_mmap_p) + parent.offset_table[sample]);
-            if (mark != 0xd00dc0de) {
+            uint32_t *block = parent.get_ptr_on_nth(sample);
+            if (!block) {
                 std::cerr << "Wrong mark on sample index" << sample << std::endl;
                 throw "Wrong mark";
             }
-            size = *(((uint32_t*)(((char*)parent.file_mmap_p) + parent.offset_table[sample])) + 2);
-            start_pos = ((uint32_t*)(((char*)parent.file_mmap_p) + parent.offset_table[sample])) + 3;
+            size = *(block + 2);
+            start_pos = block + 3;
         }
         Iterator_type begin() { return Iterator(start_pos); }
         Iterator_type end()   { return Iterator(start_pos+size*Iterator_type::skip()); }
@@ -227,43 +509,42 @@ public:
         size_t size;
     };
 
+    /* Het infos of a sample, accessed (and modified) in place through HetInfoRef in the original, compact and columnar layouts */
     class HetInfoPtrContainer {
     public:
-        using Iterator_type = Iterator<uint32_t, 4>;
-        HetInfoPtrContainer (HetInfoMemoryMap& parent, size_t sample) : parent(parent), sample(sample),
-            sample_id(*(((uint32_t*)(((char*)parent.file_mmap_p) + parent.offset_table[sample])) + 1)),
-            size(*(((uint32_t*)(((char*)parent.file_mmap_p) + parent.offset_table[sample])) + 2)),
-            start_pos(((uint32_t*)(((char*)parent.file_mmap_p) + parent.offset_table[sample])) + 3)
-        {
-            uint32_t mark = *(uint32_t*)(((char*)parent.file_mmap_p) + parent.offset_table[sample]);
-            if (mark != 0xd00dc0de) {
-                std::cerr << "Wrong mark on sample index" << sample << std::endl;
-                throw "Wrong mark";
-            }
+        HetInfoPtrContainer (HetInfoMemoryMap& parent, size_t sample) :
+            HetInfoPtrContainer(parent, sample, parent.get_span_of_nth(sample))
+        {}
+
+        /* Only the het infos of the span (e.g., get_span_of_nth_in_lines()) */
+        HetInfoPtrContainer (HetInfoMemoryMap& parent, size_t sample, const HetInfoSpan& span) : parent(parent), sample(sample),
+            span(span),
+            sample_id(parent.get_orig_idx_of_nth(sample)),
+            size(span.size())
+        {}
+
+        HetInfoRef operator[](size_t i) const {
+            return span[i];
         }
 
         void fill_het_info(std::vector<HetInfo>& v) {
-            v.clear();
-            for (size_t i = 0; i < size; ++i) {
-                v.push_back(HetInfo(start_pos+i*Iterator_type::skip()));
-            }
+            v = span.to_vector();
         }
 
         /* Switch phase of all genotypes, this is for switching vertically split
          * files that require to be switched during ligation, this should be
-         * extremely fast */
+         * extremely fast, the checksum is updated if the block was valid */
         void switch_phase() {
             /* The reason we use "int" here is to be coherent with HTSLIB */
             static_assert(sizeof(int) == sizeof(uint32_t), "int should be of same size than uint32_t");
+            const bool valid = parent.checksum_check_pass_of_nth(sample);
             for (size_t i = 0; i < size; ++i) {
-                int *gt_arr = (int*)start_pos+i*Iterator_type::skip()+1;
-                int a0 = bcf_gt_allele(gt_arr[0]);
-                int a1 = bcf_gt_allele(gt_arr[1]);
-
                 /* First allele is always unphased per VCF/BCF standard.
                  * Therefore, we can't just switch the values directly */
-                gt_arr[0] = bcf_gt_unphased(a1);
-                gt_arr[1] = bcf_gt_phased(a0);
+                (*this)[i].switch_phase();
+            }
+            if (valid) {
+                parent.update_checksum_of_nth(sample);
             }
         }
 
@@ -271,14 +552,17 @@ public:
         HetInfoMemoryMap& parent;
     public:
         const size_t sample;
+        const HetInfoSpan span;
         const uint32_t sample_id;
         const size_t size;
-        uint32_t* const start_pos;
     };
 
     void fill_het_info(std::vector<HetInfo>& v, size_t sample) {
-        HetInfoPtrContainer hipc(*this, sample);
-        hipc.fill_het_info(v);
+        if (compressed) {
+            v = get_het_info_for_nth(sample);
+            return;
+        }
+        v = get_span_of_nth(sample).to_vector();
     }
 
     void print_positions(size_t sample) {
@@ -295,14 +579,8 @@ public:
         size_t counter = 0;
         // For each sample
         for (size_t i = 0; i < num_samples; ++i) {
-            std::vector<HetInfo> v;
-            // For each het site in dataset
-            fill_het_info(v, i);
-            for (auto hi : v) {
-                if (!std::isnan(hi.pp) && hi.pp < threshold) {
-                    counter++;
-                }
-            }
+            // For each het site in dataset (only the PP is read)
+            counter += count_pp_if(i, [threshold](const float pp) { return !std::isnan(pp) && pp < threshold; });
         }
         return counter;
     }
@@ -311,14 +589,14 @@ public:
         size_t counter = 0;
         // For each sample
         for (size_t i = 0; i < num_samples; ++i) {
-            std::vector<HetInfo> v;
             // For each het site in dataset
-            fill_het_info(v, i);
-            for (auto hi : v) {
-                if (vi[hi.vcf_line].snp && !std::isnan(hi.pp) && hi.pp < threshold) {
+            for (const auto hi : get_span_of_nth(i)) {
+                const float pp = hi.pp();
+                if (vi[hi.vcf_line()].snp && !std::isnan(pp) && pp < threshold) {
                     counter++;
                 }
             }
+            release_nth(i);
         }
         return counter;
     }
@@ -327,29 +605,29 @@ public:
         size_t counter = 0;
         // For each sample
         for (size_t i = 0; i < num_samples; ++i) {
-            std::vector<HetInfo> v;
             // For each het site in dataset
-            fill_het_info(v, i);
+            const HetInfoSpan v = get_span_of_nth(i);
             for (size_t j = 0; j < v.size(); ++j) {
-                auto& hi = v[j];
+                const HetInfo hi = v.het_info(j);
                 // If low PP and SNP
                 if (vi[hi.vcf_line].snp && !std::isnan(hi.pp) && hi.pp < threshold) {
                     // Check the neighbors
                     size_t lower_bound = j < 2 ? 0 : j-2;
                     size_t upper_bound = j < v.size()-2 ? j+2 : v.size();
                     // For each neighbor
-                    for (size_t k = lower_bound; k <= upper_bound; ++k) {
+                    for (size_t k = lower_bound; k <= upper_bound && k < v.size(); ++k) {
                         // Don't check variant with itself
                         if (k == j) continue;
-                        auto& nei = v[k];
+                        const int nei_line = v[k].vcf_line();
                         // If the neighbor is also a SNP and within distance
-                        if ((!snp_nei_req || vi[nei.vcf_line].snp) && vi[hi.vcf_line].distance(vi[nei.vcf_line]) < dist) {
+                        if ((!snp_nei_req || vi[nei_line].snp) && vi[hi.vcf_line].distance(vi[nei_line]) < dist) {
                             counter++;
                             break; // Don't count twice
                         }
                     }
                 }
             }
+            release_nth(i);
         }
         return counter;
     }
@@ -358,16 +636,8 @@ public:
         size_t counter = 0;
         // For each sample
         for (size_t i = 0; i < num_samples; ++i) {
-            std::vector<HetInfo> v;
-            // For each het site in dataset
-            fill_het_info(v, i);
-            for (size_t j = 0; j < v.size(); ++j) {
-                auto& hi = v[j];
-                // If SNP and PP above 1 (means rephase with sequencing reads)
-                if (!std::isnan(hi.pp) && hi.pp > 1.0) {
-                    counter++;
-                }
-            }
+            // For each het site in dataset, if PP above 1 (means rephase with sequencing reads)
+            counter += count_pp_if(i, [](const float pp) { return !std::isnan(pp) && pp > 1.0; });
         }
         return counter;
     }
@@ -377,6 +647,311 @@ public:
     void *file_mmap_p;
     uint32_t num_samples;
     uint64_t *offset_table;
+    size_t layout_size; /* Header, offset table, sections and trailer */
+
+protected:
+    /* Sample block as stored in the file (compressed or not) */
+    uint32_t *get_stored_ptr_on_nth(uint32_t n) const {
+        return (uint32_t*)(((char*)file_mmap_p) + offset_table[n]);
+    }
+
+    /* Mark, id and number of het infos of the sample block are the same in all layouts */
+    uint32_t *get_header_on_nth(uint32_t n) const {
+        if (!encoded()) {
+            return get_ptr_on_nth(n);
+        }
+        uint32_t *start = get_stored_ptr_on_nth(n);
+        if (*start != stored_block_mark()) {
+            std::cerr << "Something is wrong, mark not found for idx " << n << std::endl;
+            return nullptr;
+        }
+        return start;
+    }
+
+    /* Layouts other than the original one (the sample blocks have their own marks and sizes) */
+    bool encoded() const {
+        return compressed || compact || columnar;
+    }
+
+    uint32_t stored_block_mark() const {
+        return compressed ? HetInfoCompression::SAMPLE_BLOCK_MARK :
+               compact ? HetInfoCompact::SAMPLE_BLOCK_MARK :
+               columnar ? HetInfoColumnar::SAMPLE_BLOCK_MARK : HetInfoFileWriter::SAMPLE_BLOCK_MARK;
+    }
+
+    uint64_t stored_block_size(const uint32_t *block) const {
+        return compressed ? HetInfoCompression::block_size(block) :
+               compact ? HetInfoCompact::block_size(block) :
+               columnar ? HetInfoColumnar::block_size(block) : HetInfoFileWriter::block_size(block[2]);
+    }
+
+    uint64_t stored_header_size() const {
+        return compressed ? HetInfoCompression::SAMPLE_BLOCK_HEADER_SIZE : HetInfoFileWriter::SAMPLE_BLOCK_HEADER_SIZE;
+    }
+
+    /* Size of sample block n as stored, false if its mark is not found or it is not within the file */
+    bool stored_size_of_nth(uint32_t n, uint64_t& size) const {
+        const uint64_t offset = offset_table[n];
+        if (offset > file_size || file_size - offset < stored_header_size() || *get_stored_ptr_on_nth(n) != stored_block_mark()) {
+            return false;
+        }
+        size = stored_block_size(get_stored_ptr_on_nth(n));
+        return size <= file_size - offset;
+    }
+
+    /* The header, offset table and sections (before the checksums) match their checksum */
+    bool sections_check_pass() const {
+        if (!checksums.empty() && crc32c::value(file_mmap_p, checksums_offset) != checksums.get_table_crc()) {
+            std::cerr << "Header, offset table and sections don't match their checksum !" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    /* Sample block i is where the previous one ends, the IDs of the sample table are the ones of the sample blocks, the skip
+     * index has the checkpoints of all their het infos and the checksum matches, size is the stored size of the block */
+    bool block_check_pass(const uint32_t i, uint64_t& size) const {
+        const uint64_t first_offset = streaming ? HetInfoStreamWriter::HEADER_SIZE : layout_size;
+        if ((!i && offset_table[0] != first_offset) || !stored_size_of_nth(i, size)) {
+            std::cerr << "Sample block " << i << " is not where it should be" << std::endl;
+            return false;
+        }
+        if (i + 1 < num_samples && offset_table[i] + size != offset_table[i+1]) {
+            std::cerr << "Offset " << i << " and next one don't match up !" << std::endl;
+            return false;
+        }
+        const uint32_t *start = get_stored_ptr_on_nth(i);
+        if (!sample_table.empty() && *(start+1) != sample_table.orig_idx_of_nth(i)) {
+            std::cerr << "Sample table and sample block " << i << " don't match up !" << std::endl;
+            return false;
+        }
+        const uint32_t interval = skip_index.get_interval();
+        if (!skip_index.empty() && skip_index.checkpoints_of_nth(i).size() != (*(start+2) + interval - 1) / interval) {
+            std::cerr << "Skip index and sample block " << i << " don't match up !" << std::endl;
+            return false;
+        }
+        return checksum_check_pass_of_nth(i);
+    }
+
+    bool writable;
+    bool streaming = false;
+    bool compressed = false;
+    bool compact = false;
+    bool columnar = false;
+    HetInfoSampleTable sample_table;
+    HetInfoSkipIndex skip_index;
+    HetInfoChecksums checksums;
+    uint64_t checksums_offset = 0;
+    /* Checksum of each sample block : not checked yet, passed or failed (see checksum_check_pass_of_nth()) */
+    enum ChecksumState : uint8_t { CHECKSUM_UNKNOWN = 0, CHECKSUM_PASS, CHECKSUM_FAIL };
+    mutable std::unique_ptr<std::atomic<uint8_t>[]> checksum_states;
+    /* Other layouts : Sample blocks decoded in the original layout (empty if not decoded) */
+    mutable std::vector<std::vector<uint32_t> > decoded_blocks;
+    mutable std::unique_ptr<std::mutex[]> decode_mutexes;
+};
+
+/**
+ * @brief Sequential reader of het info binary files from a stream (e.g., stdin),
+ *        for both the streaming layout and the original layout as long as
+ *        its sample blocks are in order (as written by the tools).
+ */
+class HetInfoStreamReader {
+public:
+    HetInfoStreamReader(std::istream& is) : is(is) {
+        const uint32_t mark = read_u32();
+        num_samples = read_u32();
+        pos = HetInfoStreamWriter::HEADER_SIZE;
+        if (mark == ENDIANNESS || mark == HetInfoCompression::FILE_MARK || mark == HetInfoCompact::FILE_MARK ||
+            mark == HetInfoColumnar::FILE_MARK) {
+            streaming = false;
+            compressed = (mark == HetInfoCompression::FILE_MARK);
+            compact = (mark == HetInfoCompact::FILE_MARK);
+            columnar = (mark == HetInfoColumnar::FILE_MARK);
+            offset_table.resize(num_samples);
+            read(reinterpret_cast<char*>(offset_table.data()), num_samples * sizeof(uint64_t));
+            if (num_samples && offset_table[0] > pos) {
+                read_sections(offset_table[0] - pos);
+            }
+        } else if (mark == HetInfoStreamWriter::STREAM_MARK) {
+            streaming = true;
+            offset_table.reserve(num_samples);
+        } else {
+            std::cerr << "Bad endianness in het info stream" << std::endl;
+            throw "Bad endianness";
+        }
+    }
+
+    /* Reads the next sample block, returns false after the last one */
+    bool next_block(uint32_t& id, std::vector<HetInfo>& his) {
+        if (current == num_samples) {
+            if (streaming && !footer_checked) {
+                check_footer();
+            }
+            return false;
+        }
+        if (streaming) {
+            offset_table.push_back(pos);
+        } else {
+            if (offset_table[current] < pos) {
+                std::cerr << "Sample blocks of the het info stream are not in order" << std::endl;
+                throw "Sample blocks not in order";
+            }
+            skip(offset_table[current] - pos);
+        }
+        block_crc = 0;
+        if (compressed) {
+            read_compressed_block(id, his);
+            check_checksum();
+            current++;
+            return true;
+        }
+        const uint32_t block_mark = compact ? HetInfoCompact::SAMPLE_BLOCK_MARK :
+                                    columnar ? HetInfoColumnar::SAMPLE_BLOCK_MARK : HetInfoFileWriter::SAMPLE_BLOCK_MARK;
+        if (read_u32() != block_mark) {
+            std::cerr << "Something is wrong, mark not found for idx " << current << std::endl;
+            throw "Mark not found";
+        }
+        id = read_u32();
+        his.resize(read_u32());
+        if (compact) {
+            std::vector<CompactHetInfo> records(his.size());
+            read(reinterpret_cast<char*>(records.data()), records.size() * sizeof(CompactHetInfo));
+            for (size_t i = 0; i < records.size(); ++i) {
+                his[i] = HetInfoCompact::decode(records[i]);
+            }
+        } else if (columnar) {
+            std::vector<uint32_t> block(HetInfoColumnar::block_size(his.size()) / sizeof(uint32_t));
+            block[0] = HetInfoColumnar::SAMPLE_BLOCK_MARK;
+            block[2] = his.size();
+            read(reinterpret_cast<char*>(block.data() + 3), his.size() * sizeof(HetInfo));
+            HetInfoColumnar::decode_block(block.data(), his);
+        } else {
+            read(reinterpret_cast<char*>(his.data()), his.size() * sizeof(HetInfo));
+        }
+        check_checksum();
+        current++;
+        return true;
+    }
+
+    /* Sample table of the stream, empty if none */
+    const HetInfoSampleTable& get_sample_table() const {
+        return sample_table;
+    }
+
+    /* Skip index of the stream, empty if none */
+    const HetInfoSkipIndex& get_skip_index() const {
+        return skip_index;
+    }
+
+    /* The sample blocks are checked against their checksums as they are read */
+    bool has_checksums() const {
+        return !checksums.empty();
+    }
+
+    uint32_t num_samples;
+
+protected:
+    /* The optional sections, if any, are between the offset table and the first sample block */
+    void read_sections(const uint64_t size) {
+        sections_data.resize((size + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+        char *data = reinterpret_cast<char*>(sections_data.data());
+        read(data, size);
+        for (uint64_t offset = 0; offset < size;) {
+            if (sample_table.empty() && HetInfoSampleTable::is_at(data + offset, size - offset)) {
+                sample_table = HetInfoSampleTable(data + offset, num_samples, size - offset);
+                offset += sample_table.size();
+            } else if (skip_index.empty() && HetInfoSkipIndex::is_at(data + offset, size - offset)) {
+                skip_index = HetInfoSkipIndex(data + offset, num_samples, size - offset);
+                offset += skip_index.size();
+            } else if (checksums.empty() && HetInfoChecksums::is_at(data + offset, size - offset)) {
+                checksums = HetInfoChecksums(data + offset, num_samples, size - offset);
+                offset += checksums.size();
+            } else {
+                break;
+            }
+        }
+    }
+
+    /* The bytes read since the start of the current sample block match its checksum */
+    void check_checksum() const {
+        if (!checksums.empty() && block_crc != checksums.crc_of_nth(current)) {
+            std::cerr << "Sample block " << current << " doesn't match its checksum !" << std::endl;
+            throw "Checksum mismatch";
+        }
+    }
+
+    void read_compressed_block(uint32_t& id, std::vector<HetInfo>& his) {
+        const size_t header_words = HetInfoCompression::SAMPLE_BLOCK_HEADER_SIZE / sizeof(uint32_t);
+        compressed_block.resize(header_words);
+        read(reinterpret_cast<char*>(compressed_block.data()), HetInfoCompression::SAMPLE_BLOCK_HEADER_SIZE);
+        if (compressed_block[0] != HetInfoCompression::SAMPLE_BLOCK_MARK) {
+            std::cerr << "Something is wrong, mark not found for idx " << current << std::endl;
+            throw "Mark not found";
+        }
+        const uint64_t size = HetInfoCompression::block_size(compressed_block.data());
+        compressed_block.resize(size / sizeof(uint32_t));
+        read(reinterpret_cast<char*>(compressed_block.data() + header_words), size - HetInfoCompression::SAMPLE_BLOCK_HEADER_SIZE);
+        HetInfoCompression::decompress_block(compressed_block.data(), id, his);
+    }
+
+    void check_footer() {
+        std::vector<uint64_t> table(num_samples);
+        const uint64_t table_offset = pos;
+        read(reinterpret_cast<char*>(table.data()), num_samples * sizeof(uint64_t));
+        uint64_t trailer_offset = 0;
+        read(reinterpret_cast<char*>(&trailer_offset), sizeof(trailer_offset));
+        const uint32_t n = read_u32();
+        const uint32_t mark = read_u32();
+        if (mark != HetInfoStreamWriter::TRAILER_MARK || n != num_samples ||
+            trailer_offset != table_offset || table != offset_table) {
+            std::cerr << "Bad footer in het info stream" << std::endl;
+            throw "Bad footer";
+        }
+        footer_checked = true;
+    }
+
+    uint32_t read_u32() {
+        uint32_t value = 0;
+        read(reinterpret_cast<char*>(&value), sizeof(uint32_t));
+        return value;
+    }
+
+    void read(char *data, const size_t size) {
+        is.read(data, size);
+        if (size_t(is.gcount()) != size) {
+            std::cerr << "Het info stream is truncated" << std::endl;
+            throw "Het info stream truncated";
+        }
+        pos += size;
+        if (!checksums.empty()) {
+            block_crc = crc32c::extend(block_crc, data, size);
+        }
+    }
+
+    void skip(size_t size) {
+        char buffer[4096];
+        while (size) {
+            const size_t chunk = std::min(size, sizeof(buffer));
+            read(buffer, chunk);
+            size -= chunk;
+        }
+    }
+
+    std::istream& is;
+    bool streaming;
+    bool compressed = false;
+    bool compact = false;
+    bool columnar = false;
+    std::vector<uint32_t> compressed_block;
+    std::vector<uint64_t> sections_data;
+    HetInfoSampleTable sample_table;
+    HetInfoSkipIndex skip_index;
+    HetInfoChecksums checksums;
+    uint32_t block_crc = 0;
+    bool footer_checked = false;
+    std::vector<uint64_t> offset_table;
+    uint64_t pos = 0;
+    uint32_t current = 0;
 };
 
 class HetInfoMemoryMapMerger {
@@ -412,6 +987,98 @@ public:
         }
     }
 
+    /* Merges the files (samples one after the other) with the sample blocks copied in parallel */
+    static void merge_files(const std::vector<std::string>& filenames, const std::string& ofname, const size_t n_threads = 1) {
+        std::vector<std::unique_ptr<HetInfoMemoryMap> > himms;
+        std::vector<uint64_t> block_sizes;
+        // Output sample -> (file, sample in file)
+        std::vector<std::pair<uint32_t, uint32_t> > sources;
+        for (const auto& filename : filenames) {
+            himms.push_back(std::make_unique<HetInfoMemoryMap>(filename));
+            const auto& himm = *himms.back();
+            if (!himm.integrity_check_pass(n_threads)) {
+                std::cerr << "File " << filename << " doesn't pass integrity checks" << std::endl;
+            }
+            for (uint32_t i = 0; i < himm.num_samples; ++i) {
+                block_sizes.push_back(himm.get_size_of_nth(i));
+                sources.push_back({himms.size()-1, i});
+            }
+        }
+
+        std::vector<char> sections = merged_sample_table(himms, sources);
+        const std::vector<char> index = merged_skip_index(himms, sources);
+        sections.insert(sections.end(), index.begin(), index.end());
+        // Checksums if all the files have them
+        const bool with_checksums = !himms.empty() &&
+            std::all_of(himms.begin(), himms.end(), [](const auto& himm) { return himm->has_checksums(); });
+        HetInfoFileWriter writer(ofname, block_sizes, HetInfoFileWriter::ENDIANNESS_MARK, sections, with_checksums);
+        writer.for_all_blocks(n_threads, [&](const size_t i) {
+            const auto& himm = *himms[sources[i].first];
+            writer.write_raw_block(i, himm.get_ptr_on_nth(sources[i].second), block_sizes[i]);
+            himm.release_nth(sources[i].second);
+        });
+    }
+
+    /* Sample table of the merged file if all the files have one (names if all have names), empty otherwise */
+    static std::vector<char> merged_sample_table(const std::vector<std::unique_ptr<HetInfoMemoryMap> >& himms,
+                                                 const std::vector<std::pair<uint32_t, uint32_t> >& sources) {
+        if (himms.empty()) {
+            return std::vector<char>();
+        }
+        bool names = true;
+        for (const auto& himm : himms) {
+            if (!himm->has_sample_table()) {
+                return std::vector<char>();
+            }
+            names = names && himm->has_sample_names();
+        }
+        std::vector<uint32_t> ids;
+        std::vector<std::string> sample_names;
+        for (const auto& source : sources) {
+            ids.push_back(himms[source.first]->get_orig_idx_of_nth(source.second));
+            if (names) {
+                sample_names.push_back(himms[source.first]->get_sample_name_of_nth(source.second));
+            }
+        }
+        return HetInfoSampleTable::encode(ids, sample_names);
+    }
+
+    /* Skip index of the merged file if all the files have one with the same interval, empty otherwise */
+    static std::vector<char> merged_skip_index(const std::vector<std::unique_ptr<HetInfoMemoryMap> >& himms,
+                                               const std::vector<std::pair<uint32_t, uint32_t> >& sources) {
+        if (himms.empty()) {
+            return std::vector<char>();
+        }
+        for (const auto& himm : himms) {
+            if (!himm->has_skip_index() || himm->get_skip_index().get_interval() != himms.front()->get_skip_index().get_interval()) {
+                return std::vector<char>();
+            }
+        }
+        std::vector<std::vector<uint32_t> > checkpoints;
+        for (const auto& source : sources) {
+            checkpoints.push_back(himms[source.first]->get_skip_index().checkpoints_of_nth(source.second));
+        }
+        return HetInfoSkipIndex::encode(checkpoints, himms.front()->get_skip_index().get_interval());
+    }
+
+    /* Merges the files in the streaming layout, os can be a pipe */
+    static void merge_files_to_stream(const std::vector<std::string>& filenames, std::ostream& os) {
+        HetInfoStreamWriter writer(os, get_num_samples_from_filenames(filenames));
+        for (const auto& filename : filenames) {
+            HetInfoMemoryMap himm(filename);
+            if (!himm.integrity_check_pass()) {
+                std::cerr << "File " << filename << " doesn't pass integrity checks" << std::endl;
+            }
+            for (uint32_t i = 0; i < himm.num_samples; ++i) {
+                const uint32_t *block = himm.get_ptr_on_nth(i);
+                writer.write_header(*(block+1), *(block+2));
+                writer.write(reinterpret_cast<const char*>(block+3), himm.get_size_of_nth(i) - HetInfoFileWriter::SAMPLE_BLOCK_HEADER_SIZE);
+                himm.release_nth(i);
+            }
+        }
+        writer.close();
+    }
+
     void merge(const std::string& filename) {
         HetInfoMemoryMap himm(filename);
         if (!himm.integrity_check_pass()) {
@@ -424,6 +1091,7 @@ public:
             }
             offset_table[current_sample] = ofs.tellp();
             ofs.write(reinterpret_cast<const char*>(himm.get_ptr_on_nth(i)), himm.get_size_of_nth(i));
+            himm.release_nth(i);
             current_sample++;
         }
     }
@@ -0,0 +1,197 @@
+#ifndef __HET_INFO_SAMPLE_TABLE_HPP__
+#define __HET_INFO_SAMPLE_TABLE_HPP__
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Sample table of het info binary files (see
+ *        pp_extractor/doc/Binary_Format.md), an optional section between the
+ *        offset table and the first sample block. It holds the original ID
+ *        of every sample block, the IDs sorted (with their sample block) and
+ *        optionally the sample names sorted the same way, so the samples can
+ *        be listed and looked up by ID or name in O(log n) without reading
+ *        the sample blocks.
+ *
+ *        Layout (little endian, the section size is a multiple of 8) :
+ *        uint32_t mark, uint32_t flags, uint64_t section size,
+ *        uint32_t ids[n] (ID of the sample blocks), uint32_t sorted_ids[n],
+ *        uint32_t id_order[n] (sample block of sorted_ids[i]), then with
+ *        names : uint32_t name_order[n] (sample blocks by name), padding to 8,
+ *        uint64_t name_offsets[n+1] (name of sample block i is the bytes
+ *        [name_offsets[i], name_offsets[i+1]) of the string data), the
+ *        string data, padding to 8.
+ */
+class HetInfoSampleTable {
+public:
+    static constexpr uint32_t MARK = 0xd00d7ab1;
+    static constexpr uint32_t HAS_NAMES = 0x1;
+    static constexpr uint64_t HEADER_SIZE = 2 * sizeof(uint32_t) + sizeof(uint64_t); /* Mark, flags, size */
+
+    /* No sample table */
+    HetInfoSampleTable() {}
+
+    /* Sample table of n samples at p (the mark must be there), available is the number of bytes after p */
+    HetInfoSampleTable(const char *p, const uint32_t n, const uint64_t available) : n(n) {
+        const uint32_t *header = reinterpret_cast<const uint32_t*>(p);
+        flags = header[1];
+        memcpy(&section_size, p + 2 * sizeof(uint32_t), sizeof(uint64_t));
+        if (header[0] != MARK || section_size > available || section_size < ids_size(n, flags)) {
+            std::cerr << "Bad sample table" << std::endl;
+            throw "Bad sample table";
+        }
+        ids = reinterpret_cast<const uint32_t*>(p + HEADER_SIZE);
+        sorted_ids = ids + n;
+        id_order = sorted_ids + n;
+        if (flags & HAS_NAMES) {
+            name_order = id_order + n;
+            name_offsets = reinterpret_cast<const uint64_t*>(p + padded(HEADER_SIZE + 4 * n * sizeof(uint32_t)));
+            names = reinterpret_cast<const char*>(name_offsets + n + 1);
+            if (names > p + section_size || uint64_t(p + section_size - names) < name_offsets[n]) {
+                std::cerr << "Bad sample names in sample table" << std::endl;
+                throw "Bad sample table";
+            }
+        }
+    }
+
+    static bool is_at(const char *p, const uint64_t available) {
+        return available >= HEADER_SIZE && *reinterpret_cast<const uint32_t*>(p) == MARK;
+    }
+
+    /* Section of the sample blocks with the given original IDs (and names, either none or one per sample block) */
+    static std::vector<char> encode(const std::vector<uint32_t>& ids, const std::vector<std::string>& names = std::vector<std::string>()) {
+        const uint32_t n = ids.size();
+        if (!names.empty() && names.size() != n) {
+            std::cerr << "The sample table has " << n << " samples but " << names.size() << " names" << std::endl;
+            throw "Sample names mismatch";
+        }
+        const uint32_t flags = names.empty() ? 0 : HAS_NAMES;
+        uint64_t names_start = 0;
+        uint64_t string_size = 0;
+        for (const auto& name : names) {
+            string_size += name.size();
+        }
+        uint64_t size = ids_size(n, flags);
+        if (flags & HAS_NAMES) {
+            names_start = size + (n + 1) * sizeof(uint64_t);
+            size = padded(names_start + string_size);
+        }
+
+        std::vector<char> section(size, 0);
+        const uint32_t header[2] = {MARK, flags};
+        memcpy(section.data(), header, sizeof(header));
+        memcpy(section.data() + sizeof(header), &size, sizeof(size));
+
+        std::vector<uint32_t> order(n);
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return ids[a] < ids[b]; });
+        uint32_t *words = reinterpret_cast<uint32_t*>(section.data() + HEADER_SIZE);
+        for (uint32_t i = 0; i < n; ++i) {
+            words[i] = ids[i];
+            words[n + i] = ids[order[i]];
+            words[2 * n + i] = order[i];
+        }
+
+        if (flags & HAS_NAMES) {
+            std::iota(order.begin(), order.end(), 0);
+            std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return names[a] < names[b]; });
+            std::copy(order.begin(), order.end(), words + 3 * n);
+            uint64_t *offsets = reinterpret_cast<uint64_t*>(section.data() + padded(HEADER_SIZE + 4 * n * sizeof(uint32_t)));
+            char *string_data = section.data() + names_start;
+            uint64_t offset = 0;
+            for (uint32_t i = 0; i < n; ++i) {
+                offsets[i] = offset;
+                memcpy(string_data + offset, names[i].data(), names[i].size());
+                offset += names[i].size();
+            }
+            offsets[n] = offset;
+        }
+        return section;
+    }
+
+    bool empty() const {
+        return !ids;
+    }
+
+    bool has_names() const {
+        return names;
+    }
+
+    /* Size of the section in bytes, 0 if there is no sample table */
+    uint64_t size() const {
+        return section_size;
+    }
+
+    uint32_t orig_idx_of_nth(const uint32_t i) const {
+        return ids[i];
+    }
+
+    std::string_view name_of_nth(const uint32_t i) const {
+        return std::string_view(names + name_offsets[i], name_offsets[i+1] - name_offsets[i]);
+    }
+
+    /* Sample block with the original ID, false if none */
+    bool find_orig_idx(const uint32_t id, uint32_t& nth) const {
+        const uint32_t *it = std::lower_bound(sorted_ids, sorted_ids + n, id);
+        if (it == sorted_ids + n || *it != id) {
+            return false;
+        }
+        nth = id_order[it - sorted_ids];
+        return true;
+    }
+
+    /* Sample block of the sample name, false if none (or no names) */
+    bool find_name(const std::string_view name, uint32_t& nth) const {
+        if (!has_names()) {
+            return false;
+        }
+        const uint32_t *it = std::lower_bound(name_order, name_order + n, name,
+                                              [this](uint32_t i, const std::string_view s) { return name_of_nth(i) < s; });
+        if (it == name_order + n || name_of_nth(*it) != name) {
+            return false;
+        }
+        nth = *it;
+        return true;
+    }
+
+    /* Section for the given sample blocks (in this order), with their names if any */
+    std::vector<char> encode_subset(const std::vector<uint32_t>& nths) const {
+        std::vector<uint32_t> sub_ids;
+        std::vector<std::string> sub_names;
+        for (const auto i : nths) {
+            sub_ids.push_back(orig_idx_of_nth(i));
+            if (has_names()) {
+                sub_names.push_back(std::string(name_of_nth(i)));
+            }
+        }
+        return encode(sub_ids, sub_names);
+    }
+
+protected:
+    static uint64_t padded(const uint64_t size) {
+        return (size + 7) & ~uint64_t(7);
+    }
+
+    /* Size of the header and the ID arrays (and name order), padded */
+    static uint64_t ids_size(const uint32_t n, const uint32_t flags) {
+        return padded(HEADER_SIZE + ((flags & HAS_NAMES) ? 4 : 3) * uint64_t(n) * sizeof(uint32_t));
+    }
+
+    uint32_t n = 0;
+    uint32_t flags = 0;
+    uint64_t section_size = 0;
+    const uint32_t *ids = nullptr;
+    const uint32_t *sorted_ids = nullptr;
+    const uint32_t *id_order = nullptr;
+    const uint32_t *name_order = nullptr;
+    const uint64_t *name_offsets = nullptr;
+    const char *names = nullptr;
+};
+
+#endif /* __HET_INFO_SAMPLE_TABLE_HPP__ */
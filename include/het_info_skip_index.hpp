@@ -0,0 +1,145 @@
+#ifndef __HET_INFO_SKIP_INDEX_HPP__
+#define __HET_INFO_SKIP_INDEX_HPP__
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "het_info_span.hpp"
+
+/**
+ * @brief Skip index of het info binary files (see
+ *        pp_extractor/doc/Binary_Format.md), an optional section after the
+ *        offset table (and sample table). For every sample block it holds the
+ *        VCF line of one het info every interval het infos (checkpoints), so
+ *        the het infos of a range of VCF lines are found with a binary search
+ *        on the checkpoints then on at most interval het infos, instead of on
+ *        the whole sample block. The het infos of a sample block are in VCF
+ *        line order, the VCF lines are never modified in place.
+ *
+ *        Layout (little endian, the section size is a multiple of 8) :
+ *        uint32_t mark, uint32_t interval, uint64_t section size,
+ *        uint64_t first[n+1] (checkpoints of sample block i are
+ *        [first[i], first[i+1]) of the checkpoints), uint32_t checkpoints[],
+ *        padding to 8.
+ */
+class HetInfoSkipIndex {
+public:
+    static constexpr uint32_t MARK = 0xd00d5c1d;
+    static constexpr uint32_t DEFAULT_INTERVAL = 256;
+    static constexpr uint64_t HEADER_SIZE = 2 * sizeof(uint32_t) + sizeof(uint64_t); /* Mark, interval, size */
+
+    /* No skip index */
+    HetInfoSkipIndex() {}
+
+    /* Skip index of n samples at p (the mark must be there), available is the number of bytes after p */
+    HetInfoSkipIndex(const char *p, const uint32_t n, const uint64_t available) {
+        const uint32_t *header = reinterpret_cast<const uint32_t*>(p);
+        interval = header[1];
+        memcpy(&section_size, p + 2 * sizeof(uint32_t), sizeof(uint64_t));
+        if (header[0] != MARK || !interval || section_size > available || section_size < HEADER_SIZE + (uint64_t(n) + 1) * sizeof(uint64_t)) {
+            std::cerr << "Bad skip index" << std::endl;
+            throw "Bad skip index";
+        }
+        first = reinterpret_cast<const uint64_t*>(p + HEADER_SIZE);
+        checkpoints = reinterpret_cast<const uint32_t*>(first + n + 1);
+        if (first[n] > (section_size - HEADER_SIZE - (uint64_t(n) + 1) * sizeof(uint64_t)) / sizeof(uint32_t)) {
+            std::cerr << "Bad skip index" << std::endl;
+            throw "Bad skip index";
+        }
+    }
+
+    static bool is_at(const char *p, const uint64_t available) {
+        return available >= HEADER_SIZE && *reinterpret_cast<const uint32_t*>(p) == MARK;
+    }
+
+    /* Checkpoints of a sample block, the VCF line of het infos 0, interval, 2 * interval, ... */
+    static std::vector<uint32_t> checkpoints_of(const HetInfoSpan& span, const uint32_t interval) {
+        std::vector<uint32_t> cps;
+        for (size_t i = 0; i < span.size(); i += interval) {
+            cps.push_back(span[i].vcf_line());
+        }
+        return cps;
+    }
+
+    static std::vector<uint32_t> checkpoints_of(const std::vector<HetInfo>& his, const uint32_t interval) {
+        std::vector<uint32_t> cps;
+        for (size_t i = 0; i < his.size(); i += interval) {
+            cps.push_back(his[i].vcf_line);
+        }
+        return cps;
+    }
+
+    /* Section with the checkpoints of the sample blocks */
+    static std::vector<char> encode(const std::vector<std::vector<uint32_t> >& checkpoints, const uint32_t interval = DEFAULT_INTERVAL) {
+        const uint64_t n = checkpoints.size();
+        uint64_t total = 0;
+        for (const auto& cps : checkpoints) {
+            total += cps.size();
+        }
+        const uint64_t size = padded(HEADER_SIZE + (n + 1) * sizeof(uint64_t) + total * sizeof(uint32_t));
+        std::vector<char> section(size, 0);
+        const uint32_t header[2] = {MARK, interval};
+        memcpy(section.data(), header, sizeof(header));
+        memcpy(section.data() + sizeof(header), &size, sizeof(size));
+        uint64_t *firsts = reinterpret_cast<uint64_t*>(section.data() + HEADER_SIZE);
+        uint32_t *cps_out = reinterpret_cast<uint32_t*>(firsts + n + 1);
+        uint64_t current = 0;
+        for (uint64_t i = 0; i < n; ++i) {
+            firsts[i] = current;
+            std::copy(checkpoints[i].begin(), checkpoints[i].end(), cps_out + current);
+            current += checkpoints[i].size();
+        }
+        firsts[n] = current;
+        return section;
+    }
+
+    bool empty() const {
+        return !first;
+    }
+
+    /* Size of the section in bytes, 0 if there is no skip index */
+    uint64_t size() const {
+        return section_size;
+    }
+
+    uint32_t get_interval() const {
+        return interval;
+    }
+
+    std::vector<uint32_t> checkpoints_of_nth(const uint32_t i) const {
+        return std::vector<uint32_t>(checkpoints + first[i], checkpoints + first[i+1]);
+    }
+
+    /* Het infos [lo, hi) of sample block i (of n_hets het infos) in which the first one with a VCF line of at least line is,
+     * hi if there is none */
+    void window(const uint32_t i, const uint32_t line, const size_t n_hets, size_t& lo, size_t& hi) const {
+        const uint32_t *cps = checkpoints + first[i];
+        const size_t k = std::lower_bound(cps, checkpoints + first[i+1], line) - cps;
+        lo = k ? (k - 1) * interval + 1 : 0;
+        hi = std::min(k * interval, n_hets);
+    }
+
+    /* Section for the given sample blocks (in this order) */
+    std::vector<char> encode_subset(const std::vector<uint32_t>& nths) const {
+        std::vector<std::vector<uint32_t> > cps;
+        for (const auto i : nths) {
+            cps.push_back(checkpoints_of_nth(i));
+        }
+        return encode(cps, interval);
+    }
+
+protected:
+    static uint64_t padded(const uint64_t size) {
+        return (size + 7) & ~uint64_t(7);
+    }
+
+    uint32_t interval = 0;
+    uint64_t section_size = 0;
+    const uint64_t *first = nullptr;
+    const uint32_t *checkpoints = nullptr;
+};
+
+#endif /* __HET_INFO_SKIP_INDEX_HPP__ */
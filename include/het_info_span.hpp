@@ -0,0 +1,134 @@
+#ifndef __HET_INFO_SPAN_HPP__
+#define __HET_INFO_SPAN_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+#include "het_info.hpp"
+#include "het_info_compact.hpp"
+#include "het_info_columnar.hpp"
+
+/**
+ * @brief View on the het infos of a sample block (in the memory map, no
+ *        copy), in the original, compact or columnar layout. The het infos
+ *        are accessed through HetInfoRef proxies with a random access
+ *        iterator, they can be modified through them if the view is writable
+ *        (the file is mapped with PROT_WRITE).
+ */
+class HetInfoSpan {
+public:
+    enum Layout { ORIGINAL, COMPACT, COLUMNAR };
+
+    HetInfoSpan() {}
+    /* records is the sample block after its header, n its number of het infos */
+    HetInfoSpan(uint32_t *records, const size_t n, const Layout layout, const bool writable) :
+        records(records), n_records(n), first(0), count(n), layout(layout), writable(writable) {}
+
+    static HetInfoRef ref(uint32_t *records, const size_t n_records, const Layout layout, const size_t i) {
+        switch (layout) {
+            case COMPACT:
+                return HetInfoRef::nth(records, i, true);
+            case COLUMNAR:
+                return HetInfoColumnar::nth(records, n_records, i);
+            default:
+                return HetInfoRef::nth(records, i, false);
+        }
+    }
+
+    class Iterator {
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using difference_type   = std::ptrdiff_t;
+        using value_type        = HetInfoRef;
+        using pointer           = void;
+        using reference         = HetInfoRef; // Proxy
+
+        Iterator() {}
+        Iterator(uint32_t *records, size_t n_records, Layout layout, size_t i) :
+            records(records), n_records(n_records), layout(layout), i(i) {}
+
+        reference operator*() const { return ref(records, n_records, layout, i); }
+        reference operator[](difference_type d) const { return ref(records, n_records, layout, i + d); }
+
+        Iterator& operator++() { ++i; return *this; }
+        Iterator operator++(int) { Iterator tmp = *this; ++i; return tmp; }
+        Iterator& operator--() { --i; return *this; }
+        Iterator operator--(int) { Iterator tmp = *this; --i; return tmp; }
+        Iterator& operator+=(difference_type d) { i += d; return *this; }
+        Iterator& operator-=(difference_type d) { i -= d; return *this; }
+        friend Iterator operator+(Iterator it, difference_type d) { return it += d; }
+        friend Iterator operator+(difference_type d, Iterator it) { return it += d; }
+        friend Iterator operator-(Iterator it, difference_type d) { return it -= d; }
+        friend difference_type operator-(const Iterator& a, const Iterator& b) { return difference_type(a.i) - difference_type(b.i); }
+
+        friend bool operator==(const Iterator& a, const Iterator& b) { return a.i == b.i; }
+        friend bool operator!=(const Iterator& a, const Iterator& b) { return a.i != b.i; }
+        friend bool operator<(const Iterator& a, const Iterator& b) { return a.i < b.i; }
+        friend bool operator>(const Iterator& a, const Iterator& b) { return a.i > b.i; }
+        friend bool operator<=(const Iterator& a, const Iterator& b) { return a.i <= b.i; }
+        friend bool operator>=(const Iterator& a, const Iterator& b) { return a.i >= b.i; }
+
+    protected:
+        uint32_t *records = nullptr;
+        size_t n_records = 0;
+        Layout layout = ORIGINAL;
+        size_t i = 0;
+    };
+
+    HetInfoRef operator[](const size_t i) const {
+        return ref(records, n_records, layout, first + i);
+    }
+
+    HetInfo het_info(const size_t i) const {
+        return (*this)[i].to_het_info();
+    }
+
+    Iterator begin() const { return Iterator(records, n_records, layout, first); }
+    Iterator end() const { return Iterator(records, n_records, layout, first + count); }
+
+    size_t size() const {
+        return count;
+    }
+
+    bool empty() const {
+        return !count;
+    }
+
+    bool is_writable() const {
+        return writable;
+    }
+
+    /* The count het infos from offset */
+    HetInfoSpan subspan(const size_t offset, const size_t count) const {
+        HetInfoSpan span(*this);
+        span.first = first + offset;
+        span.count = count;
+        return span;
+    }
+
+    /* Contiguous PP of the het infos in the columnar layout, nullptr in the other layouts */
+    const float *pp_column() const {
+        return layout == COLUMNAR ? HetInfoColumnar::pps(records, n_records) + first : nullptr;
+    }
+
+    std::vector<HetInfo> to_vector() const {
+        std::vector<HetInfo> his;
+        his.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            his.push_back(het_info(i));
+        }
+        return his;
+    }
+
+protected:
+    uint32_t *records = nullptr;
+    size_t n_records = 0;
+    size_t first = 0;
+    size_t count = 0;
+    Layout layout = ORIGINAL;
+    bool writable = false;
+};
+
+#endif /* __HET_INFO_SPAN_HPP__ */
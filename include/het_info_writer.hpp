@@ -0,0 +1,416 @@
+#ifndef __HET_INFO_WRITER_HPP__
+#define __HET_INFO_WRITER_HPP__
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <fcntl.h>
+#include <iostream>
+#include <ostream>
+#include <string>
+#include <sys/uio.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "het_info.hpp"
+#include "het_info_checksums.hpp"
+
+/**
+ * @brief Writer of het info binary files (see pp_extractor/doc/Binary_Format.md)
+ *        for which the size of every sample block is known up front. The
+ *        offset table is computed and written at creation and the file is
+ *        pre-sized, so the sample blocks can be written in any order and from
+ *        several threads (positioned writes, no shared file offset).
+ *        With checksums the CRC32C of every sample block is computed as it
+ *        is written and the checksums section is written when closing.
+ *        A writer destroyed by an exception before it is closed removes its
+ *        incomplete file.
+ */
+class HetInfoFileWriter {
+public:
+    static constexpr uint32_t ENDIANNESS_MARK = 0xaabbccdd;
+    static constexpr uint32_t SAMPLE_BLOCK_MARK = 0xd00dc0de;
+    static constexpr uint64_t SAMPLE_BLOCK_HEADER_SIZE = 3 * sizeof(uint32_t); /* Mark, id, size */
+
+    /* Size in bytes of a sample block with n het infos */
+    static uint64_t block_size(const size_t n_hets) {
+        return SAMPLE_BLOCK_HEADER_SIZE + n_hets * sizeof(HetInfo);
+    }
+
+    /* The file mark is the one of the layout of the blocks (see HetInfoCompression, HetInfoCompact, HetInfoColumnar),
+     * the optional sections (see HetInfoSampleTable and HetInfoSkipIndex encode()) are written after the offset table,
+     * followed by the checksums (see HetInfoChecksums) if requested */
+    HetInfoFileWriter(const std::string& filename, const std::vector<uint64_t>& block_sizes, const uint32_t file_mark = ENDIANNESS_MARK,
+                      const std::vector<char>& sections = std::vector<char>(), const bool with_checksums = false) :
+        filename(filename),
+        offset_table(block_sizes.size()),
+        block_sizes(block_sizes),
+        checksums(with_checksums ? block_sizes.size() : 0),
+        checksummed(with_checksums),
+        uncaught_at_creation(std::uncaught_exceptions()) {
+        static_assert(sizeof(HetInfo) == 4 * sizeof(uint32_t), "HetInfo is written as is");
+        const uint64_t table_end = 2 * sizeof(uint32_t) + block_sizes.size() * sizeof(uint64_t);
+        checksums_offset = table_end + sections.size();
+        uint64_t offset = checksums_offset + (with_checksums ? HetInfoChecksums::size_of(block_sizes.size()) : 0);
+        for (size_t i = 0; i < block_sizes.size(); ++i) {
+            offset_table[i] = offset;
+            offset += block_sizes[i];
+        }
+        file_size = offset;
+
+        fd = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            std::cerr << "Cannot open file " << filename << std::endl;
+            throw "Cannot open file";
+        }
+        if (ftruncate(fd, file_size)) {
+            std::cerr << "Cannot resize file " << filename << " to " << file_size << " bytes" << std::endl;
+            discard();
+            throw "Cannot resize file";
+        }
+
+        const uint32_t header[2] = {file_mark, uint32_t(block_sizes.size())};
+        write_at(header, sizeof(header), 0);
+        write_at(offset_table.data(), offset_table.size() * sizeof(uint64_t), sizeof(header));
+        if (!sections.empty()) {
+            write_at(sections.data(), sections.size(), table_end);
+        }
+        if (with_checksums) {
+            table_crc = crc32c::extend(crc32c::value(header, sizeof(header)), offset_table.data(), offset_table.size() * sizeof(uint64_t));
+            table_crc = crc32c::extend(table_crc, sections.data(), sections.size());
+        }
+    }
+
+    HetInfoFileWriter(const HetInfoFileWriter&) = delete;
+    HetInfoFileWriter& operator=(const HetInfoFileWriter&) = delete;
+
+    ~HetInfoFileWriter() {
+        if (std::uncaught_exceptions() > uncaught_at_creation) {
+            discard();
+            return;
+        }
+        try {
+            close();
+        } catch (const char *e) {
+            // Already reported
+        }
+    }
+
+    /* Closes and removes the file if it was not closed yet (e.g., it is incomplete) */
+    void discard() {
+        if (fd < 0) {
+            return;
+        }
+        ::close(fd);
+        fd = -1;
+        unlink(filename.c_str());
+    }
+
+    /* Writes the checksums (all the sample blocks must have been written) */
+    void close() {
+        if (fd < 0) {
+            return;
+        }
+        // The file is closed even if the checksums cannot be written
+        struct Closer {
+            int& fd;
+            ~Closer() { ::close(fd); fd = -1; }
+        } closer{fd};
+        if (checksummed) {
+            const auto section = HetInfoChecksums::encode(checksums, table_crc);
+            write_at(section.data(), section.size(), checksums_offset);
+        }
+    }
+
+    bool with_checksums() const {
+        return checksummed;
+    }
+
+    /* CRC32C of the sample block idx as written */
+    uint32_t get_checksum(const size_t idx) const {
+        return checksums[idx];
+    }
+
+    size_t num_samples() const {
+        return offset_table.size();
+    }
+
+    uint64_t get_offset(const size_t idx) const {
+        return offset_table[idx];
+    }
+
+    /* Writes the sample block idx, thread safe for different blocks */
+    void write_block(const size_t idx, const uint32_t id, const HetInfo *his, const size_t n) {
+        check_size(idx, block_size(n));
+        const uint32_t header[3] = {SAMPLE_BLOCK_MARK, id, uint32_t(n)};
+        struct iovec iov[2];
+        iov[0].iov_base = const_cast<uint32_t*>(header);
+        iov[0].iov_len = sizeof(header);
+        iov[1].iov_base = const_cast<HetInfo*>(his);
+        iov[1].iov_len = n * sizeof(HetInfo);
+        writev_at(iov, n ? 2 : 1, offset_table[idx]);
+        if (with_checksums()) {
+            checksums[idx] = crc32c::extend(crc32c::value(header, sizeof(header)), his, n * sizeof(HetInfo));
+        }
+    }
+
+    void write_block(const size_t idx, const uint32_t id, const std::vector<HetInfo>& his) {
+        write_block(idx, id, his.data(), his.size());
+    }
+
+    /* Writes an existing sample block (header included) as is, thread safe for different blocks */
+    void write_raw_block(const size_t idx, const void *block, const uint64_t size) {
+        check_size(idx, size);
+        write_at(block, size, offset_table[idx]);
+        if (with_checksums()) {
+            checksums[idx] = crc32c::value(block, size);
+        }
+    }
+
+    /* Sequential writer for a sample block written in parts, the parts must add up to the block size */
+    class BlockStream {
+    public:
+        BlockStream(HetInfoFileWriter& writer, const size_t idx) :
+            writer(writer), idx(idx), offset(writer.offset_table[idx]), end(offset + writer.block_sizes[idx]) {
+            if (writer.with_checksums()) {
+                writer.checksums[idx] = 0;
+            }
+        }
+
+        void write_header(const uint32_t id, const uint32_t n_hets) {
+            const uint32_t header[3] = {SAMPLE_BLOCK_MARK, id, n_hets};
+            write(reinterpret_cast<const char*>(header), sizeof(header));
+        }
+
+        void write(const char *data, const size_t size) {
+            if (offset + size > end) {
+                std::cerr << "Sample block overflow in file " << writer.filename << std::endl;
+                throw "Sample block overflow";
+            }
+            writer.write_at(data, size, offset);
+            offset += size;
+            if (writer.with_checksums()) {
+                writer.checksums[idx] = crc32c::extend(writer.checksums[idx], data, size);
+            }
+        }
+
+    protected:
+        HetInfoFileWriter& writer;
+        const size_t idx;
+        uint64_t offset;
+        const uint64_t end;
+    };
+
+    BlockStream open_block(const size_t idx) {
+        return BlockStream(*this, idx);
+    }
+
+    /* Runs f(idx) for all blocks idx, over contiguous ranges of blocks on n_threads threads */
+    template <typename F>
+    void for_all_blocks(const size_t n_threads, F f) {
+        parallel_for(n_threads, num_samples(), f);
+    }
+
+    template <typename F>
+    static void parallel_for(size_t n_threads, const size_t n, F f) {
+        n_threads = std::max(size_t(1), std::min(n_threads, n));
+        if (n_threads == 1) {
+            for (size_t i = 0; i < n; ++i) {
+                f(i);
+            }
+            return;
+        }
+        // An exception of a thread stops the others, all are joined and the first one is rethrown
+        std::vector<std::exception_ptr> errors(n_threads);
+        std::atomic<bool> failed(false);
+        std::vector<std::thread> threads;
+        auto join_all = [&]() {
+            for (auto& t : threads) {
+                t.join();
+            }
+        };
+        try {
+            for (size_t t = 0; t < n_threads; ++t) {
+                threads.emplace_back([=, &errors, &failed]() {
+                    const size_t begin = (n * t) / n_threads;
+                    const size_t end = (n * (t + 1)) / n_threads;
+                    try {
+                        for (size_t i = begin; i < end && !failed; ++i) {
+                            f(i);
+                        }
+                    } catch (...) {
+                        errors[t] = std::current_exception();
+                        failed = true;
+                    }
+                });
+            }
+        } catch (...) {
+            failed = true;
+            join_all();
+            throw;
+        }
+        join_all();
+        for (const auto& error : errors) {
+            if (error) {
+                std::rethrow_exception(error);
+            }
+        }
+    }
+
+protected:
+    void check_size(const size_t idx, const uint64_t size) const {
+        if (idx >= block_sizes.size() || block_sizes[idx] != size) {
+            std::cerr << "Sample block " << idx << " does not have the size planned for file " << filename << std::endl;
+            throw "Sample block size mismatch";
+        }
+    }
+
+    void write_at(const void *data, size_t size, uint64_t offset) {
+        const char *p = static_cast<const char*>(data);
+        while (size) {
+            const ssize_t written = pwrite(fd, p, size, offset);
+            if (written <= 0) {
+                std::cerr << "Failed to write to file " << filename << std::endl;
+                throw "Failed to write file";
+            }
+            p += written;
+            size -= written;
+            offset += written;
+        }
+    }
+
+    void writev_at(struct iovec *iov, int iovcnt, uint64_t offset) {
+        size_t total = 0;
+        for (int i = 0; i < iovcnt; ++i) {
+            total += iov[i].iov_len;
+        }
+        const ssize_t written = pwritev(fd, iov, iovcnt, offset);
+        if (written < 0) {
+            std::cerr << "Failed to write to file " << filename << std::endl;
+            throw "Failed to write file";
+        }
+        if (size_t(written) != total) {
+            /* Short write, finish the remaining parts one by one */
+            uint64_t pos = offset + written;
+            size_t skip = written;
+            for (int i = 0; i < iovcnt; ++i) {
+                const size_t len = iov[i].iov_len;
+                if (skip >= len) {
+                    skip -= len;
+                } else {
+                    write_at(static_cast<const char*>(iov[i].iov_base) + skip, len - skip, pos);
+                    pos += len - skip;
+                    skip = 0;
+                }
+            }
+        }
+    }
+
+    const std::string filename;
+    std::vector<uint64_t> offset_table;
+    const std::vector<uint64_t> block_sizes;
+    /* CRC32C of the sample blocks, empty without checksums */
+    std::vector<uint32_t> checksums;
+    const bool checksummed;
+    uint64_t checksums_offset = 0;
+    uint32_t table_crc = 0;
+    uint64_t file_size = 0;
+    int fd = -1;
+    const int uncaught_at_creation;
+};
+
+/**
+ * @brief Writer of the streaming layout of het info binary files, the sample
+ *        blocks are written in order and followed by a footer, so that the
+ *        output never has to be seeked and can go to a pipe.
+ *
+ *        Layout : uint32_t stream mark, uint32_t number of samples, the sample
+ *        blocks, the offset table (uint64_t[]), then the trailer : uint64_t
+ *        offset of the offset table, uint32_t number of samples, uint32_t
+ *        trailer mark.
+ */
+class HetInfoStreamWriter {
+public:
+    static constexpr uint32_t STREAM_MARK = 0xaabbccee;
+    static constexpr uint32_t TRAILER_MARK = 0xd00df007;
+    static constexpr uint64_t HEADER_SIZE = 2 * sizeof(uint32_t);
+    static constexpr uint64_t TRAILER_SIZE = sizeof(uint64_t) + 2 * sizeof(uint32_t);
+
+    HetInfoStreamWriter(std::ostream& os, const uint32_t num_samples) :
+        os(os),
+        num_samples(num_samples) {
+        static_assert(sizeof(HetInfo) == 4 * sizeof(uint32_t), "HetInfo is written as is");
+        offset_table.reserve(num_samples);
+        const uint32_t header[2] = {STREAM_MARK, num_samples};
+        write(reinterpret_cast<const char*>(header), sizeof(header));
+    }
+
+    HetInfoStreamWriter(const HetInfoStreamWriter&) = delete;
+    HetInfoStreamWriter& operator=(const HetInfoStreamWriter&) = delete;
+
+    /* Starts the next sample block, n_hets het infos must then be given with write() */
+    void write_header(const uint32_t id, const uint32_t n_hets) {
+        check_block_done();
+        if (offset_table.size() == num_samples) {
+            std::cerr << "Too many sample blocks written to stream" << std::endl;
+            throw "Too many sample blocks";
+        }
+        offset_table.push_back(pos);
+        const uint32_t header[3] = {HetInfoFileWriter::SAMPLE_BLOCK_MARK, id, n_hets};
+        write(reinterpret_cast<const char*>(header), sizeof(header));
+        block_end = pos + n_hets * sizeof(HetInfo);
+    }
+
+    /* Writes het infos of the current sample block (raw bytes) */
+    void write(const char *data, const size_t size) {
+        os.write(data, size);
+        if (!os) {
+            std::cerr << "Failed to write het info stream" << std::endl;
+            throw "Failed to write stream";
+        }
+        pos += size;
+    }
+
+    void write_block(const uint32_t id, const HetInfo *his, const size_t n) {
+        write_header(id, n);
+        write(reinterpret_cast<const char*>(his), n * sizeof(HetInfo));
+    }
+
+    void write_block(const uint32_t id, const std::vector<HetInfo>& his) {
+        write_block(id, his.data(), his.size());
+    }
+
+    /* Writes the footer, all the sample blocks must have been written */
+    void close() {
+        check_block_done();
+        if (offset_table.size() != num_samples) {
+            std::cerr << "Only " << offset_table.size() << " sample blocks written to stream out of " << num_samples << std::endl;
+            throw "Missing sample blocks";
+        }
+        const uint64_t table_offset = pos;
+        write(reinterpret_cast<const char*>(offset_table.data()), offset_table.size() * sizeof(uint64_t));
+        const uint32_t trailer[2] = {num_samples, TRAILER_MARK};
+        write(reinterpret_cast<const char*>(&table_offset), sizeof(table_offset));
+        write(reinterpret_cast<const char*>(trailer), sizeof(trailer));
+        os.flush();
+    }
+
+protected:
+    void check_block_done() const {
+        if (pos != block_end) {
+            std::cerr << "Sample block of the het info stream is incomplete" << std::endl;
+            throw "Incomplete sample block";
+        }
+    }
+
+    std::ostream& os;
+    const uint32_t num_samples;
+    std::vector<uint64_t> offset_table;
+    uint64_t pos = 0;
+    uint64_t block_end = HEADER_SIZE;
+};
+
+#endif /* __HET_INFO_WRITER_HPP__ */
@@ -110,6 +110,37 @@ public:
         return -1;
     }
 
+    /* VCF lines [begin, end) of the variants in the region CHROM, CHROM:BEG or CHROM:BEG-END (1 based, inclusive),
+     * the variants of a contig are in position order, begin == end if there is none */
+    void find_vcf_lines_of_region(const std::string& region, uint32_t& begin, uint32_t& end) const {
+        const size_t colon = region.find(':');
+        const std::string contig = region.substr(0, colon);
+        uint32_t beg_pos = 1;
+        uint32_t end_pos = -1;
+        if (colon != std::string::npos) {
+            const std::string range = region.substr(colon + 1);
+            const size_t dash = range.find('-');
+            try {
+                beg_pos = std::stoul(range.substr(0, dash));
+                if (dash != std::string::npos && dash + 1 < range.size()) {
+                    end_pos = std::stoul(range.substr(dash + 1));
+                }
+            } catch (...) {
+                std::cerr << "Bad region " << region << ", expected CHROM:BEG-END" << std::endl;
+                throw "Bad region";
+            }
+        }
+        begin = end = 0;
+        uint32_t i = 0;
+        while (i < vars.size() && (vars[i].contig != contig || vars[i].pos1 + 1 < beg_pos)) {
+            ++i;
+        }
+        begin = end = i;
+        while (end < vars.size() && vars[end].contig == contig && vars[end].pos1 + 1 <= end_pos) {
+            ++end;
+        }
+    }
+
     std::map<std::string, uint32_t> get_vcf_line_map() {
         std::map<std::string, uint32_t> map;
         for (uint32_t i = 0; i < vars.size(); ++i) {
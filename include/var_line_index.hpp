@@ -0,0 +1,267 @@
+#ifndef __VAR_LINE_INDEX_HPP__
+#define __VAR_LINE_INDEX_HPP__
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <bcf_traversal.hpp>
+#include "fs.hpp"
+
+/**
+ * @brief Index from the variants of a (main var) VCF/BCF to their line number
+ *        (record number, 0 based). The variants are identified by a 64-bit
+ *        hash of contig, position, ref and alt. The index is built once and
+ *        stored in a sidecar file that is memory mapped for look-ups.
+ *
+ *        File : uint32_t mark, uint32_t version, uint64_t number of records in
+ *        the source, uint64_t number of entries, then the hashes (uint64_t[],
+ *        sorted) and the lines (uint32_t[], same order).
+ */
+class VarLineIndex {
+public:
+    static constexpr uint32_t MARK = 0xaabbcc1d;
+    static constexpr uint32_t VERSION = 1;
+    static constexpr uint64_t HEADER_SIZE = 2 * sizeof(uint32_t) + 2 * sizeof(uint64_t);
+
+    static std::string default_filename(const std::string& vcf_filename) {
+        return vcf_filename + ".lidx";
+    }
+
+    /* Returns the default index of the VCF/BCF if it exists and is not older than it, empty string otherwise */
+    static std::string find_default_index(const std::string& vcf_filename) {
+        const std::string index_filename = default_filename(vcf_filename);
+        std::error_code ec;
+        if (!fs::exists(index_filename, ec) ||
+            fs::last_write_time(index_filename, ec) < fs::last_write_time(vcf_filename, ec)) {
+            return "";
+        }
+        return index_filename;
+    }
+
+    /* FNV-1a of the fields followed by a finalizer so that all bits are mixed */
+    static uint64_t hash_variant(const char *contig, const uint32_t pos, const char *ref, const char *alt) {
+        uint64_t h = 0xcbf29ce484222325ULL;
+        auto add = [&h](const char *p, const size_t n) {
+            for (size_t i = 0; i < n; ++i) {
+                h ^= (uint8_t)p[i];
+                h *= 0x100000001b3ULL;
+            }
+        };
+        add(contig, strlen(contig) + 1);
+        add(reinterpret_cast<const char*>(&pos), sizeof(pos));
+        add(ref, strlen(ref) + 1);
+        add(alt, strlen(alt) + 1);
+        h ^= h >> 30;
+        h *= 0xbf58476d1ce4e5b9ULL;
+        h ^= h >> 27;
+        h *= 0x94d049bb133111ebULL;
+        h ^= h >> 31;
+        return h;
+    }
+
+    /* The record must be unpacked (BCF_UN_STR) */
+    static uint64_t hash_variant(const bcf_hdr_t *hdr, const bcf1_t *line) {
+        return hash_variant(bcf_hdr_id2name(hdr, line->rid), line->pos, line->d.allele[0],
+                            line->n_allele > 1 ? line->d.allele[1] : ".");
+    }
+
+    /* Full key, used to tell duplicate records from hash collisions */
+    static std::string key_variant(const bcf_hdr_t *hdr, const bcf1_t *line) {
+        return std::string(bcf_hdr_id2name(hdr, line->rid)) + ":" + std::to_string(line->pos) + ":" +
+               line->d.allele[0] + ":" + (line->n_allele > 1 ? line->d.allele[1] : ".");
+    }
+
+    VarLineIndex(const std::string& filename) : filename(filename) {
+        fd = open(filename.c_str(), O_RDONLY, 0);
+        if (fd < 0) {
+            std::cerr << "Failed to open file : " << filename << std::endl;
+            throw "Failed to open file";
+        }
+        file_size = fs::file_size(filename);
+        if (file_size < HEADER_SIZE) {
+            std::cerr << "File " << filename << " is not a variant line index" << std::endl;
+            close(fd);
+            throw "Bad variant line index";
+        }
+        file_mmap_p = mmap(NULL, file_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (file_mmap_p == MAP_FAILED) {
+            std::cerr << "Failed to memory map file : " << filename << std::endl;
+            close(fd);
+            throw "Failed to mmap file";
+        }
+
+        const uint32_t *header = (const uint32_t*)file_mmap_p;
+        source_records = *(const uint64_t*)(header + 2);
+        num_entries = *(const uint64_t*)(header + 4);
+        if (header[0] != MARK || header[1] != VERSION ||
+            file_size != HEADER_SIZE + num_entries * (sizeof(uint64_t) + sizeof(uint32_t))) {
+            std::cerr << "File " << filename << " is not a valid variant line index" << std::endl;
+            munmap(file_mmap_p, file_size);
+            close(fd);
+            throw "Bad variant line index";
+        }
+        hashes = (const uint64_t*)((const char*)file_mmap_p + HEADER_SIZE);
+        lines = (const uint32_t*)(hashes + num_entries);
+    }
+
+    VarLineIndex(const VarLineIndex&) = delete;
+    VarLineIndex& operator=(const VarLineIndex&) = delete;
+
+    ~VarLineIndex() {
+        if (file_mmap_p) {
+            munmap(file_mmap_p, file_size);
+            file_mmap_p = NULL;
+        }
+        if (fd > 0) {
+            close(fd);
+            fd = 0;
+        }
+    }
+
+    /* Returns the line of the variant, -1 if not in the index */
+    int64_t find(const uint64_t hash) const {
+        const uint64_t *it = std::lower_bound(hashes, hashes + num_entries, hash);
+        if (it == hashes + num_entries || *it != hash) {
+            return -1;
+        }
+        return lines[it - hashes];
+    }
+
+    int64_t find(const bcf_hdr_t *hdr, const bcf1_t *line) const {
+        return find(hash_variant(hdr, line));
+    }
+
+    const std::string filename;
+    uint64_t source_records = 0;
+    uint64_t num_entries = 0;
+
+protected:
+    int fd = 0;
+    size_t file_size = 0;
+    void *file_mmap_p = NULL;
+    const uint64_t *hashes = NULL;
+    const uint32_t *lines = NULL;
+};
+
+/**
+ * @brief Builds the variant line index of a VCF/BCF. Records with the same hash
+ *        are checked against the source in a second pass, duplicate variants
+ *        keep their first line, different variants with the same hash (hash
+ *        collision) are an error.
+ */
+class VarLineIndexBuilder : public BcfTraversal {
+public:
+    VarLineIndexBuilder() {}
+
+    void build(const std::string& vcf_filename, const std::string& index_filename) {
+        entries.clear();
+        line_num = 0;
+        collecting_keys = false;
+        traverse_no_unpack_no_destroy(vcf_filename);
+        destroy();
+        const uint64_t source_records = line_num;
+
+        std::sort(entries.begin(), entries.end());
+
+        // Lines sharing a hash with another line
+        for (size_t i = 1; i < entries.size(); ++i) {
+            if (entries[i].first == entries[i-1].first) {
+                shared_hash_lines.insert(entries[i-1].second);
+                shared_hash_lines.insert(entries[i].second);
+            }
+        }
+        if (shared_hash_lines.size()) {
+            line_num = 0;
+            collecting_keys = true;
+            traverse_no_unpack_no_destroy(vcf_filename);
+            destroy();
+        }
+
+        std::vector<std::pair<uint64_t, uint32_t> > unique_entries;
+        unique_entries.reserve(entries.size());
+        for (const auto& e : entries) {
+            if (unique_entries.size() && unique_entries.back().first == e.first) {
+                const auto& first_key = keys.at(unique_entries.back().second);
+                const auto& key = keys.at(e.second);
+                if (first_key != key) {
+                    std::cerr << "Hash collision between line " << unique_entries.back().second << " (" << first_key
+                              << ") and line " << e.second << " (" << key << ")" << std::endl;
+                    throw "Variant hash collision";
+                }
+                std::cout << "Duplicate entry : " << key << " at line " << e.second << ", keeping line " << unique_entries.back().second << std::endl;
+            } else {
+                unique_entries.push_back(e);
+            }
+        }
+        duplicates = entries.size() - unique_entries.size();
+        entries.clear();
+        entries.shrink_to_fit();
+        keys.clear();
+        shared_hash_lines.clear();
+
+        write(index_filename, source_records, unique_entries);
+        num_entries = unique_entries.size();
+    }
+
+    virtual void handle_bcf_file_reader() override {}
+
+    virtual void handle_bcf_line() override {
+        auto line = bcf_fri.line;
+        const bcf_hdr_t *hdr = bcf_fri.sr->readers[0].header;
+        bcf_unpack(line, BCF_UN_STR);
+        if (collecting_keys) {
+            if (shared_hash_lines.count(line_num)) {
+                keys[line_num] = VarLineIndex::key_variant(hdr, line);
+            }
+        } else {
+            entries.push_back({VarLineIndex::hash_variant(hdr, line), line_num});
+        }
+        line_num++;
+    }
+
+    size_t num_entries = 0;
+    size_t duplicates = 0;
+
+protected:
+    static void write(const std::string& filename, const uint64_t source_records, const std::vector<std::pair<uint64_t, uint32_t> >& entries) {
+        std::fstream ofs(filename, std::ios_base::binary | std::ios_base::out | std::ios_base::trunc);
+        if (!ofs.is_open()) {
+            std::cerr << "Cannot open file " << filename << std::endl;
+            throw "Cannot open file";
+        }
+        const uint32_t header[2] = {VarLineIndex::MARK, VarLineIndex::VERSION};
+        const uint64_t n = entries.size();
+        ofs.write(reinterpret_cast<const char*>(header), sizeof(header));
+        ofs.write(reinterpret_cast<const char*>(&source_records), sizeof(source_records));
+        ofs.write(reinterpret_cast<const char*>(&n), sizeof(n));
+        for (const auto& e : entries) {
+            ofs.write(reinterpret_cast<const char*>(&e.first), sizeof(e.first));
+        }
+        for (const auto& e : entries) {
+            ofs.write(reinterpret_cast<const char*>(&e.second), sizeof(e.second));
+        }
+        ofs.close();
+        if (ofs.fail()) {
+            std::cerr << "Failed to write file " << filename << std::endl;
+            throw "Failed to write file";
+        }
+    }
+
+    uint32_t line_num = 0;
+    bool collecting_keys = false;
+    std::vector<std::pair<uint64_t, uint32_t> > entries;
+    std::unordered_set<uint32_t> shared_hash_lines;
+    std::unordered_map<uint32_t, std::string> keys;
+};
+
+#endif /* __VAR_LINE_INDEX_HPP__ */
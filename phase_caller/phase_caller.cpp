@@ -51,6 +51,8 @@ public:
                        "    1000 bp is ok for most short-read libraries");
         app.add_option("--pp-threshold", pp_threshold, "Caller: PP threshold, rephase only extracted variants with PP < threshold (default 1.0)\n"
                        "    Note: The pp_extractor stage already thresholds on PP (< 0.99) during extraction");
+        app.add_option("-r,--region", region, "Subsampling: Only rephase the het sites in the region CHROM:BEG-END (1 based, inclusive)\n"
+                       "    The het sites outside the region are neither rephased nor used to rephase");
         app.add_option("-t,--num-threads", n_threads, "Perf: Number of threads, default is 1, set to 0 for auto");
         app.add_flag("-v,--verbose", verbose, "Other: Verbose mode, display more messages");
         app.add_flag("--indels", indels, "[Experimental] Include indels in rephasing");
@@ -75,6 +77,10 @@ public:
     size_t max_distance = 1000;
     float pp_threshold = 1.0;
     bool indels = false;
+    std::string region;
+    /* VCF lines of the region, all if no region */
+    uint32_t begin_line = 0;
+    uint32_t end_line = -1;
 };
 
 GlobalAppOptions global_app_options;
@@ -88,37 +94,39 @@ public:
         a1_reads_p(new std::set<std::string>) {}
     Hetp(float *pp, int *gt, const VarInfo *var_info) :
         Hetp(var_info) {
-        pp_arr = pp;
-        gt_arr = gt;
+        het_info = HetInfoRef(gt, pp);
+    }
+    /* Het info of a memory mapped file (original or compact layout), edited in place */
+    Hetp(const HetInfoRef& het_info, const std::vector<VarInfo>& vi) : Hetp(&vi[het_info.vcf_line()]) {
+        this->het_info = het_info;
     }
-    Hetp(uint32_t* ptr, const std::vector<VarInfo>& vi) : Hetp((float*)ptr+3, (int*)ptr+1, &vi[*ptr]) {}
 
     bool is_snp() {
         return var_info->snp;
     }
 
     inline char get_allele0() const {
-        return bcf_gt_allele(gt_arr[0]) ? var_info->alt[0] : var_info->ref[0];
+        return bcf_gt_allele(het_info.a0()) ? var_info->alt[0] : var_info->ref[0];
     }
 
     inline char get_allele1() const {
-        return bcf_gt_allele(gt_arr[1]) ? var_info->alt[0] : var_info->ref[0];
+        return bcf_gt_allele(het_info.a1()) ? var_info->alt[0] : var_info->ref[0];
     }
 
     inline bool allele0_is_ref() const {
-        return bcf_gt_allele(gt_arr[0]) == 0;
+        return bcf_gt_allele(het_info.a0()) == 0;
     }
 
     inline bool allele1_is_ref() const {
-        return bcf_gt_allele(gt_arr[1]) == 0;
+        return bcf_gt_allele(het_info.a1()) == 0;
     }
 
     inline bool allele0_is_alt() const {
-        return bcf_gt_allele(gt_arr[0]) != 0;
+        return bcf_gt_allele(het_info.a0()) != 0;
     }
 
     inline bool allele1_is_alt() const {
-        return bcf_gt_allele(gt_arr[1]) != 0;
+        return bcf_gt_allele(het_info.a1()) != 0;
     }
 
     int get_indel_signed_length() const {
@@ -129,17 +137,13 @@ public:
     std::string to_string() const {
         //std::string result(bcf_hdr_id2name(hdr, rec->rid)); // segfault ...
         std::string result(var_info->to_string());
-        result += "\t" + std::to_string(bcf_gt_allele(gt_arr[0])) + "|" + std::to_string(bcf_gt_allele(gt_arr[1])) + ":" + std::to_string(get_pp());
+        result += "\t" + std::to_string(bcf_gt_allele(het_info.a0())) + "|" + std::to_string(bcf_gt_allele(het_info.a1())) + ":" + std::to_string(get_pp());
 
         return result;
     }
 
     void reverse_phase() {
-        int a0 = bcf_gt_allele(gt_arr[0]);
-        int a1 = bcf_gt_allele(gt_arr[1]);
-
-        gt_arr[0] = bcf_gt_unphased(a1); // First allele is always unphased per BCF standard
-        gt_arr[1] = bcf_gt_phased(a0);
+        het_info.switch_phase(); // First allele is always unphased per BCF standard
         reversed = true;
         // The reads that associate to that allele are now swapped
         a0_reads_p.swap(a1_reads_p);
@@ -147,11 +151,13 @@ public:
 
     float get_pp() const {
         /// @note NaN is when PP is not given (e.g., common variants)
-        return std::isnan(pp_arr[0]) ? 1.0 : pp_arr[0];
+        const float pp = het_info.pp();
+        return std::isnan(pp) ? 1.0 : pp;
     }
 
+    /* PP + number of reads + 1 in the original layout, the number of reads and a flag in the compact layout */
     void set_validated_pp(size_t number_of_reads) {
-        pp_arr[0] += number_of_reads+1;
+        het_info.set_validated(number_of_reads);
     }
 
 
@@ -161,8 +167,7 @@ public:
 
 protected:
     bool reversed = false;
-    float *pp_arr = NULL;
-    int *gt_arr = NULL;
+    HetInfoRef het_info;
 };
 
 class Het : public Hetp {
@@ -180,6 +185,7 @@ public:
         if (res < 0) {
             std::cerr << "Could not extract GT for pos : " << rec->pos << std::endl;
         }
+        het_info = HetInfoRef(gt_arr, pp_arr);
     }
 
     ~Het() {
@@ -196,6 +202,8 @@ public:
     std::unique_ptr<const VarInfo> var_info_up;
 
 private:
+    float *pp_arr = NULL;
+    int *gt_arr = NULL;
     int pp_arr_size = 0;
     int gt_arr_size = 0;
 };
@@ -556,10 +564,15 @@ public:
     HetInfoPtrContainerExt (HetInfoMemoryMap& parent, size_t sample_idx, const std::vector<VarInfo>& vi) :
         HetInfoMemoryMap::HetInfoPtrContainer(parent, sample_idx), vi(vi) {}
 
+    /* Only the het infos of the VCF lines [begin_line, end_line) */
+    HetInfoPtrContainerExt (HetInfoMemoryMap& parent, size_t sample_idx, const std::vector<VarInfo>& vi,
+                            uint32_t begin_line, uint32_t end_line) :
+        HetInfoMemoryMap::HetInfoPtrContainer(parent, sample_idx, parent.get_span_of_nth_in_lines(sample_idx, begin_line, end_line)), vi(vi) {}
+
     void fill_het_info_ext(std::vector<std::unique_ptr<Hetp> >& v) {
         v.clear();
-        for (size_t i = 0; i < size; ++i) {
-            v.emplace_back(std::make_unique<Hetp>(start_pos+i*Iterator_type::skip(), vi));
+        for (const auto hi : span) {
+            v.emplace_back(std::make_unique<Hetp>(hi, vi));
         }
     }
 
@@ -756,7 +769,7 @@ void rephase_sample(const std::vector<VarInfo>& vi, HetInfoMemoryMap& himm, cons
     std::vector<std::unique_ptr<HetTrio> > het_trios;
 
     // Get hets from memory map
-    HetInfoPtrContainerExt hipce(himm, himm_sample_idx, vi);
+    HetInfoPtrContainerExt hipce(himm, himm_sample_idx, vi, global_app_options.begin_line, global_app_options.end_line);
     // Hets created from the memory map will directy edit the file on rephase
     hipce.fill_het_info_ext(hets);
     het_trio_list_from_hets(het_trios, hets);
@@ -842,6 +855,14 @@ private:
         if (sample_name[0] == 'W' && !global_app_options.cram_path_from_samples_file) {
             std::lock_guard lk(mutex);
             std::cerr << "Withdrawn sample " << sample_name << " will not rephase because sequencing data is not available" << std::endl;
+        } else if (himm.has_sample_names() && himm.get_sample_name_of_nth(himm_idx) != sample_name) {
+            // The sample table of the binary file says which sample the block is
+            std::lock_guard lk(mutex);
+            std::cerr << "Sample " << sample_name << " is " << himm.get_sample_name_of_nth(himm_idx) << " in the binary file, skipping ..." << std::endl;
+        } else if (!himm.checksum_check_pass_of_nth(himm_idx)) {
+            // Checked on first access, a corrupted sample block is not rephased (it would get a valid checksum)
+            std::lock_guard lk(mutex);
+            std::cerr << "Sample " << sample_name << " has a corrupted sample block in the binary file, skipping ..." << std::endl;
         } else {
             std::string cram_file;
             if (!global_app_options.cram_path_from_samples_file) {
@@ -860,6 +881,8 @@ private:
                 std::cerr << "Cannot find file " << cram_file << " skipping ..." << std::endl;
             } else {
                 rephase_sample(vil.vars, himm, cram_file, himm_idx);
+                // The sample block was modified in place
+                himm.update_checksum_of_nth(himm_idx);
             }
         }
         {
@@ -946,6 +969,12 @@ public:
         for (size_t i = 0; i < sil.sample_names.size(); ++i) {
             if (std::find(samples_to_do.sample_names.begin(), samples_to_do.sample_names.end(),
                 sil.sample_names[i]) != samples_to_do.sample_names.end()) {
+                // With a sample table the binary file can be subsampled, its block is looked up
+                uint32_t himm_idx = i;
+                if (himm.has_sample_table() && !himm.find_nth_of_orig_idx(i, himm_idx)) {
+                    std::cerr << "Sample " << sil.sample_names[i] << " is not in the binary file, skipping ..." << std::endl;
+                    continue;
+                }
                 std::unique_lock<std::mutex> lk(mutex);
                 size_t ti = find_free(active_threads);
                 cv.wait(lk, [&]{ti = find_free(active_threads); return ti < active_threads.size(); });
@@ -960,7 +989,7 @@ public:
 
                 std::cout << "Launching thread " << ti << std::endl;
                 active_threads[ti] = true;
-                threads[ti] = new std::thread(thread_fun, ti, i, i);
+                threads[ti] = new std::thread(thread_fun, ti, i, himm_idx);
             }
         }
 
@@ -1016,6 +1045,14 @@ int main(int argc, char**argv) {
     std::cout << "Read filter is : " << (global_app_options.no_filter ? "OFF" : "ON") << std::endl;
 
     PhaseCaller pc(opt.var_filename, opt.bin_filename, opt.sample_filename, opt.sample_list_filename, opt.n_threads);
+    if (!opt.region.empty()) {
+        try {
+            pc.vil.find_vcf_lines_of_region(opt.region, opt.begin_line, opt.end_line);
+        } catch (const char *e) {
+            exit(-1);
+        }
+        std::cout << "Region " << opt.region << " : VCF lines [" << opt.begin_line << ", " << opt.end_line << ")" << std::endl;
+    }
     pc.rephase_orchestrator_multi_thread();
     printElapsedTime(start_time, std::chrono::steady_clock::now());
 
@@ -0,0 +1,429 @@
+/**
+ * @brief Micro-benchmark of the per record extraction cost of pp_extract
+ *
+ *        Compares the previous per sample loop, with the mode branches
+ *        (PP field, synthetic PP, singletons, non SNP) tested for every
+ *        sample, to the het scan and mode specialized kernels, for the PP,
+ *        MAF and AF modes, and to the tiled extraction (records buffered
+ *        in tiles transposed to sample major order). The records are
+ *        generated in memory so that the decoding of the input does not
+ *        weigh in.
+ *
+ *        With --check the optimized parts are checked against their
+ *        reference implementations instead (the FIFO ring against the
+ *        previous deque FIFO for all the sizes, the vectorized het scan
+ *        kernels against the scalar one), on random inputs.
+ */
+
+#include <algorithm>
+#include <deque>
+#include <iostream>
+#include <random>
+#include "CLI11.hpp"
+#include "fifo.hpp"
+#include "extractors.hpp"
+
+class GlobalAppOptions {
+public:
+    GlobalAppOptions() {
+        app.add_option("-n,--samples", n_samples, "Number of samples");
+        app.add_option("-r,--records", n_records, "Number of records");
+        app.add_option("--het-rate", het_rate, "Average fraction of het samples in a record");
+        app.add_option("--low-pp-rate", low_pp_rate, "Fraction of het samples with a PP below threshold");
+        app.add_option("--fifo-size", fifo_size, "FIFO size");
+        app.add_option("--seed", seed, "Random seed");
+        app.add_option("--tile-records", tile_records, "Number of records of a tile");
+        app.add_option("--tile-samples", tile_samples, "Number of samples transposed together");
+        app.add_flag("--check", check, "Check the optimized parts against their reference implementations and exit");
+    }
+
+    CLI::App app{"Extraction micro-benchmark"};
+    size_t n_samples = 10000;
+    size_t n_records = 2000;
+    float het_rate = 0.01;
+    float low_pp_rate = 0.1;
+    size_t fifo_size = 5;
+    size_t seed = 42;
+    size_t tile_records = 256;
+    size_t tile_samples = 2048;
+    bool check = false;
+};
+
+GlobalAppOptions global_app_options;
+
+class BenchRecord {
+public:
+    ExtractRecordInfo info;
+    std::vector<int> gt;
+    std::vector<float> pp;
+};
+
+enum class Mode { PP, MAF, AF };
+
+static const char* mode_name(Mode mode) {
+    switch (mode) {
+        case Mode::PP: return "PP";
+        case Mode::MAF: return "MAF";
+        default: return "AF";
+    }
+}
+
+/* Records with mostly hom ref samples, as for rare variants */
+std::vector<BenchRecord> generate_records(Mode mode) {
+    const auto& opt = global_app_options;
+    std::mt19937 gen(opt.seed);
+    std::uniform_real_distribution<float> uniform(0.0, 1.0);
+    std::vector<BenchRecord> records(opt.n_records);
+    for (size_t r = 0; r < opt.n_records; ++r) {
+        auto& rec = records[r];
+        rec.gt.resize(opt.n_samples * PLOIDY_2);
+        rec.pp.resize(opt.n_samples);
+        /* Vary the het rate between records, a fraction are singletons */
+        const float rate = (r % 4 == 0) ? 0.0 : opt.het_rate * uniform(gen) * 2;
+        int AC = 0;
+        for (size_t i = 0; i < opt.n_samples; ++i) {
+            int a0 = 0;
+            int a1 = 0;
+            if (uniform(gen) < rate) {
+                (uniform(gen) < 0.5 ? a0 : a1) = 1;
+            }
+            AC += a0 + a1;
+            rec.gt[i*PLOIDY_2] = bcf_gt_unphased(a0);
+            rec.gt[i*PLOIDY_2+1] = bcf_gt_phased(a1);
+            rec.pp[i] = (uniform(gen) < opt.low_pp_rate) ? uniform(gen) * 0.99 : 1.0;
+        }
+        rec.info.line_counter = r;
+        rec.info.AC = (r % 4 == 0) ? 1 : AC;
+        rec.info.has_pp = (mode == Mode::PP);
+        rec.info.non_snp = (r % 10 == 0);
+        const float maf = float(rec.info.AC) / (opt.n_samples * PLOIDY_2);
+        rec.info.synthetic_pp = (maf > 0.001) ? NAN : 0.5 + maf / 2.0;
+    }
+    return records;
+}
+
+/* The previous extraction loop, all samples are visited and the modes tested for each */
+class LegacyExtractor {
+public:
+    LegacyExtractor(size_t n_samples, size_t fifo_size, bool pp_from_maf, bool pp_from_af) :
+        PP_THRESHOLD(0.99), pred(PP_THRESHOLD), pp_from_maf(pp_from_maf), pp_from_af(pp_from_af),
+        number_of_het_sites(n_samples, 0), number_of_low_pp_sites(n_samples, 0),
+        number_of_snp_low_pp_sites(n_samples, 0), number_of_non_snp(n_samples, 0),
+        fifos(n_samples, GenericKeepFifo<HetInfo, PPPred>(fifo_size, PPPred(PP_THRESHOLD))) {}
+
+    void extract(const ExtractRecordInfo& info, const int *gt_arr, const float *pp_arr) {
+        for (size_t i = 0; i < fifos.size(); ++i) {
+            int encoded_a0 = gt_arr[i*PLOIDY_2];
+            int encoded_a1 = gt_arr[i*PLOIDY_2+1];
+            int a0 = bcf_gt_allele(encoded_a0);
+            int a1 = bcf_gt_allele(encoded_a1);
+
+            if (a0 != a1) {
+                number_of_het_sites[i]++;
+                float pp = NAN;
+                if (info.has_pp) {
+                    pp = pp_arr[i];
+                } else if (pp_from_maf || pp_from_af) {
+                    pp = info.synthetic_pp;
+                }
+                if (info.AC == 1 && pp >= PP_THRESHOLD) {
+                    pp = 0.97;
+                }
+                HetInfo hi(info.line_counter, encoded_a0, encoded_a1, pp);
+                if (pred(hi)) {
+                    number_of_low_pp_sites[i]++;
+                    if (!info.non_snp) {
+                        number_of_snp_low_pp_sites[i]++;
+                    }
+                }
+                if (info.non_snp) {
+                    number_of_non_snp[i]++;
+                }
+                fifos[i].insert(hi);
+            }
+        }
+    }
+
+    const float PP_THRESHOLD;
+    const PPPred pred;
+    bool pp_from_maf;
+    bool pp_from_af;
+    std::vector<uint32_t> number_of_het_sites;
+    std::vector<uint32_t> number_of_low_pp_sites;
+    std::vector<uint32_t> number_of_snp_low_pp_sites;
+    std::vector<uint32_t> number_of_non_snp;
+    std::vector<GenericKeepFifo<HetInfo, PPPred> > fifos;
+};
+
+/* The previous FIFO (a deque of flagged items), reference of the FIFO ring */
+template <typename T, class Pred>
+class DequeKeepFifo {
+public:
+    DequeKeepFifo(const size_t size, Pred p) : size(size), mid(size/2), p(p) {}
+
+    void insert(T item) {
+        if (items.size() == 0) {
+            for (size_t i = 0; i < size; ++i) {
+                items.push_back({item, true});
+            }
+        }
+        items.push_back({item, false});
+        items.pop_front();
+        if (p(items[mid].item)) {
+            keep_from(0);
+        }
+    }
+
+    void finalize() {
+        for (size_t i = mid + 1; i < items.size(); ++i) {
+            if (p(items[i].item)) {
+                keep_from(i-mid);
+                break;
+            }
+        }
+    }
+
+    const std::vector<T>& get_kept_items_ref() const {
+        return kept_items;
+    }
+
+protected:
+    struct FIFOItem {
+        T item;
+        bool kept;
+    };
+
+    void keep_from(const size_t start) {
+        for (size_t i = start; i < items.size(); ++i) {
+            if (!items[i].kept) {
+                kept_items.push_back(items[i].item);
+                items[i].kept = true;
+            }
+        }
+    }
+
+    size_t size;
+    size_t mid;
+    std::deque<FIFOItem> items;
+    std::vector<T> kept_items;
+    Pred p;
+};
+
+/* Same kept items as the deque FIFO, for all the FIFO sizes up to twice the masks (in the ring of the FIFO, in a ring
+ * allocated with it, with the flags by slot) and random streams of different lengths (shorter than the FIFO
+ * included) and low PP rates */
+bool check_fifos() {
+    const auto& opt = global_app_options;
+    std::mt19937 gen(opt.seed);
+    std::uniform_real_distribution<float> uniform(0.0, 1.0);
+    const PPPred pred(0.99);
+    size_t streams = 0;
+    size_t failures = 0;
+    for (size_t size = 1; size <= 2 * GenericKeepFifo<HetInfo, PPPred>::MASK_MAX_SIZE + 3; size += 2) {
+        for (const float low_pp_rate : {0.01f, 0.1f, 0.5f, 0.9f}) {
+            for (size_t length : {size_t(0), size_t(1), size / 2, size, size + 1, size_t(100 + gen() % 1000)}) {
+                GenericKeepFifo<HetInfo, PPPred> ring(size, pred);
+                DequeKeepFifo<HetInfo, PPPred> reference(size, pred);
+                for (size_t i = 0; i < length; ++i) {
+                    const float pp = (uniform(gen) < low_pp_rate) ? uniform(gen) * 0.99 : 1.0;
+                    const HetInfo hi(i, bcf_gt_unphased(i & 1), bcf_gt_phased(!(i & 1)), pp);
+                    ring.insert(hi);
+                    reference.insert(hi);
+                }
+                ring.finalize();
+                reference.finalize();
+                streams++;
+                if (ring.get_kept_items_ref() != reference.get_kept_items_ref()) {
+                    std::cerr << "FIFO of size " << size << " differs from the deque FIFO on a stream of " << length
+                              << " items with a low PP rate of " << low_pp_rate << std::endl;
+                    failures++;
+                }
+            }
+        }
+    }
+    std::cout << "FIFO ring against deque FIFO : " << streams - failures << " of " << streams << " streams with the same kept items" << std::endl;
+    return !failures;
+}
+
+/* Float of the given bit pattern, e.g., bcf_float_missing */
+static float float_of_bits(const uint32_t bits) {
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+/* Same het indices, low PP flags, number of hets and alt alleles as the scalar kernel for the vectorized kernels
+ * available on the CPU, on random GT (missing, vector end, other alleles) and PP (missing, vector end, NaN, around
+ * the threshold) arrays, with and without PP, for ranges not aligned on and not multiple of the vector widths,
+ * and the same for the scan of the samples not homozygous reference only (carriers of a sparse record) */
+bool check_het_scan_kernels() {
+    const auto& opt = global_app_options;
+    std::mt19937 gen(opt.seed);
+    const int gts[] = {bcf_gt_unphased(0), bcf_gt_phased(0), bcf_gt_unphased(1), bcf_gt_phased(1),
+                       bcf_gt_phased(2), bcf_gt_phased(3), bcf_gt_missing, bcf_int32_vector_end};
+    const float pps[] = {0.5, 0.98, 0.99, 0.995, 1.0, NAN, float_of_bits(bcf_float_missing), float_of_bits(bcf_float_vector_end)};
+    const float pp_threshold = 0.99;
+
+    std::vector<het_scan::Isa> isas = {het_scan::Isa::SSE42, het_scan::Isa::AVX2};
+    const het_scan::Isa best = het_scan::best_isa();
+    isas.erase(std::remove_if(isas.begin(), isas.end(), [&](het_scan::Isa isa) { return int(isa) > int(best); }), isas.end());
+
+    HetScanner reference(het_scan::Isa::SCALAR);
+    HetScanner listed;
+    size_t scans = 0;
+    size_t failures = 0;
+    for (auto isa : isas) {
+        HetScanner scanner(isa);
+        for (size_t n = 0; n < 2000; ++n) {
+            const size_t begin = gen() % 11;
+            const size_t end = begin + ((n < 100) ? n % 40 : gen() % 300);
+            /* Mostly hom ref or hets of the two first alleles, the rare values are the special ones */
+            std::vector<int> gt(end * 2);
+            std::vector<float> pp(end);
+            for (size_t i = 0; i < end; ++i) {
+                gt[i*2] = gts[(gen() % 4) ? gen() % 4 : gen() % 8];
+                gt[i*2+1] = gts[(gen() % 4) ? gen() % 4 : gen() % 8];
+                pp[i] = pps[gen() % 8];
+            }
+            std::vector<uint32_t> carriers;
+            for (size_t i = 0; i < end; ++i) {
+                if (bcf_gt_allele(gt[i*2]) || bcf_gt_allele(gt[i*2+1])) {
+                    carriers.push_back(i);
+                }
+            }
+            for (const bool with_pp : {true, false}) {
+                for (const bool with_alt_count : {true, false}) {
+                    const float *pp_arr = with_pp ? pp.data() : NULL;
+                    reference.scan(gt.data(), pp_arr, begin, end, pp_threshold, with_alt_count);
+                    scanner.scan(gt.data(), pp_arr, begin, end, pp_threshold, with_alt_count);
+                    scans++;
+                    const size_t n_hets = reference.n_hets;
+                    if (scanner.n_hets != n_hets || scanner.alt_count != reference.alt_count ||
+                        !std::equal(reference.het_idx.begin(), reference.het_idx.begin() + n_hets, scanner.het_idx.begin()) ||
+                        !std::equal(reference.low_pp.begin(), reference.low_pp.begin() + n_hets, scanner.low_pp.begin()) ||
+                        scanner.count_alt_alleles(gt.data(), begin, end) != reference.count_alt_alleles(gt.data(), begin, end)) {
+                        std::cerr << het_scan::isa_name(isa) << " kernel differs from the scalar one on samples [" << begin << ", " << end << ")"
+                                  << (with_pp ? "" : " without PP") << (with_alt_count ? " with alt count" : "") << std::endl;
+                        failures++;
+                    }
+                    listed.scan_listed(gt.data(), pp_arr, carriers, begin, end, pp_threshold, with_alt_count);
+                    if (listed.n_hets != n_hets || listed.alt_count != reference.alt_count ||
+                        !std::equal(reference.het_idx.begin(), reference.het_idx.begin() + n_hets, listed.het_idx.begin()) ||
+                        !std::equal(reference.low_pp.begin(), reference.low_pp.begin() + n_hets, listed.low_pp.begin())) {
+                        std::cerr << "Scan of the carriers differs from the scalar kernel on samples [" << begin << ", " << end << ")"
+                                  << (with_pp ? "" : " without PP") << (with_alt_count ? " with alt count" : "") << std::endl;
+                        failures++;
+                    }
+                }
+            }
+        }
+    }
+    std::cout << "Het scan kernels (";
+    for (size_t i = 0; i < isas.size(); ++i) {
+        std::cout << (i ? ", " : "") << het_scan::isa_name(isas[i]);
+    }
+    std::cout << ") against scalar kernel : " << scans - failures << " of " << scans << " scans with the same results" << std::endl;
+    return !failures;
+}
+
+/* Drives the kernels of the traversal without a file */
+class BenchTraversal : public PPExtractTraversal {
+public:
+    BenchTraversal(size_t n_samples, size_t fifo_size, bool pp_from_maf, bool pp_from_af, size_t tile_records = 0, size_t tile_samples = 0) :
+        PPExtractTraversal(0, n_samples, fifo_size, pp_from_maf, pp_from_af) {
+        bcf_fri.n_samples = n_samples;
+        set_tiling(tile_records, tile_samples);
+        handle_bcf_file_reader();
+    }
+
+    HetTile *tile() {
+        return tiles.empty() ? NULL : &tiles.front();
+    }
+};
+
+template <typename F, typename G>
+double time_records(const std::vector<BenchRecord>& records, F f, G finalize) {
+    const auto start{std::chrono::steady_clock::now()};
+    for (const auto& rec : records) {
+        f(rec);
+    }
+    finalize();
+    const std::chrono::duration<double> elapsed_seconds{std::chrono::steady_clock::now() - start};
+    return elapsed_seconds.count();
+}
+
+template <typename A, typename B>
+bool same_results(const A& a, const B& b) {
+    if (a.number_of_het_sites != b.number_of_het_sites ||
+        a.number_of_low_pp_sites != b.number_of_low_pp_sites ||
+        a.number_of_snp_low_pp_sites != b.number_of_snp_low_pp_sites ||
+        a.number_of_non_snp != b.number_of_non_snp) {
+        return false;
+    }
+    for (size_t i = 0; i < a.fifos.size(); ++i) {
+        const auto& ka = a.fifos[i].get_kept_items_ref();
+        const auto& kb = b.fifos[i].get_kept_items_ref();
+        if (ka.size() != kb.size() ||
+            (ka.size() && memcmp(ka.data(), kb.data(), ka.size() * sizeof(HetInfo)))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char**argv) {
+    CLI::App& app = global_app_options.app;
+    CLI11_PARSE(app, argc, argv);
+    const auto& opt = global_app_options;
+
+    if (opt.check) {
+        const bool fifos_ok = check_fifos();
+        const bool kernels_ok = check_het_scan_kernels();
+        return (fifos_ok && kernels_ok) ? 0 : 1;
+    }
+
+    bool ok = true;
+    for (auto mode : {Mode::PP, Mode::MAF, Mode::AF}) {
+        const auto records = generate_records(mode);
+        const bool maf = (mode == Mode::MAF);
+        const bool af = (mode == Mode::AF);
+
+        LegacyExtractor legacy(opt.n_samples, opt.fifo_size, maf, af);
+        const double legacy_time = time_records(records, [&](const BenchRecord& rec) {
+            legacy.extract(rec.info, rec.gt.data(), rec.pp.data());
+        }, [&]{
+            for (auto& f : legacy.fifos) {
+                f.finalize();
+            }
+        });
+
+        BenchTraversal specialized(opt.n_samples, opt.fifo_size, maf, af);
+        HetScanner scanner;
+        const double specialized_time = time_records(records, [&](const BenchRecord& rec) {
+            specialized.extract_samples(rec.info, rec.gt.data(), rec.pp.data(), 0, opt.n_samples, scanner);
+        }, [&]{ specialized.finalize(); });
+
+        BenchTraversal tiled(opt.n_samples, opt.fifo_size, maf, af, opt.tile_records, opt.tile_samples);
+        const double tiled_time = time_records(records, [&](const BenchRecord& rec) {
+            tiled.extract_samples(rec.info, rec.gt.data(), rec.pp.data(), 0, opt.n_samples, scanner, tiled.tile());
+        }, [&]{ tiled.finalize(); });
+
+        const bool same = same_results(legacy, specialized) && same_results(legacy, tiled);
+        ok = ok && same;
+
+        const double n = records.size();
+        std::cout << mode_name(mode) << " mode : "
+                  << "per sample branches " << legacy_time * 1e9 / n << " ns/record, "
+                  << "specialized kernels (" << het_scan::isa_name(scanner.isa) << ") "
+                  << specialized_time * 1e9 / n << " ns/record, "
+                  << "speedup " << legacy_time / specialized_time << "x"
+                  << (same ? "" : " RESULTS DIFFER !") << std::endl;
+        std::cout << mode_name(mode) << " mode : "
+                  << "direct FIFOs " << n / specialized_time << " records/s, "
+                  << "tiles of " << opt.tile_records << " records x " << opt.tile_samples << " samples "
+                  << n / tiled_time << " records/s, "
+                  << "speedup " << specialized_time / tiled_time << "x" << std::endl;
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,272 @@
+#ifndef __BCF_PIPELINE_HPP__
+#define __BCF_PIPELINE_HPP__
+
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "vcf.h"
+#include "hts.h"
+#include "bcf_traversal.hpp"
+
+/**
+ * @brief Bounded ring of pre-allocated BCF records between a decoding stage
+ *        (single producer) and a processing stage (single consumer)
+ */
+class BcfRecordRing {
+public:
+    class Slot {
+    public:
+        bcf1_t *line = NULL;
+        int *gt_arr = NULL;
+        int size_gt_arr = 0;
+        int ngt = 0;
+    };
+
+    class StageStatistics {
+    public:
+        size_t stalls = 0;
+        double stalled_seconds = 0.0;
+    };
+
+    BcfRecordRing(size_t capacity) : capacity(std::max(capacity, size_t(1))), slots(new Slot[this->capacity]) {
+        for (size_t i = 0; i < this->capacity; ++i) {
+            slots[i].line = bcf_init();
+        }
+    }
+
+    ~BcfRecordRing() {
+        for (size_t i = 0; i < capacity; ++i) {
+            if (slots[i].line) {
+                bcf_destroy(slots[i].line);
+                slots[i].line = NULL;
+            }
+            if (slots[i].gt_arr) {
+                free(slots[i].gt_arr);
+                slots[i].gt_arr = NULL;
+            }
+        }
+    }
+
+    /* Producer : Get the next free slot to decode a record into, waits if the ring is full, returns NULL if cancelled */
+    Slot* acquire_free() {
+        std::unique_lock<std::mutex> lk(mutex);
+        if (filled == capacity && !cancelled) {
+            wait(lk, cv_free, [&]{ return filled < capacity || cancelled; }, producer_stats);
+        }
+        if (cancelled) {
+            return NULL;
+        }
+        return &slots[head];
+    }
+
+    /* Producer : The slot returned by acquire_free() holds a decoded record */
+    void publish() {
+        {
+            std::lock_guard<std::mutex> lk(mutex);
+            head = (head + 1) % capacity;
+            filled++;
+        }
+        cv_filled.notify_one();
+    }
+
+    /* Producer : No more records will be published */
+    void close() {
+        {
+            std::lock_guard<std::mutex> lk(mutex);
+            closed = true;
+        }
+        cv_filled.notify_one();
+    }
+
+    /* Consumer : Get the oldest decoded record, waits if the ring is empty, returns NULL when done */
+    Slot* acquire_filled() {
+        std::unique_lock<std::mutex> lk(mutex);
+        if (!filled && !closed) {
+            wait(lk, cv_filled, [&]{ return filled || closed; }, consumer_stats);
+        }
+        if (!filled) {
+            return NULL;
+        }
+        return &slots[tail];
+    }
+
+    /* Consumer : The slot returned by acquire_filled() can be reused */
+    void release() {
+        {
+            std::lock_guard<std::mutex> lk(mutex);
+            tail = (tail + 1) % capacity;
+            filled--;
+        }
+        cv_free.notify_one();
+    }
+
+    /* Consumer : No more records will be handled (e.g., on error), the producer stops */
+    void cancel() {
+        {
+            std::lock_guard<std::mutex> lk(mutex);
+            cancelled = true;
+        }
+        cv_free.notify_one();
+    }
+
+    /* Stalls of the decoding stage (ring full), the processing stage is the limiting one */
+    StageStatistics producer_stats;
+    /* Stalls of the processing stage (ring empty), the decoding stage is the limiting one */
+    StageStatistics consumer_stats;
+
+protected:
+    template <typename Pred>
+    void wait(std::unique_lock<std::mutex>& lk, std::condition_variable& cv, Pred pred, StageStatistics& stats) {
+        const auto start{std::chrono::steady_clock::now()};
+        cv.wait(lk, pred);
+        const std::chrono::duration<double> elapsed_seconds{std::chrono::steady_clock::now() - start};
+        stats.stalls++;
+        stats.stalled_seconds += elapsed_seconds.count();
+    }
+
+    const size_t capacity;
+    std::unique_ptr<Slot[]> slots;
+    size_t head = 0;
+    size_t tail = 0;
+    size_t filled = 0;
+    bool closed = false;
+    bool cancelled = false;
+    std::mutex mutex;
+    std::condition_variable cv_free;
+    std::condition_variable cv_filled;
+};
+
+/**
+ * @brief BCF traversal that can run the decoding (BGZF inflate by an htslib
+ *        thread pool, record unpacking and GT extraction) in a separate stage
+ *        from the record handling, both connected through a BcfRecordRing
+ */
+class PipelinedBcfTraversal : public BcfTraversal {
+public:
+    virtual void traverse_pipelined_no_destroy(const std::string& filename, size_t decode_threads, size_t ring_size) {
+        htsFile *fp = hts_open(filename.c_str(), "r");
+        if (!fp) {
+            std::cerr << "Failed to open file : " << filename << std::endl;
+            throw "Failed to open file";
+        }
+        htsThreadPool thread_pool = {NULL, 0};
+        if (decode_threads) {
+            thread_pool.pool = hts_tpool_init(decode_threads);
+            if (!thread_pool.pool) {
+                std::cerr << "Failed to create the htslib thread pool, decompressing on the decode thread" << std::endl;
+            } else {
+                hts_set_thread_pool(fp, &thread_pool);
+            }
+        }
+        pipeline_hdr = bcf_hdr_read(fp);
+        if (!pipeline_hdr) {
+            std::cerr << "Failed to read header of file : " << filename << std::endl;
+            hts_close(fp);
+            throw "Failed to read header";
+        }
+
+        auto close_file = [&]() {
+            bcf_hdr_destroy(pipeline_hdr);
+            pipeline_hdr = NULL;
+            hts_close(fp);
+            if (thread_pool.pool) {
+                hts_tpool_destroy(thread_pool.pool);
+            }
+        };
+
+        bcf_fri.filename = filename;
+        bcf_fri.n_samples = bcf_hdr_nsamples(pipeline_hdr);
+        bcf_fri.line_num = 0;
+        try {
+            handle_bcf_file_reader();
+        } catch (...) {
+            close_file();
+            throw;
+        }
+
+        BcfRecordRing ring(ring_size);
+        bool decode_error = false;
+
+        /* Decoding stage */
+        std::thread decoder([&]{
+            while (auto slot = ring.acquire_free()) {
+                int ret = bcf_read(fp, pipeline_hdr, slot->line);
+                if (ret < 0) {
+                    decode_error = (ret < -1);
+                    break;
+                }
+                bcf_unpack(slot->line, BCF_UN_ALL);
+                slot->ngt = bcf_get_genotypes(pipeline_hdr, slot->line, &(slot->gt_arr), &(slot->size_gt_arr));
+                ring.publish();
+            }
+            ring.close();
+        });
+
+        /* Processing stage */
+        BcfRecordRing::Slot *slot = NULL;
+        /* The ring owns the records and arrays */
+        auto return_slot = [&]() {
+            /* The handler may have swapped the GT array with its own */
+            slot->gt_arr = bcf_fri.gt_arr;
+            slot->size_gt_arr = bcf_fri.size_gt_arr;
+            bcf_fri.line = NULL;
+            bcf_fri.gt_arr = NULL;
+            bcf_fri.size_gt_arr = 0;
+        };
+        try {
+            while ((slot = ring.acquire_filled())) {
+                bcf_fri.line = slot->line;
+                bcf_fri.gt_arr = slot->gt_arr;
+                bcf_fri.size_gt_arr = slot->size_gt_arr;
+                bcf_fri.line_num++;
+                line_max_ploidy = bcf_fri.n_samples ? slot->ngt / bcf_fri.n_samples : 0;
+                handle_bcf_line();
+                return_slot();
+                ring.release();
+            }
+        } catch (...) {
+            /* The decoding stage is stopped before the ring and the file are freed */
+            if (bcf_fri.line) {
+                return_slot();
+            }
+            ring.cancel();
+            decoder.join();
+            close_file();
+            throw;
+        }
+        decoder.join();
+
+        producer_stats = ring.producer_stats;
+        consumer_stats = ring.consumer_stats;
+
+        close_file();
+
+        if (decode_error) {
+            std::cerr << "Error while reading file : " << filename << std::endl;
+            throw "Failed to read record";
+        }
+    }
+
+    void show_pipeline_info() const {
+        std::cout << "Decode stage stalled " << producer_stats.stalls << " times on a full ring for "
+                  << producer_stats.stalled_seconds << " s (waiting on record handling)" << std::endl;
+        std::cout << "Handling stage stalled " << consumer_stats.stalls << " times on an empty ring for "
+                  << consumer_stats.stalled_seconds << " s (waiting on decoding)" << std::endl;
+    }
+
+protected:
+    /* Header of the file being traversed, valid in the handlers for both traversals */
+    bcf_hdr_t *get_header() const {
+        return pipeline_hdr ? pipeline_hdr : bcf_fri.sr->readers[0].header;
+    }
+
+    bcf_hdr_t *pipeline_hdr = NULL;
+    BcfRecordRing::StageStatistics producer_stats;
+    BcfRecordRing::StageStatistics consumer_stats;
+};
+
+#endif /* __BCF_PIPELINE_HPP__ */
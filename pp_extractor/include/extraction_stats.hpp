@@ -0,0 +1,216 @@
+#ifndef __EXTRACTION_STATS_HPP__
+#define __EXTRACTION_STATS_HPP__
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "hts.h"
+#include "vcf.h"
+
+/* Number of records of a BCF from its index (sum of the records of the contigs), -1 if it is not indexed */
+inline int64_t count_indexed_records(const std::string& filename) {
+    htsFile *fp = hts_open(filename.c_str(), "r");
+    if (!fp) {
+        return -1;
+    }
+    bcf_hdr_t *hdr = bcf_hdr_read(fp);
+    hts_idx_t *idx = hdr ? bcf_index_load(filename.c_str()) : NULL;
+    int64_t n_records = -1;
+    if (idx) {
+        n_records = 0;
+        for (int rid = 0; rid < hdr->n[BCF_DT_CTG]; ++rid) {
+            uint64_t mapped = 0;
+            uint64_t unmapped = 0;
+            if (hts_idx_get_stat(idx, rid, &mapped, &unmapped) == 0) {
+                n_records += mapped;
+            }
+        }
+        hts_idx_destroy(idx);
+    }
+    if (hdr) {
+        bcf_hdr_destroy(hdr);
+    }
+    hts_close(fp);
+    return n_records;
+}
+
+/**
+ * @brief Cumulative time of the stages of an extraction and its counters,
+ *        reported as JSON at the end and periodically to a status file. The
+ *        time is only measured when enabled, otherwise the stages only test
+ *        the enabled flag.
+ */
+class ExtractionStats {
+public:
+    enum Stage { DECODE, PP, EXTRACT, FINALIZE, WRITE, N_STAGES };
+    /* Decode is the time between the records (reading, inflating and unpacking them, or waiting on the pipeline) */
+    static constexpr const char* STAGE_NAMES[N_STAGES] = {"decode", "pp", "extract", "finalize", "write"};
+    static constexpr double DEFAULT_STATUS_INTERVAL = 10.0;
+    /* The clock is read for the status file every this many records */
+    static constexpr size_t STATUS_CHECK_RECORDS = 1024;
+
+    using clock = std::chrono::steady_clock;
+
+    /* Counters of the extraction, filled by the extractor when reporting, the per sample ones only if counted */
+    class Counters {
+    public:
+        bool per_sample = true;
+        size_t records = 0;
+        size_t genotypes = 0;
+        size_t het_sites = 0;
+        size_t low_pp_sites = 0;
+        size_t kept = 0;
+        size_t kept_with_pred = 0;
+    };
+
+    /* Adds the time from its creation to the stage when it goes out of scope */
+    class ScopedTimer {
+    public:
+        ScopedTimer(ExtractionStats& stats, const Stage stage) : stats(stats), stage(stage) {
+            if (stats.enabled) {
+                start = clock::now();
+            }
+        }
+        ~ScopedTimer() {
+            if (stats.enabled) {
+                stats.add(stage, start, clock::now());
+            }
+        }
+
+    protected:
+        ExtractionStats& stats;
+        const Stage stage;
+        clock::time_point start;
+    };
+
+    /* Starts measuring, the status file (if any) is rewritten every status_interval seconds */
+    void enable(const std::string& status_filename = "", const double status_interval = DEFAULT_STATUS_INTERVAL) {
+        enabled = true;
+        this->status_filename = status_filename;
+        this->status_interval = status_interval;
+        begin = clock::now();
+        last_status = begin;
+        last_record_end = begin;
+    }
+
+    /* Records expected in the input (e.g., from count_indexed_records()), for the ETA, -1 if unknown */
+    void set_expected_records(const int64_t n) {
+        expected_records = n;
+    }
+
+    void add(const Stage stage, const clock::time_point from, const clock::time_point to) {
+        seconds[stage] += std::chrono::duration<double>(to - from).count();
+    }
+
+    /* Called at the beginning and end of each record, the time in between records is decoding */
+    clock::time_point begin_record() {
+        const auto now = clock::now();
+        add(DECODE, last_record_end, now);
+        return now;
+    }
+
+    void end_record(const clock::time_point now) {
+        last_record_end = now;
+    }
+
+    /* True when the status file should be written, checked every STATUS_CHECK_RECORDS records */
+    bool status_due() {
+        if (status_filename.empty() || ++records_since_check < STATUS_CHECK_RECORDS) {
+            return false;
+        }
+        records_since_check = 0;
+        const auto now = clock::now();
+        if (std::chrono::duration<double>(now - last_status).count() < status_interval) {
+            return false;
+        }
+        last_status = now;
+        return true;
+    }
+
+    std::string to_json(const Counters& c, const bool done) const {
+        const double elapsed = std::chrono::duration<double>(clock::now() - begin).count();
+        const double records_per_s = elapsed > 0 ? c.records / elapsed : 0;
+        std::ostringstream oss;
+        oss << "{\n";
+        oss << "  \"status\": \"" << (done ? "done" : "running") << "\",\n";
+        oss << "  \"elapsed_s\": " << number(elapsed) << ",\n";
+        oss << "  \"records\": " << c.records << ",\n";
+        oss << "  \"expected_records\": " << (expected_records < 0 ? "null" : std::to_string(expected_records)) << ",\n";
+        if (expected_records > 0 && !done) {
+            const double remaining = std::max(0.0, double(expected_records) - double(c.records));
+            oss << "  \"progress\": " << number(std::min(1.0, double(c.records) / expected_records)) << ",\n";
+            oss << "  \"eta_s\": " << (records_per_s > 0 ? number(remaining / records_per_s) : "null") << ",\n";
+        } else {
+            oss << "  \"progress\": " << (done ? "1" : "null") << ",\n";
+            oss << "  \"eta_s\": " << (done ? "0" : "null") << ",\n";
+        }
+        oss << "  \"records_per_s\": " << number(records_per_s) << ",\n";
+        oss << "  \"genotypes_per_s\": " << number(elapsed > 0 ? c.genotypes / elapsed : 0) << ",\n";
+        if (c.per_sample) {
+            oss << "  \"het_sites\": " << c.het_sites << ",\n";
+            oss << "  \"low_pp_het_sites\": " << c.low_pp_sites << ",\n";
+            oss << "  \"kept\": " << c.kept << ",\n";
+            oss << "  \"kept_with_predicate\": " << c.kept_with_pred << ",\n";
+            oss << "  \"keep_rate\": " << number(c.het_sites ? double(c.kept) / c.het_sites : 0) << ",\n";
+        } else {
+            // Being updated by the worker threads
+            oss << "  \"het_sites\": null,\n  \"low_pp_het_sites\": null,\n  \"kept\": null,\n  \"kept_with_predicate\": null,\n  \"keep_rate\": null,\n";
+        }
+        oss << "  \"stages_s\": {";
+        for (size_t s = 0; s < N_STAGES; ++s) {
+            oss << (s ? ", " : "") << "\"" << STAGE_NAMES[s] << "\": " << number(seconds[s]);
+        }
+        oss << "}\n}\n";
+        return oss.str();
+    }
+
+    /* Writes the JSON to a temporary file renamed over the file, so that readers never see a partial file */
+    void write_json(const std::string& filename, const Counters& c, const bool done) const {
+        const std::string tmp_filename = filename + ".tmp";
+        {
+            std::ofstream ofs(tmp_filename);
+            if (!ofs.is_open()) {
+                std::cerr << "Cannot open file " << tmp_filename << std::endl;
+                return;
+            }
+            ofs << to_json(c, done);
+        }
+        if (std::rename(tmp_filename.c_str(), filename.c_str())) {
+            std::cerr << "Cannot write file " << filename << std::endl;
+        }
+    }
+
+    const std::string& get_status_filename() const {
+        return status_filename;
+    }
+
+    bool enabled = false;
+
+protected:
+    static std::string number(const double v) {
+        if (!std::isfinite(v)) {
+            return "null";
+        }
+        std::ostringstream oss;
+        oss << v;
+        return oss.str();
+    }
+
+    double seconds[N_STAGES] = {};
+    clock::time_point begin;
+    clock::time_point last_record_end;
+    clock::time_point last_status;
+    std::string status_filename;
+    double status_interval = DEFAULT_STATUS_INTERVAL;
+    size_t records_since_check = 0;
+    int64_t expected_records = -1;
+};
+
+#endif /* __EXTRACTION_STATS_HPP__ */
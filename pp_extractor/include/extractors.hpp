@@ -1,18 +1,53 @@
 #ifndef __EXTRACTORS_HPP__
 #define __EXTRACTORS_HPP__
 
+#include <algorithm>
 #include <cmath>
+#include <memory>
 
 #include "vcf.h"
 #include "hts.h"
 #include "synced_bcf_reader.h"
 #include "bcf_traversal.hpp"
+#include "bcf_pipeline.hpp"
 #include "het_info.hpp"
 #include "var_info.hpp"
+#include "var_line_index.hpp"
 #include "fs.hpp"
+#include "shard_workers.hpp"
+#include "het_scan.hpp"
+#include "fifo.hpp"
+#include "het_tile.hpp"
+#include "spill.hpp"
+#include "het_info_writer.hpp"
+#include "region_chunks.hpp"
+#include "selection.hpp"
+#include "xsi_input.hpp"
+#include "region_fingerprints.hpp"
+#include "het_info_loader.hpp"
+#include "extraction_stats.hpp"
 
 constexpr size_t PLOIDY_2 = 2;
 
+/* Storage of the FIFO ring for HetInfo, one array per field */
+template <size_t CAPACITY>
+class FifoStorage<HetInfo, CAPACITY> {
+public:
+    HetInfo get(const size_t slot) const { return HetInfo(vcf_line[slot], a0[slot], a1[slot], pp[slot]); }
+    void set(const size_t slot, const HetInfo& item) {
+        vcf_line[slot] = item.vcf_line;
+        a0[slot] = item.a0;
+        a1[slot] = item.a1;
+        pp[slot] = item.pp;
+    }
+
+protected:
+    int vcf_line[CAPACITY];
+    int a0[CAPACITY];
+    int a1[CAPACITY];
+    float pp[CAPACITY];
+};
+
 class PPPred {
 public:
     PPPred(float pp_threshold) : pp_threshold(pp_threshold) {}
@@ -52,11 +87,103 @@ public:
     size_t line_num = 0;
     std::unordered_map<std::string, size_t> id_line_map;
 };
-class PPExtractTraversal : public BcfTraversal {
+
+/* Information of a VCF/BCF record required to extract the het sites of the samples */
+class ExtractRecordInfo {
+public:
+    size_t line_counter = 0;
+    uint64_t position = 0;
+    int AC = 0;
+    float synthetic_pp = 0.0;
+    bool has_pp = false;
+    bool non_snp = false;
+    SelectionRecord selection;
+};
+
+/* Fields of a record decoded once and shared by the extraction and its
+ * configurations, which only differ by their thresholds */
+class DecodedRecord {
+public:
+    const int *gt_arr = NULL;
+    const float *pp_values = NULL;
+    bool has_pp = false;
+    bool non_snp = false;
+    int AC = 0;
+    int AN = 0;
+    bool has_af = false;
+    float AF = 0.0;
+    /* Het samples of the record and the threshold of their low PP flags (NULL if scanned by the worker threads) */
+    const HetScanner *scanner = NULL;
+    float scan_pp_threshold = 0.0;
+};
+
+/* Decoded record handed from the reader to the extraction workers, the GT and
+ * PP arrays are swapped with the ones of the reader (htslib reallocates them
+ * as needed) so that no copy of the per sample data is made */
+class ExtractRecord {
+public:
+    ExtractRecord() {}
+    ExtractRecord(const ExtractRecord&) = delete;
+    ExtractRecord& operator=(const ExtractRecord&) = delete;
+    ~ExtractRecord() {
+        if (gt_arr) {
+            free(gt_arr);
+            gt_arr = NULL;
+        }
+        if (pp_arr) {
+            free(pp_arr);
+            pp_arr = NULL;
+        }
+    }
+
+    ExtractRecordInfo info;
+    int *gt_arr = NULL;
+    int gt_arr_size = 0;
+    float *pp_arr = NULL;
+    int pp_arr_size = 0;
+};
+
+/* PP source of the extraction kernels : The FORMAT/PP field of each sample */
+class FormatPPSource {
+public:
+    FormatPPSource(const float *pp_arr, const HetScanner& scanner) : pp_arr(pp_arr), low_pp_flags(scanner.low_pp.data()) {}
+
+    float pp(const size_t sample) const { return pp_arr[sample]; }
+    bool low_pp(const size_t het) const { return low_pp_flags[het]; }
+
+protected:
+    const float *pp_arr;
+    const uint8_t *low_pp_flags;
+};
+
+/* PP source of the extraction kernels : Same PP for all the samples of the record (synthetic or none) */
+class RecordPPSource {
 public:
-    PPExtractTraversal(size_t start_id, size_t stop_id, size_t fifo_size, bool pp_from_maf, bool pp_from_af) :
+    RecordPPSource(const float record_pp, const bool record_low_pp) : record_pp(record_pp), record_low_pp(record_low_pp) {}
+
+    float pp(const size_t) const { return record_pp; }
+    bool low_pp(const size_t) const { return record_low_pp; }
+
+protected:
+    const float record_pp;
+    const bool record_low_pp;
+};
+
+/* Het site of the first or last ones of a sample in a region chunk, if it is kept and if it satisfies the predicate */
+class BoundaryHet {
+public:
+    HetInfo hi;
+    bool kept = false;
+    bool pred = false;
+};
+
+class PPExtractTraversal : public PipelinedBcfTraversal {
+public:
+    static constexpr float DEFAULT_PP_THRESHOLD = 0.99;
+
+    PPExtractTraversal(size_t start_id, size_t stop_id, size_t fifo_size, bool pp_from_maf, bool pp_from_af, float pp_threshold = DEFAULT_PP_THRESHOLD) :
         FIFO_SIZE(fifo_size),
-        PP_THRESHOLD(0.99),
+        PP_THRESHOLD(pp_threshold),
         MAF_THRESHOLD(0.001),
         pp_arr(NULL),
         pp_arr_size(0),
@@ -64,13 +191,16 @@ public:
         stop_id(stop_id),
         line_counter(0),
         print_counter(0),
+        records_handled(0),
         pred(PP_THRESHOLD),
         progress(0),
         pp_from_maf(pp_from_maf),
         pp_from_af(pp_from_af),
         extract_acan(pp_from_maf), // MAF requires AC/AN
         line_counter_from_map(false),
-        search_line_value(false) {
+        search_line_value(false),
+        n_threads(1),
+        current_batch(0) {
         if (pp_from_maf) {
             std::cout << "The PP score will be generated from MAF" << std::endl;
         }
@@ -95,7 +225,76 @@ public:
         */
     }
 
+    /* Look-up the VCF line of the records in a variant line index (see var_line_index),
+     * for all records or only the first one (the next ones are contiguous) */
+    void use_line_index(const std::string& index_filename, const bool all_records) {
+        std::cout << "Using the variant line index " << index_filename << std::endl;
+        line_index = std::make_unique<VarLineIndex>(index_filename);
+        line_index_all_records = all_records;
+        line_index_found = false;
+    }
+
+    /**
+     * @brief Adds an extraction with other FIFO size and thresholds that gets
+     *        the same records (decoded once), with the same samples, PP mode
+     *        and VCF lines as this one. The other settings are set on the
+     *        returned extraction. Single threaded extraction (-t 1) only.
+     */
+    PPExtractTraversal& add_configuration(const size_t fifo_size, const float pp_threshold, const float maf_threshold) {
+        configurations.push_back(std::make_unique<PPExtractTraversal>(start_id, stop_id, fifo_size, false, false, pp_threshold));
+        auto& c = *configurations.back();
+        c.pp_from_maf = pp_from_maf;
+        c.pp_from_af = pp_from_af;
+        c.extract_acan = extract_acan;
+        c.MAF_THRESHOLD = maf_threshold;
+        c.selection = selection;
+        c.shared_selection = true;
+        c.keep_distance = keep_distance;
+        c.drop_isolated = drop_isolated;
+        c.set_quiet(true);
+        return c;
+    }
+
+    size_t num_configurations() const {
+        return configurations.size();
+    }
+
+    PPExtractTraversal& get_configuration(const size_t i) {
+        return *configurations[i];
+    }
+
     virtual void handle_bcf_file_reader() override {
+        if (!samples_file.empty()) {
+            subset_samples(get_header());
+        }
+        // Names of the decoded samples for the sample table of the output (the XSI variant BCF may have none)
+        if (pipeline_hdr || bcf_fri.sr) {
+            bcf_hdr_t *hdr = get_header();
+            if (size_t(bcf_hdr_nsamples(hdr)) == bcf_fri.n_samples) {
+                sample_names.clear();
+                for (int i = 0; i < bcf_hdr_nsamples(hdr); ++i) {
+                    sample_names.push_back(hdr->samples[i]);
+                }
+            }
+        }
+
+        // Configurations and region chunks share the selection of the extraction they come from
+        if (selection && !shared_selection) {
+            if (sample_names.size() == bcf_fri.n_samples) {
+                selection->set_samples(sample_names);
+            } else {
+                selection->set_header(get_header());
+            }
+        }
+
+        for (auto& c : configurations) {
+            c->bcf_fri.n_samples = bcf_fri.n_samples;
+            c->sample_ids = sample_ids;
+            c->sample_names = sample_names;
+            c->pp_in_place = pp_in_place;
+            c->handle_bcf_file_reader();
+        }
+
         number_of_het_sites.clear();
         number_of_low_pp_sites.clear();
         number_of_non_snp.clear();
@@ -114,79 +313,169 @@ public:
         if (stop_id < start_id) {
             stop_id = start_id;
         }
-        std::cout << "Start ID : " << start_id << " Stop ID : " << stop_id << std::endl;
-        fifos.resize(stop_id-start_id, GenericKeepFifo<HetInfo, PPPred>(FIFO_SIZE, PPPred(PP_THRESHOLD)));
+        if (!quiet) {
+            std::cout << "Start ID : " << start_id << " Stop ID : " << stop_id << std::endl;
+        }
+        fifos.resize(stop_id-start_id, GenericKeepFifo<HetInfo, PPPred>(FIFO_SIZE, PPPred(PP_THRESHOLD), keep_distance, drop_isolated));
+
+        if (n_threads > 1) {
+            /* Don't have more threads than samples */
+            const size_t n_shards = std::max(size_t(1), std::min(n_threads, stop_id-start_id));
+            /* Limit the memory held by the records in flight, a record holds the GT and PP of all samples */
+            const size_t record_bytes = bcf_fri.n_samples * (PLOIDY_2 * sizeof(int) + sizeof(float)) + 1;
+            const size_t capacity = std::clamp(BATCH_BYTES / record_bytes, size_t(1), MAX_BATCH_RECORDS);
+            for (auto& b : batches) {
+                b.records = std::make_unique<ExtractRecord[]>(capacity);
+                b.capacity = capacity;
+                b.size = 0;
+            }
+            current_batch = 0;
+            workers = std::make_unique<ShardWorkers>(n_shards);
+            scanners.resize(n_shards);
+            std::cout << "Extracting with " << n_shards << " threads, batches of " << capacity << " records" << std::endl;
+        } else {
+            scanners.resize(1);
+        }
+        if (!quiet) {
+            std::cout << "Het scan kernel : " << het_scan::isa_name(scanners.front().isa) << std::endl;
+        }
+
+        tiles.clear();
+        if (tile_records) {
+            /* One tile per sample range (shard) */
+            tiles.reserve(scanners.size());
+            for (size_t shard = 0; shard < scanners.size(); ++shard) {
+                tiles.emplace_back(tile_records, tile_samples, shard_begin(shard, scanners.size()), shard_begin(shard+1, scanners.size()));
+            }
+            if (!quiet) {
+                std::cout << "Transposing tiles of " << tile_records << " records by blocks of " << tile_samples << " samples" << std::endl;
+            }
+        }
+
+        boundary_heads.clear();
+        if (record_boundaries) {
+            boundary_heads.resize(fifos.size() * (FIFO_SIZE / 2));
+        }
+
+        spiller.reset();
+        spilled_pred = 0;
+        records_since_spill_check = 0;
+        if (max_memory) {
+            /* The kept het infos can use what the per sample state and records in flight leave, the FIFOs larger
+             * than their inline ring and the ones with a distance also allocate their ring and positions */
+            const size_t fifo_memory = fifos.empty() ? 0 : sizeof(fifos.front()) + fifos.front().get_heap_memory();
+            size_t fixed_memory = fifos.size() * fifo_memory + bcf_fri.n_samples * 4 * sizeof(uint32_t);
+            if (workers) {
+                fixed_memory += 2 * batches[0].capacity * bcf_fri.n_samples * (PLOIDY_2 * sizeof(int) + sizeof(float));
+            }
+            if (fixed_memory >= max_memory) {
+                std::cerr << "Warning the memory limit is below the " << fixed_memory / (1024*1024)
+                          << " MB required for the samples, will spill as often as possible" << std::endl;
+                kept_memory_limit = 0;
+            } else {
+                kept_memory_limit = max_memory - fixed_memory;
+            }
+            std::cout << "Kept het infos will be spilled to disk above " << kept_memory_limit / (1024*1024) << " MB" << std::endl;
+        }
+
+        if (stats.enabled) {
+            // Opening the file is not decoding of the first record
+            stats.end_record(ExtractionStats::clock::now());
+        }
     }
 
     virtual void handle_bcf_line() override {
+        const auto record_begin = stats.enabled ? stats.begin_record() : ExtractionStats::clock::time_point();
         auto line = bcf_fri.line;
-        auto header = bcf_fri.sr->readers[0].header;
+        auto header = get_header();
 
         bool has_pp = false;
-        int res = bcf_get_format_float(header, line, "PP", &pp_arr, &pp_arr_size);
-        // There are PP values
-        if (res > 0) {
-            has_pp = true;
+        int res = 0;
+        const float *pp_values = pp_arr;
+        if (pp_in_place) {
+            // Only the PP of the het samples are read, the values are not copied
+            pp_values = get_format_pp_in_place(header, line);
+            has_pp = (pp_values != NULL);
+        } else {
+            res = bcf_get_format_float(header, line, "PP", &pp_arr, &pp_arr_size);
+            pp_values = pp_arr;
+            // There are PP values
+            if (res > 0) {
+                has_pp = true;
+            }
         }
 
-        bool non_snp = false;
+        const auto pp_end = stats.enabled ? ExtractionStats::clock::now() : record_begin;
+        if (stats.enabled) {
+            stats.add(ExtractionStats::PP, record_begin, pp_end);
+        }
+
+        DecodedRecord decoded;
+        decoded.gt_arr = bcf_fri.gt_arr;
+        decoded.pp_values = pp_values;
+        decoded.has_pp = has_pp;
         if (strlen(line->d.allele[0]) > 1 || strlen(line->d.allele[1]) > 1) {
-            non_snp = true;
+            decoded.non_snp = true;
         }
 
         // We need AC (Allele Count) and AN (Allele Number) for PP from MAF
-        int AC = 0;
         int* pAC = NULL;
         int nAC = 0;
-        int AN = 0;
         int* pAN = NULL;
         int nAN = 0;
-        float AF = 0.0;
         float* pAF = NULL;
         int nAF = 0;
-        float synthetic_pp = 0.0;
+
+        const bool count_ac = extract_acan && (bcf_get_info_int32(header, line, "AC", &pAC, &nAC) < 0);
+
+        if (!workers) {
+            if (carriers) {
+                // Sparse record of an XSI file, only its carriers are scanned
+                scanners.front().scan_listed(bcf_fri.gt_arr, has_pp ? pp_values : NULL, *carriers, start_id, stop_id, PP_THRESHOLD, count_ac);
+            } else {
+                // Single pass over the GT/PP arrays, also counts the alt alleles if AC is not in the VCF
+                scanners.front().scan(bcf_fri.gt_arr, has_pp ? pp_values : NULL, start_id, stop_id, PP_THRESHOLD, count_ac);
+            }
+            decoded.scanner = &scanners.front();
+            decoded.scan_pp_threshold = PP_THRESHOLD;
+        }
 
         if (extract_acan) {
-            res = bcf_get_info_int32(header, line, "AC", &pAC, &nAC);
             // If not in the VCF then compute it
-            if (res < 0) {
-                for (size_t i = start_id; i < stop_id; ++i) {
-                    if (bcf_gt_allele(bcf_fri.gt_arr[i*PLOIDY_2]) == 1) {
-                        AC++;
-                    }
-                    if (bcf_gt_allele(bcf_fri.gt_arr[i*PLOIDY_2+1]) == 1) {
-                        AC++;
-                    }
-                }
+            if (count_ac) {
+                decoded.AC = workers ? scanners.front().count_alt_alleles(bcf_fri.gt_arr, start_id, stop_id) :
+                                       scanners.front().alt_count;
             } else {
-                AC = *pAC;
+                decoded.AC = *pAC;
             }
             // If not in the VCF then compute it
             res = bcf_get_info_int32(header, line, "AN", &pAN, &nAN);
             if (res < 0) {
-                AN = (stop_id - start_id) * PLOIDY_2;
+                decoded.AN = (stop_id - start_id) * PLOIDY_2;
             } else {
-                AN = *pAN;
+                decoded.AN = *pAN;
             }
-            float maf = float(AC)/AN;
-            synthetic_pp = (maf > MAF_THRESHOLD) ? NAN : 0.5 + maf / 2.0;
-            //std::cout << "AC : " << AC << "\tAN : " << AN << "\tsynth PP " << synthetic_pp << std::endl;
         }
 
         if (pp_from_af) {
             res = bcf_get_info_float(header, line, "AF", &pAF, &nAF);
             if (res < 0) {
                 std::cerr << "Could not get AF info field ! PP set to NaN" << std::endl;
-                synthetic_pp = NAN;
             } else {
-                AF = *pAF;
-                if (AF > 0.5) {
-                    // Complement to get the minor allele frequency
-                    AF = 1.0 - AF;
-                }
-                synthetic_pp = (AF > MAF_THRESHOLD) ? NAN : 0.5 + AF / 2.0;
-                //std::cout << "AF: " << AF << " Synth PP : " << synthetic_pp << std::endl;
+                decoded.has_af = true;
+                decoded.AF = *pAF;
+            }
+        }
+
+        // This is for split VCF/BCFs
+        if (line_index && (line_index_all_records || !line_index_found)) {
+            const int64_t line_in_index = line_index->find(header, line);
+            if (line_in_index < 0) {
+                std::cerr << "Could not find VCF record in variant line index " << line_index->filename << std::endl;
+                throw "vcf line counter error";
             }
+            line_counter = line_in_index;
+            line_index_found = true;
         }
 
         // This is for split VCF/BCFs
@@ -216,53 +505,47 @@ public:
             }
         }
 
-        // Extract heterozygous sites and PP
-        for (size_t i = start_id; i < stop_id; ++i) {
-            int encoded_a0 = bcf_fri.gt_arr[i*PLOIDY_2];
-            int encoded_a1 = bcf_fri.gt_arr[i*PLOIDY_2+1];
-            int a0 = bcf_gt_allele(encoded_a0);
-            int a1 = bcf_gt_allele(encoded_a1);
-
-            if (a0 != a1) {
-                number_of_het_sites[i]++;
-                float pp = NAN; // Assume perfect phasing if there is no PP field
-                if (has_pp) {
-                    pp = pp_arr[i];
-                } else if (pp_from_maf || pp_from_af) {
-                    pp = synthetic_pp;
-                }
-
-                if (AC == 1 && pp >= PP_THRESHOLD) {
-                    /* Edge case for old version of SHAPEIT5 that would score
-                       singletons phased with only one of their parents with
-                       a PP of 1.0, In about 95% of cases the singleton comes
-                       from the other parent if not observed in the known parent
-                       but it could also be a de novo mutation on the known
-                       parent haplotype, these cases should not be scored 1.0 */
-                       pp = 0.97; /* arbitrary value */
-                }
-
-                HetInfo hi(line_counter, encoded_a0, encoded_a1, pp);
-
-                if (pred(hi)) {
-                    number_of_low_pp_sites[i]++;
-                    if (!non_snp) {
-                        number_of_snp_low_pp_sites[i]++;
-                    }
-                }
-                if (non_snp) {
-                    number_of_non_snp[i]++;
-                }
+        ExtractRecordInfo info;
+        info.line_counter = line_counter;
+        info.position = GenericKeepFifo<HetInfo, PPPred>::position(line->rid, line->pos);
+        info.AC = decoded.AC;
+        info.synthetic_pp = get_synthetic_pp(decoded);
+        info.has_pp = has_pp;
+        info.non_snp = decoded.non_snp;
+        if (selection) {
+            selection->begin_record(header, line, bcf_fri.gt_arr, bcf_fri.n_samples, info.selection, carriers);
+        }
 
-                fifos[i-start_id].insert(hi);
+        if (workers) {
+            // Hand the decoded record over to the worker threads
+            auto& batch = batches[current_batch];
+            auto& record = batch.records[batch.size++];
+            record.info = info;
+            std::swap(record.gt_arr, bcf_fri.gt_arr);
+            std::swap(record.gt_arr_size, bcf_fri.size_gt_arr);
+            std::swap(record.pp_arr, pp_arr);
+            std::swap(record.pp_arr_size, pp_arr_size);
+            if (batch.size == batch.capacity) {
+                dispatch_batch();
             }
+        } else {
+            extract_scanned(info, bcf_fri.gt_arr, pp_values, scanners.front(), tiles.empty() ? NULL : &tiles.front());
+        }
+
+        if (fingerprints) {
+            fingerprints->add_record(header, line, info.line_counter);
         }
 
         line_counter++;
+        records_handled++;
+        if (max_memory && !workers && ++records_since_spill_check == SPILL_CHECK_RECORDS) {
+            records_since_spill_check = 0;
+            spill_if_above_limit();
+        }
         if (progress) {
             if (++print_counter == progress) {
                 print_counter = 0;
-                printf("\033[A\033[2K");
+                std::cout << "\033[A\033[2K";
                 std::cout << "Handled " << bcf_fri.line_num << " VCF entries (lines)" << std::endl;
             }
         }
@@ -280,6 +563,142 @@ public:
             free(pAF);
             pAF = NULL;
         }
+
+        // The other configurations extract the same decoded record, at the same VCF line
+        for (auto& c : configurations) {
+            c->extract_decoded(decoded, info);
+        }
+
+        if (stats.enabled) {
+            const auto record_end = ExtractionStats::clock::now();
+            stats.add(ExtractionStats::EXTRACT, pp_end, record_end);
+            stats.end_record(record_end);
+            if (stats.status_due()) {
+                stats.write_json(stats.get_status_filename(), stats_counters(), false);
+            }
+        }
+    }
+
+    /* PP of all the samples of the record from its MAF (AC/AN or AF) given the MAF threshold, 0 if not used */
+    float get_synthetic_pp(const DecodedRecord& decoded) const {
+        float synthetic_pp = 0.0;
+        if (extract_acan) {
+            float maf = float(decoded.AC)/decoded.AN;
+            synthetic_pp = (maf > MAF_THRESHOLD) ? NAN : 0.5 + maf / 2.0;
+        }
+        if (pp_from_af) {
+            if (!decoded.has_af) {
+                synthetic_pp = NAN;
+            } else {
+                float AF = decoded.AF;
+                if (AF > 0.5) {
+                    // Complement to get the minor allele frequency
+                    AF = 1.0 - AF;
+                }
+                synthetic_pp = (AF > MAF_THRESHOLD) ? NAN : 0.5 + AF / 2.0;
+            }
+        }
+        return synthetic_pp;
+    }
+
+    /* Extracts a record decoded by the extraction this configuration was added to (see add_configuration),
+     * the het samples are the ones it scanned, only the thresholds of this configuration are applied */
+    void extract_decoded(const DecodedRecord& decoded, const ExtractRecordInfo& record_info) {
+        ExtractRecordInfo info = record_info;
+        info.synthetic_pp = get_synthetic_pp(decoded);
+        const HetScanner *scanner = decoded.scanner;
+        if (decoded.scan_pp_threshold != PP_THRESHOLD) {
+            scanners.front().rethreshold(*decoded.scanner, decoded.has_pp ? decoded.pp_values : NULL, PP_THRESHOLD);
+            scanner = &scanners.front();
+        }
+        extract_scanned(info, decoded.gt_arr, decoded.pp_values, *scanner, tiles.empty() ? NULL : &tiles.front());
+
+        line_counter = info.line_counter + 1;
+        records_handled++;
+        if (max_memory && ++records_since_spill_check == SPILL_CHECK_RECORDS) {
+            records_since_spill_check = 0;
+            spill_if_above_limit();
+        }
+    }
+
+    /* Extracts the current record in another extraction at the given VCF line, the record stays owned by this one */
+    void forward_record(PPExtractTraversal& other, const size_t vcf_line) {
+        other.bcf_fri.sr = bcf_fri.sr;
+        other.bcf_fri.line = bcf_fri.line;
+        other.bcf_fri.gt_arr = bcf_fri.gt_arr;
+        other.bcf_fri.size_gt_arr = bcf_fri.size_gt_arr;
+        other.bcf_fri.ngt = bcf_fri.ngt;
+        other.bcf_fri.line_num = bcf_fri.line_num;
+        other.pipeline_hdr = pipeline_hdr;
+        other.line_max_ploidy = line_max_ploidy;
+        other.line_counter = vcf_line;
+        other.handle_bcf_line();
+        other.bcf_fri.sr = NULL;
+        other.bcf_fri.line = NULL;
+        other.bcf_fri.gt_arr = NULL;
+        other.bcf_fri.size_gt_arr = 0;
+        other.pipeline_hdr = NULL;
+    }
+
+    /* Extract heterozygous sites and PP for samples [begin, end) of a record, through the tile if given */
+    void extract_samples(const ExtractRecordInfo& info, const int *gt_arr, const float *pp_arr, size_t begin, size_t end, HetScanner& scanner, HetTile *tile = NULL) {
+        scanner.scan(gt_arr, info.has_pp ? pp_arr : NULL, begin, end, PP_THRESHOLD, false);
+        extract_scanned(info, gt_arr, pp_arr, scanner, tile);
+    }
+
+    /* Extract the het sites found by the scanner, either directly in the FIFOs or buffered in the tile */
+    void extract_scanned(const ExtractRecordInfo& info, const int *gt_arr, const float *pp_arr, const HetScanner& scanner, HetTile *tile) {
+        if (tile) {
+            extract_scanned_to(info, gt_arr, pp_arr, scanner, *tile);
+            if (tile->end_record(info.position)) {
+                flush_tile(*tile);
+            }
+        } else {
+            DirectSink sink(*this, info.position);
+            extract_scanned_to(info, gt_arr, pp_arr, scanner, sink);
+        }
+    }
+
+    /* Transpose the tile and hand the het sites to the FIFOs sample by sample */
+    void flush_tile(HetTile& tile) {
+        tile.transpose([this](const size_t sample, const HetInfo *hets, const uint8_t *flags, const uint64_t *positions, const size_t n) {
+            for (size_t k = 0; k < n; ++k) {
+                add_het(sample, hets[k], flags[k] & HetTile::LOW_PP, flags[k] & HetTile::NON_SNP, positions[k]);
+            }
+        });
+    }
+
+    /* Only het samples are visited, the kernel for the mode of the record is selected once here */
+    template <typename Sink>
+    void extract_scanned_to(const ExtractRecordInfo& info, const int *gt_arr, const float *pp_arr, const HetScanner& scanner, Sink& sink) {
+        if (info.has_pp) {
+            const FormatPPSource source(pp_arr, scanner);
+            if (info.AC == 1) {
+                extract_hets_select_snp<FormatPPSource, true>(info, gt_arr, source, scanner, sink);
+            } else {
+                extract_hets_select_snp<FormatPPSource, false>(info, gt_arr, source, scanner, sink);
+            }
+        } else {
+            float pp = NAN; // Assume perfect phasing if there is no PP field
+            if (pp_from_maf || pp_from_af) {
+                pp = info.synthetic_pp;
+            }
+            if (info.AC == 1) {
+                pp = singleton_pp(pp);
+            }
+            const RecordPPSource source(pp, pred(HetInfo(0, 0, 0, pp)));
+            extract_hets_select_snp<RecordPPSource, false>(info, gt_arr, source, scanner, sink);
+        }
+    }
+
+    void set_threads(const size_t n_threads) {
+        this->n_threads = n_threads;
+    }
+
+    /* Buffer tiles of records (0 disables) transposed by blocks of samples */
+    void set_tiling(const size_t tile_records, const size_t tile_samples) {
+        this->tile_records = tile_records;
+        this->tile_samples = tile_samples;
     }
 
     void set_progress(const size_t progress) {
@@ -299,70 +718,1075 @@ public:
         extract_acan = true;
     }
 
+    /* Spill the kept het infos to a temporary directory to use less than max_memory bytes (0 disables) */
+    void set_max_memory(const size_t max_memory, const std::string& tmp_dir) {
+        this->max_memory = max_memory;
+        this->tmp_dir = tmp_dir;
+    }
+
+    /* Extract the het sites chosen by the selection instead of the ones with a low PP */
+    void set_selection(std::shared_ptr<GenotypeSelection> selection) {
+        std::cout << "Selecting het sites : " << selection->to_string() << std::endl;
+        this->selection = selection;
+    }
+
+    /* Only decode and extract the samples of the file (one name per line), the
+     * subset is given to htslib so that the other samples are not unpacked */
+    void set_samples_file(const std::string& samples_file) {
+        if (!fs::exists(samples_file)) {
+            std::cerr << "File : " << samples_file << " does not exist !" << std::endl;
+            throw "File does not exist";
+        }
+        this->samples_file = samples_file;
+    }
+
+    /**
+     * @brief Only keep the het sites of the window within max_distance bp of a
+     *        het site with a low PP (the FIFO size is the maximum number of
+     *        them), the others cannot be used to rephase it. With drop_isolated
+     *        the low PP het sites without het site within the distance are not
+     *        extracted. 0 keeps the whole window.
+     */
+    void set_keep_distance(const uint32_t max_distance, const bool drop_isolated) {
+        if (max_distance) {
+            std::cout << "Keeping het sites within " << max_distance << " bp" << (drop_isolated ? ", dropping isolated ones" : "") << std::endl;
+        }
+        keep_distance = max_distance;
+        this->drop_isolated = drop_isolated;
+    }
+
+    /**
+     * @brief Computes the fingerprints of the regions of region_size bp of the
+     *        extracted records (see RegionFingerprints), so that the output can
+     *        be updated when the VCF/BCF is regenerated (see traverse_update_no_destroy)
+     */
+    void set_fingerprints(const uint32_t region_size) {
+        fingerprints = std::make_unique<RegionFingerprints>(region_size, parameters_hash());
+    }
+
+    void write_fingerprints(const std::string& filename) const {
+        if (!fingerprints) {
+            std::cerr << "No fingerprints were computed" << std::endl;
+            throw "No fingerprints";
+        }
+        fingerprints->save(filename);
+        std::cout << "Done writing fingerprints of " << fingerprints->regions.size() << " regions to " << filename << std::endl;
+    }
+
+    /**
+     * @brief Measures the time of the stages of the extraction (see
+     *        ExtractionStats), the status is written to status_filename (if
+     *        given) every status_interval seconds, with an ETA if the number
+     *        of records is known (expected_records, -1 if not)
+     */
+    void enable_stats(const std::string& status_filename, const double status_interval, const int64_t expected_records) {
+        stats.enable(status_filename, status_interval);
+        stats.set_expected_records(expected_records);
+    }
+
+    /* Writes the stage timers, throughput and keep rates as JSON */
+    void write_stats(const std::string& filename) const {
+        stats.write_json(filename, stats_counters(), true);
+        std::cout << "Done writing statistics to " << filename << std::endl;
+    }
+
+    ExtractionStats::Counters stats_counters() const {
+        ExtractionStats::Counters counters;
+        counters.records = records_handled;
+        counters.genotypes = records_handled * (stop_id - start_id);
+        // The worker threads update the per sample counters while extracting
+        counters.per_sample = !workers;
+        if (!counters.per_sample) {
+            return counters;
+        }
+        for (size_t i = start_id; i < stop_id && i < number_of_het_sites.size(); ++i) {
+            counters.het_sites += number_of_het_sites[i];
+            counters.low_pp_sites += number_of_low_pp_sites[i];
+        }
+        counters.kept = spiller ? spiller->get_total_spilled() : 0;
+        counters.kept_with_pred = spilled_pred;
+        for (auto& f : fifos) {
+            counters.kept += f.get_kept_items_ref().size();
+            counters.kept_with_pred += f.get_number_kept_with_pred();
+        }
+        return counters;
+    }
+
+    /* Don't show the setup messages (e.g., extraction of a region chunk) */
+    void set_quiet(const bool quiet) {
+        this->quiet = quiet;
+    }
+
     void set_maf_threshold(const float maf_threhsold) {
         std::cout << "Setting MAF threshold to " << maf_threhsold << std::endl;
         MAF_THRESHOLD = maf_threhsold;
     }
 
     void finalize() {
+        ExtractionStats::ScopedTimer timer(stats, ExtractionStats::FINALIZE);
+        if (workers) {
+            // Extract the remaining records and stop the workers
+            if (batches[current_batch].size) {
+                dispatch_batch();
+            }
+            workers.reset();
+        }
+
+        // Extract the records remaining in the tiles
+        for (auto& tile : tiles) {
+            flush_tile(tile);
+        }
+
         // Finalize FIFOs
         for (auto& f : fifos) {
             f.finalize();
         }
+
+        for (auto& c : configurations) {
+            c->finalize();
+        }
     }
 
     void show_info() {
-        size_t total_kept = 0;
-        size_t total_kept_pred = 0;
+        const auto counters = stats_counters();
+        size_t total_dropped = 0;
         for (auto& f : fifos) {
-            auto kept_items = f.get_kept_items_ref();
-            total_kept += kept_items.size();
-            total_kept_pred += f.get_number_kept_with_pred();
+            total_dropped += f.get_number_dropped();
+        }
+
+        std::cout << "Extracted a total of " << counters.kept << " genotypes" << std::endl;
+        std::cout << "From which a total of " << counters.kept_with_pred << " were selected given the predicate" << std::endl;
+        if (drop_isolated) {
+            std::cout << "Dropped " << total_dropped << " isolated genotypes given the predicate" << std::endl;
         }
+    }
 
-        std::cout << "Extracted a total of " << total_kept << " genotypes" << std::endl;
-        std::cout << "From which a total of " << total_kept_pred << " were selected given the predicate" << std::endl;
+    void show_throughput(std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end) const {
+        const std::chrono::duration<double> elapsed_seconds{end - begin};
+        std::cout << "Extracted " << records_handled << " records in " << elapsed_seconds.count() << " s ("
+                  << records_handled / elapsed_seconds.count() << " records/s)" << std::endl;
     }
 
-    void write_to_file(std::string filename) {
-        std::fstream ofs(filename, std::ios_base::binary | std::ios_base::out | std::ios_base::trunc);
-        if (!ofs.is_open()) {
-            std::cerr << "Cannot open file " << filename << std::endl;
+    /* Original IDs of the extracted samples, with their names if known (see HetInfoSampleTable) */
+    std::vector<char> get_sample_table() const {
+        std::vector<uint32_t> ids;
+        std::vector<std::string> names;
+        for (size_t idx = 0; idx < stop_id-start_id; ++idx) {
+            ids.push_back(sample_id(idx));
+            if (!sample_names.empty()) {
+                names.push_back(sample_names[start_id + idx]);
+            }
         }
+        return HetInfoSampleTable::encode(ids, names);
+    }
 
-        const uint32_t endianness = 0xaabbccdd;
-        // Write endianness
-        ofs.write(reinterpret_cast<const char*>(&endianness), sizeof(uint32_t));
-        // Write number of samples
-        uint32_t num_samples = stop_id-start_id;
-        ofs.write(reinterpret_cast<const char*>(&num_samples), sizeof(uint32_t));
-        // Write offset table
-        uint64_t dummy_offset = 0xdeadc0dedeadc0de;
-        auto table_seek = ofs.tellp();
-        for (size_t i = start_id; i < stop_id; ++i) {
-            ofs.write(reinterpret_cast<const char*>(&dummy_offset), sizeof(uint64_t));
+    /* Checkpoints of the extracted het sites in memory (see HetInfoSkipIndex), not the spilled ones */
+    std::vector<char> get_skip_index(const uint32_t interval) const {
+        if (spiller) {
+            std::cerr << "The skip index cannot be computed when het sites are spilled" << std::endl;
+            throw "Skip index with spilled het sites";
+        }
+        std::vector<std::vector<uint32_t> > checkpoints(stop_id-start_id);
+        for (size_t idx = 0; idx < checkpoints.size(); ++idx) {
+            checkpoints[idx] = HetInfoSkipIndex::checkpoints_of(fifos[idx].get_kept_items_ref(), interval);
         }
+        return HetInfoSkipIndex::encode(checkpoints, interval);
+    }
 
-        // Write the data for all the samples
-        std::vector<uint64_t> offset_table(stop_id-start_id);
-        for (size_t i = start_id; i < stop_id; ++i) {
-            const size_t idx = i-start_id;
-            offset_table[idx] = ofs.tellp();
-            SampleBlock::write_to_stream(ofs, fifos[idx].get_kept_items_ref(), i);
+    /* The sample table, skip index (every skip_interval het sites) and checksums are optional */
+    void write_to_file(std::string filename, const bool with_sample_table = false, const uint32_t skip_interval = 0,
+                       const bool with_checksums = false) {
+        ExtractionStats::ScopedTimer timer(stats, ExtractionStats::WRITE);
+        // The size of all sample blocks is known, so they can be written in parallel at their final position
+        std::vector<uint64_t> block_sizes(stop_id-start_id);
+        for (size_t idx = 0; idx < block_sizes.size(); ++idx) {
+            const size_t spilled = spiller ? spiller->spilled(idx) : 0;
+            block_sizes[idx] = HetInfoFileWriter::block_size(spilled + fifos[idx].get_kept_items_ref().size());
         }
+        std::vector<char> sections = with_sample_table ? get_sample_table() : std::vector<char>();
+        if (skip_interval) {
+            const auto index = get_skip_index(skip_interval);
+            sections.insert(sections.end(), index.begin(), index.end());
+        }
+        HetInfoFileWriter writer(filename, block_sizes, HetInfoFileWriter::ENDIANNESS_MARK, sections, with_checksums);
 
-        // Rewrite the offset table
-        ofs.seekp(table_seek);
-        for (size_t i = start_id; i < stop_id; ++i) {
-            const size_t idx = i-start_id;
-            ofs.write(reinterpret_cast<const char*>(&offset_table[idx]), sizeof(decltype(offset_table.front())));
+        if (spiller) {
+            // The spilled het infos come first, then the ones still in memory, streamed from the runs in sample order
+            spiller->start_merge();
+            for (size_t idx = 0; idx < block_sizes.size(); ++idx) {
+                const auto& items = fifos[idx].get_kept_items_ref();
+                auto block = writer.open_block(idx);
+                block.write_header(sample_id(idx), spiller->spilled(idx) + items.size());
+                spiller->copy_next_sample(block);
+                block.write(reinterpret_cast<const char*>(items.data()), items.size() * sizeof(HetInfo));
+            }
+            spiller->end_merge();
+        } else {
+            writer.for_all_blocks(n_threads, [&](const size_t idx) {
+                writer.write_block(idx, sample_id(idx), fifos[idx].get_kept_items_ref());
+            });
         }
+        writer.close();
 
         std::cout << "Done writing file " << filename << std::endl;
+    }
 
-        ofs.close();
+    /* Writes the streaming layout, the sample blocks in order then the offset table, no seek needed */
+    void write_to_stream(std::ostream& os) {
+        ExtractionStats::ScopedTimer timer(stats, ExtractionStats::WRITE);
+        HetInfoStreamWriter writer(os, stop_id-start_id);
+        if (spiller) {
+            spiller->start_merge();
+        }
+        for (size_t idx = 0; idx < stop_id-start_id; ++idx) {
+            const auto& items = fifos[idx].get_kept_items_ref();
+            const size_t spilled = spiller ? spiller->spilled(idx) : 0;
+            writer.write_header(sample_id(idx), spilled + items.size());
+            if (spiller) {
+                spiller->copy_next_sample(writer);
+            }
+            writer.write(reinterpret_cast<const char*>(items.data()), items.size() * sizeof(HetInfo));
+        }
+        if (spiller) {
+            spiller->end_merge();
+        }
+        writer.close();
+    }
+
+    /* Extracts the records starting in the chunk, the file must be indexed */
+    void traverse_region(const std::string& filename, const RegionChunk& chunk) {
+        const std::string region = chunk.to_region();
+        bcf_fri.sr = bcf_sr_init();
+        bcf_fri.sr->require_index = 1;
+        if (bcf_sr_set_regions(bcf_fri.sr, region.c_str(), 0) < 0 || !bcf_sr_add_reader(bcf_fri.sr, filename.c_str())) {
+            std::cerr << "Failed to open region " << region << " of file : " << filename << std::endl;
+            destroy_bcf_file_reader(bcf_fri);
+            throw "Failed to open region";
+        }
+        bcf_fri.filename = filename;
+        bcf_fri.n_samples = bcf_hdr_nsamples(bcf_fri.sr->readers[0].header);
+        bcf_fri.line_num = 0;
+        handle_bcf_file_reader();
+
+        while (bcf_next_line(bcf_fri)) {
+            bcf1_t *line = bcf_fri.line;
+            // Records overlapping the start of the chunk belong to the previous chunk
+            if (!chunk.contains(line)) {
+                continue;
+            }
+            bcf_unpack(line, BCF_UN_STR);
+            bcf_fri.ngt = bcf_get_genotypes(bcf_fri.sr->readers[0].header, line, &(bcf_fri.gt_arr), &(bcf_fri.size_gt_arr));
+            line_max_ploidy = bcf_fri.ngt / bcf_fri.n_samples;
+            handle_bcf_line();
+        }
+        destroy_bcf_file_reader(bcf_fri);
+    }
+
+    /**
+     * @brief Extracts an XSI file (see XsiReader), the records come from the
+     *        variant BCF of the XSI file and their PP are read in place, so
+     *        that only the values of the het samples are accessed
+     */
+    void traverse_xsi_no_destroy(const std::string& filename, const std::string& variants_filename) {
+        if (n_threads > 1 || !samples_file.empty()) {
+            // The worker threads take the PP arrays of the records and the samples are those of the XSI file
+            std::cerr << "XSI files are extracted on a single thread with all their samples" << std::endl;
+            throw "XSI extraction settings";
+        }
+        XsiReader reader(filename, variants_filename);
+
+        // The handlers get the header of the variant BCF
+        pipeline_hdr = reader.get_header();
+        pp_in_place = true;
+        bcf_fri.filename = filename;
+        bcf_fri.n_samples = reader.get_n_samples();
+        // The variant BCF may have no samples, the names are the ones of the XSI file
+        sample_names = reader.get_sample_names();
+        bcf_fri.line_num = 0;
+        handle_bcf_file_reader();
+
+        while (reader.next_line(bcf_fri)) {
+            line_max_ploidy = bcf_fri.n_samples ? bcf_fri.ngt / bcf_fri.n_samples : 0;
+            // The rare records may only have the GT of their carriers
+            carriers = reader.get_carriers();
+            handle_bcf_line();
+        }
+
+        // The reader owns the header and the records
+        pipeline_hdr = NULL;
+        bcf_fri.line = NULL;
+        carriers = NULL;
+    }
+
+    /**
+     * @brief Extracts an indexed BCF by genomic chunks on n_threads threads. The
+     *        chunks are extracted independently (lines from 0) and folded in
+     *        order into this extraction, the FIFO windows crossing a chunk
+     *        boundary are completed from the first and last het sites of each
+     *        sample in the chunks, so the result is the same as traverse().
+     */
+    void traverse_regions_no_destroy(const std::string& filename, const size_t n_threads) {
+        if (keep_distance) {
+            // The windows are completed across the chunks boundaries from the number of het sites only
+            std::cerr << "The region chunks cannot be extracted with a keep distance" << std::endl;
+            throw "Keep distance with region chunks";
+        }
+        const auto chunks = plan_region_chunks(filename, REGION_CHUNKS_PER_THREAD * n_threads);
+        std::cout << "Extracting " << chunks.size() << " region chunks with " << n_threads << " threads" << std::endl;
+
+        // Samples and per sample state of the merged extraction
+        initialize_bcf_file_reader(bcf_fri, filename);
+        handle_bcf_file_reader();
+        destroy_bcf_file_reader(bcf_fri);
+        region_tails.clear();
+        region_tails.resize(fifos.size());
+
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::vector<std::unique_ptr<PPExtractTraversal> > extracted(chunks.size());
+        size_t next_chunk = 0;
+        size_t folded = 0;
+        const char *error = NULL;
+
+        auto worker = [&]() {
+            while (true) {
+                size_t c = 0;
+                {
+                    // Don't get too far ahead of the fold, the extracted chunks are held in memory
+                    std::unique_lock<std::mutex> lk(mutex);
+                    cv.wait(lk, [&]{ return error || next_chunk == chunks.size() || next_chunk < folded + 2 * n_threads; });
+                    if (error || next_chunk == chunks.size()) {
+                        return;
+                    }
+                    c = next_chunk++;
+                }
+                auto chunk = make_region_chunk();
+                const char *chunk_error = NULL;
+                try {
+                    chunk->traverse_region(filename, chunks[c]);
+                    chunk->finalize();
+                } catch (const char *e) {
+                    chunk_error = e;
+                } catch (...) {
+                    chunk_error = "Failed to extract region chunk";
+                }
+                {
+                    std::lock_guard<std::mutex> lk(mutex);
+                    if (chunk_error) {
+                        error = chunk_error;
+                    } else {
+                        extracted[c] = std::move(chunk);
+                    }
+                }
+                cv.notify_all();
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < n_threads; ++t) {
+            threads.emplace_back(worker);
+        }
+
+        // The chunks are folded in order as they are extracted
+        for (size_t c = 0; c < chunks.size(); ++c) {
+            std::unique_ptr<PPExtractTraversal> chunk;
+            {
+                std::unique_lock<std::mutex> lk(mutex);
+                cv.wait(lk, [&]{ return error || extracted[c]; });
+                if (error) {
+                    break;
+                }
+                chunk = std::move(extracted[c]);
+            }
+            // The workers are stopped and joined before a fold error is rethrown
+            const char *fold_error = NULL;
+            try {
+                fold_region_chunk(*chunk, n_threads);
+            } catch (const char *e) {
+                fold_error = e;
+            } catch (...) {
+                fold_error = "Failed to fold region chunk";
+            }
+            chunk.reset();
+            {
+                std::lock_guard<std::mutex> lk(mutex);
+                if (fold_error && !error) {
+                    error = fold_error;
+                }
+                folded++;
+            }
+            cv.notify_all();
+            if (fold_error) {
+                break;
+            }
+            if (progress) {
+                std::cout << "\033[A\033[2K";
+                std::cout << "Handled " << records_handled << " VCF entries (lines), " << c + 1 << " of " << chunks.size() << " region chunks" << std::endl;
+            }
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+        if (error) {
+            std::cerr << "Failed to extract the region chunks of file : " << filename << std::endl;
+            throw error;
+        }
+        region_tails.clear();
+    }
+
+    /**
+     * @brief Extracts a regenerated VCF/BCF from the extraction of its previous
+     *        version (binary file and its fingerprints, see set_fingerprints).
+     *        The records of the regions whose fingerprint changed are extracted
+     *        again, with enough unchanged regions around them for the FIFO
+     *        windows, the het sites of the other regions are copied from the
+     *        previous binary file with their VCF line shifted. The result is
+     *        the same as traverse(), the fingerprints are updated.
+     */
+    void traverse_update_no_destroy(const std::string& filename, const std::string& previous_filename) {
+        if (!fingerprints || n_threads > 1 || max_memory || !samples_file.empty() || !configurations.empty() ||
+            line_index || line_counter_from_map || search_line_value) {
+            std::cerr << "The update requires the fingerprints and a single threaded extraction of all the records to memory" << std::endl;
+            throw "Update extraction settings";
+        }
+        const auto previous_fingerprints = RegionFingerprints::load(RegionFingerprints::default_filename(previous_filename));
+        if (previous_fingerprints.region_size != fingerprints->region_size ||
+            previous_fingerprints.parameters_hash != fingerprints->parameters_hash) {
+            std::cerr << "The previous file " << previous_filename << " was extracted with other parameters or region size" << std::endl;
+            throw "Update parameters mismatch";
+        }
+
+        // Fingerprints of the new records, nothing is decoded
+        initialize_bcf_file_reader(bcf_fri, filename);
+        handle_bcf_file_reader();
+        uint64_t n_records = 0;
+        while (bcf_next_line(bcf_fri)) {
+            fingerprints->add_record(get_header(), bcf_fri.line, n_records++);
+        }
+        destroy_bcf_file_reader(bcf_fri);
+
+        HetInfoMemoryMap previous(previous_filename);
+        if (!previous.integrity_check_pass()) {
+            std::cerr << "The previous file " << previous_filename << " is corrupted" << std::endl;
+            throw "Update previous file corrupted";
+        }
+        if (previous.num_samples != fifos.size()) {
+            std::cerr << "The previous file " << previous_filename << " has " << previous.num_samples << " samples instead of " << fifos.size() << std::endl;
+            throw "Update samples mismatch";
+        }
+        for (size_t idx = 0; idx < fifos.size(); ++idx) {
+            if (previous.get_orig_idx_of_nth(idx) != sample_id(idx)) {
+                std::cerr << "The samples of the previous file " << previous_filename << " are not the extracted ones" << std::endl;
+                throw "Update samples mismatch";
+            }
+        }
+
+        auto runs = find_update_runs(previous_fingerprints, n_records);
+        plan_update_runs(runs, n_records);
+        while (!extract_update_runs(filename, runs, previous, n_records)) {
+            plan_update_runs(runs, n_records);
+        }
+
+        uint64_t extracted = 0;
+        for (const auto& run : runs) {
+            extracted += run.context_end - run.context_begin;
+        }
+        std::cout << "Extracted again " << extracted << " of " << n_records << " records for " << runs.size() << " changed parts" << std::endl;
+        records_handled = n_records;
+        line_counter = n_records;
+    }
+
+protected:
+    /**
+     * @brief Consecutive regions that changed between the previous and new
+     *        records. The zone is extracted again and replaces the previous
+     *        het sites, the context around it is only extracted for the FIFO
+     *        windows. They extend by whole unchanged regions on each side.
+     */
+    class UpdateRun {
+    public:
+        /* Last unchanged region before the run (-1 if none) and first one after (in the new fingerprints) */
+        int64_t before = -1;
+        size_t after = 0;
+        /* Unchanged regions in the zone and in the context, on each side */
+        size_t inner_before = 1;
+        size_t outer_before = 1;
+        size_t inner_after = 1;
+        size_t outer_after = 1;
+        /* Changed records in the new and previous records */
+        uint64_t begin = 0;
+        uint64_t end = 0;
+        uint64_t previous_begin = 0;
+        uint64_t previous_end = 0;
+        uint64_t zone_begin = 0;
+        uint64_t zone_end = 0;
+        uint64_t context_begin = 0;
+        uint64_t context_end = 0;
+
+        /* Boundaries where the number of het sites is checked, in order */
+        uint64_t boundary(const size_t i) const {
+            const uint64_t boundaries[] = {zone_begin, begin, end, zone_end};
+            return boundaries[i];
+        }
+    };
+
+    /* Hash of the settings that change the extracted het sites, part of the fingerprints */
+    uint64_t parameters_hash() const {
+        std::ostringstream oss;
+        oss << FIFO_SIZE << " " << PP_THRESHOLD << " " << MAF_THRESHOLD << " " << pp_from_maf << pp_from_af << extract_acan << " "
+            << start_id << " " << stop_id << " " << keep_distance << drop_isolated << " " << (selection ? selection->to_string() : "");
+        return RegionFingerprints::hash_string(oss.str());
+    }
+
+    /* Merges the previous and new regions in order, the runs are the regions added, removed or changed in between unchanged ones */
+    std::vector<UpdateRun> find_update_runs(const RegionFingerprints& previous_fingerprints, const uint64_t n_records) const {
+        const auto& regions = fingerprints->regions;
+        const auto& previous_regions = previous_fingerprints.regions;
+        std::vector<UpdateRun> runs;
+        UpdateRun run;
+        bool in_run = false;
+        int64_t last_unchanged = -1;
+        uint64_t last_end = 0;
+        uint64_t last_previous_end = 0;
+        auto open_run = [&]() {
+            if (!in_run) {
+                run = UpdateRun();
+                run.before = last_unchanged;
+                run.begin = last_end;
+                run.previous_begin = last_previous_end;
+                in_run = true;
+            }
+        };
+        auto close_run = [&](const size_t after, const uint64_t end, const uint64_t previous_end) {
+            if (in_run) {
+                run.after = after;
+                run.end = end;
+                run.previous_end = previous_end;
+                runs.push_back(run);
+                in_run = false;
+            }
+        };
+
+        size_t i = 0;
+        size_t j = 0;
+        while (i < regions.size() || j < previous_regions.size()) {
+            if (i < regions.size() && j < previous_regions.size() && regions[i].key() == previous_regions[j].key()) {
+                if (regions[i].same_records(previous_regions[j])) {
+                    close_run(i, regions[i].first_line, previous_regions[j].first_line);
+                    last_unchanged = i;
+                    last_end = regions[i].end_line();
+                    last_previous_end = previous_regions[j].end_line();
+                } else {
+                    open_run();
+                }
+                i++;
+                j++;
+            } else if (i < regions.size() && previous_fingerprints.find(regions[i]) < 0) {
+                open_run();
+                i++;
+            } else if (j < previous_regions.size() && fingerprints->find(previous_regions[j]) < 0) {
+                open_run();
+                j++;
+            } else {
+                std::cerr << "The regions of the previous and new records are not in the same order" << std::endl;
+                throw "Update regions order";
+            }
+        }
+        close_run(regions.size(), n_records, previous_regions.empty() ? 0 : previous_regions.back().end_line());
+        return runs;
+    }
+
+    /* Sets the lines of the zones and contexts of the runs and merges the runs whose contexts overlap */
+    void plan_update_runs(std::vector<UpdateRun>& runs, const uint64_t n_records) const {
+        const auto& regions = fingerprints->regions;
+        for (auto& run : runs) {
+            // First line of the n-th unchanged region before the run, end of the n-th after it
+            auto line_before = [&](const size_t n) -> uint64_t {
+                return (run.before + 1 >= int64_t(n)) ? regions[run.before + 1 - n].first_line : 0;
+            };
+            auto line_after = [&](const size_t n) -> uint64_t {
+                return (run.after + n <= regions.size()) ? regions[run.after + n - 1].end_line() : n_records;
+            };
+            run.zone_begin = line_before(run.inner_before);
+            run.context_begin = line_before(run.inner_before + run.outer_before);
+            run.zone_end = line_after(run.inner_after);
+            run.context_end = line_after(run.inner_after + run.outer_after);
+        }
+        size_t merged = 0;
+        for (size_t r = 1; r < runs.size(); ++r) {
+            auto& run = runs[merged];
+            if (run.context_end > runs[r].context_begin) {
+                run.after = runs[r].after;
+                run.end = runs[r].end;
+                run.previous_end = runs[r].previous_end;
+                run.inner_after = runs[r].inner_after;
+                run.outer_after = runs[r].outer_after;
+                run.zone_end = runs[r].zone_end;
+                run.context_end = runs[r].context_end;
+            } else {
+                runs[++merged] = runs[r];
+            }
+        }
+        runs.resize(runs.empty() ? 0 : merged + 1);
+    }
+
+    /**
+     * @brief Extracts the zones and contexts of the runs and splices them in
+     *        the previous het sites, one run after the other. Returns false if
+     *        the context of a run had less than mid het sites for a sample,
+     *        the run is then extended and all runs must be extracted again.
+     */
+    bool extract_update_runs(const std::string& filename, std::vector<UpdateRun>& runs, const HetInfoMemoryMap& previous, const uint64_t n_records) {
+        const size_t mid = FIFO_SIZE / 2;
+        std::vector<size_t> cursors(fifos.size(), 0);
+        for (auto& f : fifos) {
+            f.set_kept_items(std::vector<HetInfo>());
+        }
+
+        std::unique_ptr<PPExtractTraversal> part;
+        // Number of het sites of the samples at the beginning of the context, the boundaries of the run and its end
+        std::vector<std::vector<uint32_t> > counts;
+        size_t r = 0;
+        bool sufficient = true;
+        auto start_run = [&]() {
+            part = make_partial_extraction();
+            part->bcf_fri.n_samples = bcf_fri.n_samples;
+            part->sample_ids = sample_ids;
+            part->handle_bcf_file_reader();
+            counts.assign(1, part->number_of_het_sites);
+        };
+        // At least mid het sites between the given count and the next one for all samples
+        auto enough_hets = [&](const size_t c) {
+            for (size_t i = start_id; i < stop_id; ++i) {
+                if (counts[c+1][i] - counts[c][i] < mid) {
+                    return false;
+                }
+            }
+            return true;
+        };
+        auto end_run = [&]() {
+            if (!part) {
+                start_run();
+            }
+            part->finalize();
+            auto& run = runs[r];
+            while (counts.size() < 6) {
+                counts.push_back(part->number_of_het_sites);
+            }
+            // The previous het sites outside of the zone are kept if their windows didn't change and the zone has full windows
+            bool extended = false;
+            if (run.context_begin && !enough_hets(0)) {
+                run.outer_before++;
+                extended = true;
+            }
+            if (run.zone_begin && !enough_hets(1)) {
+                run.inner_before++;
+                extended = true;
+            }
+            if (run.zone_end < n_records && !enough_hets(3)) {
+                run.inner_after++;
+                extended = true;
+            }
+            if (run.context_end < n_records && !enough_hets(4)) {
+                run.outer_after++;
+                extended = true;
+            }
+            if (extended) {
+                sufficient = false;
+            } else {
+                for (size_t idx = 0; idx < fifos.size(); ++idx) {
+                    splice_update_run(*part, run, previous, idx, cursors[idx]);
+                }
+            }
+            part.reset();
+            r++;
+        };
+
+        initialize_bcf_file_reader(bcf_fri, filename);
+        uint64_t line = 0;
+        while (sufficient && r < runs.size()) {
+            if (line == runs[r].context_end) {
+                end_run();
+                continue;
+            }
+            if (!bcf_next_line(bcf_fri)) {
+                break;
+            }
+            // Only the records of the contexts are decoded
+            if (line >= runs[r].context_begin) {
+                if (!part) {
+                    start_run();
+                }
+                while (counts.size() < 5 && runs[r].boundary(counts.size() - 1) <= line) {
+                    counts.push_back(part->number_of_het_sites);
+                }
+                bcf1_t *rec = bcf_fri.line;
+                bcf_unpack(rec, BCF_UN_STR);
+                bcf_fri.ngt = bcf_get_genotypes(bcf_fri.sr->readers[0].header, rec, &(bcf_fri.gt_arr), &(bcf_fri.size_gt_arr));
+                line_max_ploidy = bcf_fri.ngt / bcf_fri.n_samples;
+                forward_record(*part, line);
+            }
+            line++;
+        }
+        destroy_bcf_file_reader(bcf_fri);
+        if (!sufficient) {
+            return false;
+        }
+        if (r < runs.size()) {
+            std::cerr << "The file " << filename << " changed during the update" << std::endl;
+            throw "Update file changed";
+        }
+
+        // The het sites after the last run
+        const int delta = runs.empty() ? 0 : int(runs.back().end) - int(runs.back().previous_end);
+        for (size_t idx = 0; idx < fifos.size(); ++idx) {
+            const HetInfoSpan block = previous.get_span_of_nth(idx);
+            auto kept = fifos[idx].take_kept_items();
+            for (size_t& c = cursors[idx]; c < block.size(); ++c) {
+                HetInfo hi = block.het_info(c);
+                hi.vcf_line += delta;
+                kept.push_back(hi);
+            }
+            fifos[idx].set_kept_items(std::move(kept));
+            // Last access to the previous block of the sample (decoded if not in the original layout)
+            previous.release_nth(idx);
+        }
+        return true;
+    }
+
+    /* Appends the previous het sites of a sample before the zone of the run then the extracted ones in the zone */
+    void splice_update_run(PPExtractTraversal& part, const UpdateRun& run, const HetInfoMemoryMap& previous, const size_t idx, size_t& cursor) {
+        const HetInfoSpan block = previous.get_span_of_nth(idx);
+        const size_t previous_size = block.size();
+        const int delta_before = int(run.begin) - int(run.previous_begin);
+        const int delta_after = int(run.end) - int(run.previous_end);
+        auto kept = fifos[idx].take_kept_items();
+        for (; cursor < previous_size; ++cursor) {
+            HetInfo hi = block.het_info(cursor);
+            if (hi.vcf_line + delta_before >= int(run.zone_begin)) {
+                break;
+            }
+            hi.vcf_line += delta_before;
+            kept.push_back(hi);
+        }
+        for (const auto& hi : part.fifos[idx].get_kept_items_ref()) {
+            if (hi.vcf_line >= int(run.zone_begin) && hi.vcf_line < int(run.zone_end)) {
+                kept.push_back(hi);
+            }
+        }
+        // The previous het sites of the zone are replaced
+        while (cursor < previous_size && block[cursor].vcf_line() + delta_after < int(run.zone_end)) {
+            cursor++;
+        }
+        fifos[idx].set_kept_items(std::move(kept));
+    }
+
+    /* PP of the samples in the record itself when stored as one float per sample (no copy), decoded otherwise */
+    const float* get_format_pp_in_place(bcf_hdr_t *header, bcf1_t *line) {
+        bcf_fmt_t *fmt = bcf_get_fmt(header, line, "PP");
+        if (!fmt) {
+            return NULL;
+        }
+        if (fmt->type == BCF_BT_FLOAT && fmt->n == 1 && !(reinterpret_cast<uintptr_t>(fmt->p) % alignof(float))) {
+            return reinterpret_cast<const float*>(fmt->p);
+        }
+        return (bcf_get_format_float(header, line, "PP", &pp_arr, &pp_arr_size) > 0) ? pp_arr : NULL;
+    }
+
+    /* Sample of the input file of the sample block idx */
+    uint32_t sample_id(const size_t idx) const {
+        return sample_ids.empty() ? start_id + idx : sample_ids[start_id + idx];
+    }
+
+    /* Restricts the header to the samples of the file, before any record is read */
+    void subset_samples(bcf_hdr_t *hdr) {
+        std::unordered_map<std::string, uint32_t> original_ids;
+        for (int i = 0; i < bcf_hdr_nsamples(hdr); ++i) {
+            original_ids[hdr->samples[i]] = i;
+        }
+        const int ret = bcf_hdr_set_samples(hdr, samples_file.c_str(), 1);
+        if (ret < 0) {
+            std::cerr << "Failed to read the samples from file : " << samples_file << std::endl;
+            throw "Failed to set samples";
+        } else if (ret > 0) {
+            std::cerr << "Warning some samples of " << samples_file << " are not in the input, they are ignored" << std::endl;
+        }
+        // The samples keep the order of the header
+        sample_ids.resize(bcf_hdr_nsamples(hdr));
+        for (size_t i = 0; i < sample_ids.size(); ++i) {
+            sample_ids[i] = original_ids.at(hdr->samples[i]);
+        }
+        bcf_fri.n_samples = sample_ids.size();
+        if (!quiet) {
+            std::cout << "Extracting " << sample_ids.size() << " samples out of " << original_ids.size() << " from " << samples_file << std::endl;
+        }
+    }
+
+    /* Creates an extraction of part of the records with the settings of this one */
+    std::unique_ptr<PPExtractTraversal> make_partial_extraction() const {
+        auto part = std::make_unique<PPExtractTraversal>(start_id, stop_id, FIFO_SIZE, false, false, PP_THRESHOLD);
+        part->pp_from_maf = pp_from_maf;
+        part->pp_from_af = pp_from_af;
+        part->extract_acan = extract_acan;
+        part->MAF_THRESHOLD = MAF_THRESHOLD;
+        part->selection = selection;
+        part->shared_selection = true;
+        part->samples_file = samples_file;
+        part->keep_distance = keep_distance;
+        part->drop_isolated = drop_isolated;
+        part->set_quiet(true);
+        return part;
+    }
+
+    /* Creates the extraction of a region chunk with the settings of this one */
+    std::unique_ptr<PPExtractTraversal> make_region_chunk() const {
+        auto chunk = make_partial_extraction();
+        chunk->set_tiling(tile_records, tile_samples);
+        chunk->record_boundaries = true;
+        return chunk;
+    }
+
+    /* Appends the records of the next region chunk (extracted and finalized) */
+    void fold_region_chunk(PPExtractTraversal& chunk, const size_t n_threads) {
+        const int line_offset = records_handled;
+        HetInfoFileWriter::parallel_for(n_threads, fifos.size(), [&](const size_t idx) {
+            fold_region_chunk_sample(chunk, idx, line_offset);
+        });
+        records_handled += chunk.records_handled;
+        line_counter = records_handled;
+    }
+
+    /**
+     * @brief The kept het sites of a sample are the windows of mid het sites on
+     *        each side of the ones satisfying the predicate. The chunk was
+     *        extracted on its own, so only the windows crossing the boundary
+     *        are missing, they are completed from the last mid het sites so
+     *        far (tail) and the first mid het sites of the chunk (head).
+     */
+    void fold_region_chunk_sample(PPExtractTraversal& chunk, const size_t idx, const int line_offset) {
+        const size_t mid = FIFO_SIZE / 2;
+        const size_t i = start_id + idx;
+        auto& chunk_fifo = chunk.fifos[idx];
+        const size_t chunk_hets = chunk.number_of_het_sites[i];
+        auto& tail = region_tails[idx];
+        std::vector<HetInfo> kept = fifos[idx].take_kept_items();
+        const std::vector<HetInfo> chunk_kept = chunk_fifo.take_kept_items();
+        auto by_line = [](const HetInfo& a, const HetInfo& b) { return a.vcf_line < b.vcf_line; };
+
+        std::vector<BoundaryHet> head(std::min(chunk_hets, mid));
+        std::vector<bool> newly_kept_head(head.size(), false);
+        for (size_t j = 0; j < head.size(); ++j) {
+            head[j] = chunk.boundary_heads[idx * mid + j];
+            head[j].kept = std::binary_search(chunk_kept.begin(), chunk_kept.end(), head[j].hi, by_line);
+        }
+
+        // Windows from the tail into the head of the chunk (d is the distance to the boundary)
+        for (size_t d = 1; d <= tail.size(); ++d) {
+            if (tail[tail.size() - d].pred) {
+                for (size_t j = 0; j + d <= mid && j < head.size(); ++j) {
+                    if (!head[j].kept) {
+                        head[j].kept = true;
+                        newly_kept_head[j] = true;
+                    }
+                }
+            }
+        }
+
+        // Windows from the head of the chunk into the tail, these het sites are among the last kept ones
+        for (size_t j = 0; j < head.size(); ++j) {
+            if (head[j].pred) {
+                for (size_t d = 1; d + j <= mid && d <= tail.size(); ++d) {
+                    auto& t = tail[tail.size() - d];
+                    if (!t.kept) {
+                        t.kept = true;
+                        kept.insert(std::upper_bound(kept.begin(), kept.end(), t.hi, by_line), t.hi);
+                    }
+                }
+            }
+        }
+
+        // Kept het sites of the chunk, with the newly kept ones of the head, at their final lines
+        kept.reserve(kept.size() + chunk_kept.size() + head.size());
+        auto append = [&](HetInfo hi) {
+            hi.vcf_line += line_offset;
+            kept.push_back(hi);
+        };
+        size_t k = 0;
+        for (size_t j = 0; j < head.size(); ++j) {
+            if (newly_kept_head[j]) {
+                while (k < chunk_kept.size() && chunk_kept[k].vcf_line < head[j].hi.vcf_line) {
+                    append(chunk_kept[k++]);
+                }
+                append(head[j].hi);
+            }
+        }
+        while (k < chunk_kept.size()) {
+            append(chunk_kept[k++]);
+        }
+        fifos[idx].set_kept_items(std::move(kept));
+
+        // New tail, the last mid het sites so far
+        const size_t chunk_tail = std::min(chunk_hets, mid);
+        for (size_t age = chunk_tail; age-- > 0;) {
+            BoundaryHet b;
+            b.hi = chunk_fifo.get_newest(age);
+            const size_t j = chunk_hets - 1 - age;
+            b.kept = chunk_fifo.is_newest_kept(age) || (j < head.size() && newly_kept_head[j]);
+            b.pred = chunk_fifo.is_newest_pred(age);
+            b.hi.vcf_line += line_offset;
+            tail.push_back(b);
+        }
+        if (tail.size() > mid) {
+            tail.erase(tail.begin(), tail.end() - mid);
+        }
+
+        number_of_het_sites[i] += chunk.number_of_het_sites[i];
+        number_of_low_pp_sites[i] += chunk.number_of_low_pp_sites[i];
+        number_of_snp_low_pp_sites[i] += chunk.number_of_snp_low_pp_sites[i];
+        number_of_non_snp[i] += chunk.number_of_non_snp[i];
+    }
+
+    float singleton_pp(const float pp) const {
+        if (pp >= PP_THRESHOLD) {
+            /* Edge case for old version of SHAPEIT5 that would score
+               singletons phased with only one of their parents with
+               a PP of 1.0, In about 95% of cases the singleton comes
+               from the other parent if not observed in the known parent
+               but it could also be a de novo mutation on the known
+               parent haplotype, these cases should not be scored 1.0 */
+            return 0.97; /* arbitrary value */
+        }
+        return pp;
+    }
+
+    template <typename PPSource, bool SINGLETON_FIX, typename Sink>
+    void extract_hets_select_snp(const ExtractRecordInfo& info, const int *gt_arr, const PPSource& source, const HetScanner& scanner, Sink& sink) {
+        if (selection) {
+            if (info.non_snp) {
+                extract_hets<PPSource, SINGLETON_FIX, true, true>(info, gt_arr, source, scanner, sink);
+            } else {
+                extract_hets<PPSource, SINGLETON_FIX, false, true>(info, gt_arr, source, scanner, sink);
+            }
+        } else {
+            if (info.non_snp) {
+                extract_hets<PPSource, SINGLETON_FIX, true, false>(info, gt_arr, source, scanner, sink);
+            } else {
+                extract_hets<PPSource, SINGLETON_FIX, false, false>(info, gt_arr, source, scanner, sink);
+            }
+        }
+    }
+
+    /* Per het sample kernel, instantiated for each mode so that it has no mode branches */
+    template <typename PPSource, bool SINGLETON_FIX, bool NON_SNP, bool SELECT, typename Sink>
+    void extract_hets(const ExtractRecordInfo& info, const int *gt_arr, const PPSource& source, const HetScanner& scanner, Sink& sink) {
+        for (size_t k = 0; k < scanner.n_hets; ++k) {
+            const size_t i = scanner.het_idx[k];
+            float pp = source.pp(i);
+            bool low_pp = source.low_pp(k);
+            if constexpr (SINGLETON_FIX) {
+                if (pp >= PP_THRESHOLD) {
+                    pp = singleton_pp(pp);
+                    low_pp = pred(HetInfo(0, 0, 0, pp));
+                }
+            }
+            if constexpr (SELECT) {
+                // The selection replaces the low PP as predicate of the FIFOs, the PP of the record is kept
+                low_pp = selection->select(info.selection, i, pp);
+            }
+
+            sink.put(i, HetInfo(info.line_counter, gt_arr[i*PLOIDY_2], gt_arr[i*PLOIDY_2+1], pp), low_pp, NON_SNP);
+        }
+    }
+
+    /* Counters and FIFO of the sample */
+    inline void add_het(const size_t i, const HetInfo& hi, const bool low_pp, const bool non_snp, const uint64_t position) {
+        number_of_het_sites[i]++;
+        if (record_boundaries && number_of_het_sites[i] <= FIFO_SIZE / 2) {
+            auto& b = boundary_heads[(i-start_id) * (FIFO_SIZE / 2) + number_of_het_sites[i] - 1];
+            b.hi = hi;
+            b.pred = low_pp;
+        }
+        number_of_low_pp_sites[i] += low_pp;
+        if (non_snp) {
+            number_of_non_snp[i]++;
+        } else {
+            number_of_snp_low_pp_sites[i] += low_pp;
+        }
+
+        // The low PP flag is the predicate, it is the selection when there is one
+        fifos[i-start_id].insert_with_pred(hi, low_pp, position);
     }
 
+    /* Het sites go directly to the counters and FIFO of the sample */
+    class DirectSink {
+    public:
+        DirectSink(PPExtractTraversal& extractor, const uint64_t position) : extractor(extractor), position(position) {}
+        inline void put(const size_t i, const HetInfo& hi, const bool low_pp, const bool non_snp) {
+            extractor.add_het(i, hi, low_pp, non_snp, position);
+        }
+
+    protected:
+        PPExtractTraversal& extractor;
+        const uint64_t position;
+    };
+
+    void spill_if_above_limit() {
+        size_t kept_memory = 0;
+        for (const auto& f : fifos) {
+            kept_memory += f.get_kept_items_memory();
+        }
+        if (kept_memory > kept_memory_limit) {
+            spill();
+        }
+    }
+
+    /* Moves the kept het infos of all samples to a new run on disk */
+    void spill() {
+        if (!spiller) {
+            spiller = std::make_unique<HetInfoSpiller>(tmp_dir.empty() ? fs::temp_directory_path().string() : tmp_dir, fifos.size());
+        }
+        for (const auto& f : fifos) {
+            spilled_pred += f.get_number_kept_with_pred();
+        }
+        spiller->spill([this](const size_t idx) -> const std::vector<HetInfo>& { return fifos[idx].get_kept_items_ref(); });
+        for (auto& f : fifos) {
+            f.clear_kept_items();
+        }
+        if (progress) {
+            std::cout << "Spilled kept het infos to disk, " << spiller->get_total_spilled() << " so far" << std::endl;
+        }
+    }
+
+    /* First sample of the shard (contiguous slice of the samples) */
+    size_t shard_begin(const size_t shard, const size_t n_shards) const {
+        return start_id + ((stop_id - start_id) * shard) / n_shards;
+    }
+
+    /* Each worker extracts all the records of the batch for its contiguous slice of samples,
+     * so that the FIFOs see the records in the same order as in a single threaded run */
+    void dispatch_batch() {
+        auto& batch = batches[current_batch];
+        if (max_memory) {
+            // The FIFOs can only be spilled when the workers are done with them
+            workers->wait();
+            spill_if_above_limit();
+        }
+        const size_t n_shards = workers->size();
+        workers->dispatch([this, &batch, n_shards](size_t shard) {
+            const size_t begin = shard_begin(shard, n_shards);
+            const size_t end = shard_begin(shard + 1, n_shards);
+            HetTile *tile = tiles.empty() ? NULL : &tiles[shard];
+            for (size_t r = 0; r < batch.size; ++r) {
+                const auto& record = batch.records[r];
+                extract_samples(record.info, record.gt_arr, record.pp_arr, begin, end, scanners[shard], tile);
+            }
+        });
+        // Fill the other batch while this one is extracted (dispatch waited for it to be done)
+        current_batch ^= 1;
+        batches[current_batch].size = 0;
+    }
+
+public:
     const size_t FIFO_SIZE;
     const float PP_THRESHOLD;
     float MAF_THRESHOLD;
@@ -372,6 +1796,7 @@ public:
     size_t stop_id;
     size_t line_counter;
     size_t print_counter;
+    size_t records_handled;
     const PPPred pred;
     size_t progress;
     bool pp_from_maf;
@@ -386,6 +1811,65 @@ public:
     bool search_line_value;
     std::string search_in_file;
     VcfIdLineMapper vcf_id_line_mapper;
+    std::unique_ptr<VarLineIndex> line_index;
+    bool line_index_all_records = false;
+    bool line_index_found = false;
+
+protected:
+    class ExtractRecordBatch {
+    public:
+        std::unique_ptr<ExtractRecord[]> records;
+        size_t capacity = 0;
+        size_t size = 0;
+    };
+
+    static constexpr size_t BATCH_BYTES = 64*1024*1024;
+    static constexpr size_t MAX_BATCH_RECORDS = 256;
+    size_t n_threads;
+    std::unique_ptr<ShardWorkers> workers;
+    /* One per worker (or one when single threaded) */
+    std::vector<HetScanner> scanners;
+    size_t tile_records = 0;
+    size_t tile_samples = 2048;
+    /* One per worker (or one when single threaded), if tiling */
+    std::vector<HetTile> tiles;
+    static constexpr size_t SPILL_CHECK_RECORDS = 256;
+    size_t max_memory = 0;
+    size_t kept_memory_limit = 0;
+    std::string tmp_dir;
+    std::unique_ptr<HetInfoSpiller> spiller;
+    size_t spilled_pred = 0;
+    size_t records_since_spill_check = 0;
+    ExtractRecordBatch batches[2];
+    size_t current_batch;
+    bool quiet = false;
+    /* Region chunks : Records the first mid het sites of each sample */
+    static constexpr size_t REGION_CHUNKS_PER_THREAD = 4;
+    bool record_boundaries = false;
+    std::vector<BoundaryHet> boundary_heads;
+    /* Region chunks : Last mid het sites of each sample so far */
+    std::vector<std::vector<BoundaryHet> > region_tails;
+    /* Selection of the het sites, shared with the configurations and region chunks */
+    std::shared_ptr<GenotypeSelection> selection;
+    bool shared_selection = false;
+    /* Maximum distance of the kept het sites to the low PP ones (see set_keep_distance) */
+    uint32_t keep_distance = 0;
+    bool drop_isolated = false;
+    /* The PP are read in the records instead of decoded (see traverse_xsi_no_destroy) */
+    bool pp_in_place = false;
+    /* Samples of the current record not homozygous reference if only their GT are decoded (XSI), NULL otherwise */
+    const std::vector<uint32_t> *carriers = NULL;
+    /* Samples of the input file (see set_samples_file), original index of the decoded samples */
+    std::string samples_file;
+    std::vector<uint32_t> sample_ids;
+    /* Names of the decoded samples (empty if unknown) */
+    std::vector<std::string> sample_names;
+    /* Stage timers and counters (see enable_stats) */
+    ExtractionStats stats;
+    /* Fingerprints of the regions of the extracted records (see set_fingerprints) */
+    std::unique_ptr<RegionFingerprints> fingerprints;
+    /* Other extractions of the same records (see add_configuration) */
+    std::vector<std::unique_ptr<PPExtractTraversal> > configurations;
 };
 
 #endif /* __EXTRACTORS_HPP__ */
\ No newline at end of file
@@ -1,49 +1,147 @@
 #ifndef __GENERIC_KEEP_FIFO_HPP__
 #define __GENERIC_KEEP_FIFO_HPP__
 
-#include <deque>
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <vector>
 
-template <typename T, class Pred>
+/* Storage of the FIFO ring, one array of items, can be specialized per item type */
+template <typename T, size_t CAPACITY>
+class FifoStorage {
+public:
+    T get(const size_t slot) const { return items[slot]; }
+    void set(const size_t slot, const T& item) { items[slot] = item; }
+
+protected:
+    T items[CAPACITY];
+};
+
+/**
+ * @brief FIFO of the last "size" items, when the middle item satisfies the
+ *        predicate the items of the FIFO not kept yet are kept (in order).
+ *
+ *        The FIFO is a ring of compile-time capacity (power of two), the
+ *        flags of the items are bitmasks indexed by age (0 is the newest).
+ *        FIFOs larger than the capacity use a ring allocated with the FIFO
+ *        instead (next power of two above the size), and FIFOs larger than
+ *        the 64-bit masks keep the flags of the items by slot of the ring.
+ *        Items are only kept while they are in the FIFO and items enter as
+ *        not kept, so the items not kept yet are always the newest ones.
+ *
+ *        With a maximum distance the items are inserted with their position
+ *        and only the items of the window within that distance of the middle
+ *        item are kept, the middle item is dropped if it has none of them
+ *        when isolated items are dropped. The kept items stay in order.
+ */
+template <typename T, class Pred, size_t CAPACITY = 16>
 class GenericKeepFifo {
+    static_assert(CAPACITY && !(CAPACITY & (CAPACITY - 1)), "FIFO capacity must be a power of two");
+    static_assert(CAPACITY <= 64, "FIFO flags are stored in 64-bit masks");
+
 public:
-    GenericKeepFifo(const size_t size, Pred p) :
+    /* Largest size held in the ring of compile-time capacity */
+    static constexpr size_t INLINE_MAX_SIZE = (CAPACITY & 1) ? CAPACITY : CAPACITY - 1;
+    /* Largest size with the flags in 64-bit masks */
+    static constexpr size_t MASK_MAX_SIZE = 63;
+
+    /* Position of the items inserted without position (never within the distance) */
+    static constexpr uint64_t NO_POSITION = ~uint64_t(0);
+
+    GenericKeepFifo(const size_t size, Pred p, const uint32_t max_distance = 0, const bool drop_isolated = false) :
         size(size),
         mid(size/2),
+        max_distance(max_distance),
+        drop_isolated(drop_isolated),
         p(p) {
         if (!(size & 1)) {
             std::cerr << "FIFO size should be odd ! Adjusting size to " << ++this->size << std::endl;
             this->mid = this->size/2;
         }
+        if (this->size > INLINE_MAX_SIZE) {
+            size_t ring_size = 1;
+            while (ring_size <= this->size) {
+                ring_size <<= 1;
+            }
+            wide_items.resize(ring_size);
+            ring_mask = ring_size - 1;
+        }
+        if (this->size > MASK_MAX_SIZE) {
+            slot_flags.resize(ring_mask + 1, 0);
+        } else {
+            window_mask = (uint64_t(1) << this->size) - 1;
+        }
+        if (max_distance) {
+            positions.resize(ring_mask + 1, NO_POSITION);
+        }
+    }
+
+    /* Position of an item for the distance, e.g., (contig << 32) | position, see max_distance */
+    static constexpr uint64_t position(const uint32_t contig, const uint32_t pos) {
+        return (uint64_t(contig) << 32) | pos;
+    }
+
+    void insert(T item, const uint64_t item_position = NO_POSITION) {
+        insert_with_pred(item, p(item), item_position);
     }
 
-    void insert(T item) {
+    /* Inserts an item whose predicate is given instead (e.g., a selection of the items) */
+    void insert_with_pred(T item, const bool item_pred, const uint64_t item_position = NO_POSITION) {
         // If the FIFO is empty, fill with "dummy items" (to simplify logic)
-        if (items.size() == 0) {
+        if (!started) {
+            // With a distance the dummy items have no position, the first item has its own window
+            const bool dummy_pred = item_pred && !max_distance;
             for (size_t i = 0; i < size; ++i) {
-                items.push_back(FIFOItem(item));
-                // Setting this true will make sure "keep" doesn't save them
-                items.back().kept = true;
+                set_item(i, item);
             }
+            head = size - 1;
+            // Dummy items are marked kept so that "keep" doesn't save them
+            pending = 0;
+            pred_mask = dummy_pred ? window_mask : 0;
+            std::fill(slot_flags.begin(), slot_flags.end(), dummy_pred ? SLOT_PRED : 0);
+            started = true;
         }
 
-        // Push item at the end
-        items.push_back(FIFOItem(item));
-
-        // Pop the oldest item
-        items.pop_front();
+        // Push item at the end, overwriting the oldest item
+        head = (head + 1) & ring_mask;
+        set_item(head, item);
+        if (max_distance) {
+            positions[head] = item_position;
+        }
+        if (slot_flags.empty()) {
+            pending = ((pending << 1) | 1) & window_mask;
+            pred_mask = ((pred_mask << 1) | (item_pred ? 1 : 0)) & window_mask;
+        } else {
+            slot_flags[head] = SLOT_PENDING | (item_pred ? SLOT_PRED : 0);
+        }
 
-        // If predicate (e.g., small PP)
-        if (p(items[mid].item)) {
+        // If predicate (e.g., small PP) on the middle item, the middle item has age mid
+        if (is_pred(mid)) {
             // Keep the information
-            keep();
+            if (max_distance) {
+                keep_within_distance(mid);
+            } else {
+                keep_ages(size - 1, 0);
+            }
         }
     }
 
     void finalize() {
-        // Search for predicate (e.g., small PP) at the end
-        for (size_t i = mid + 1; i < items.size(); ++i) {
-            if (p(items[i].item)) {
-                keep_end(i-mid);
+        if (!started) {
+            return;
+        }
+        // Search for predicate (e.g., small PP) at the end, from the oldest item after the middle one
+        for (size_t age = mid; age-- > 0;) {
+            if (max_distance) {
+                // The windows depend on the distances, each item after the middle one is checked
+                if (is_pred(age)) {
+                    keep_within_distance(age);
+                }
+                continue;
+            }
+            if (is_pred(age)) {
+                // Keep the items from mid positions before it to the end
+                keep_ages(age + mid, 0);
                 break;
             }
         }
@@ -63,37 +161,159 @@ public:
         return kept_items;
     }
 
+    /* Memory held by the kept items */
+    size_t get_kept_items_memory() const {
+        return kept_items.capacity() * sizeof(T);
+    }
+
+    /* Drops the kept items (e.g., once they are saved elsewhere) and releases their memory */
+    void clear_kept_items() {
+        std::vector<T>().swap(kept_items);
+    }
+
+    /* Moves the kept items out of the FIFO */
+    std::vector<T> take_kept_items() {
+        std::vector<T> items;
+        items.swap(kept_items);
+        return items;
+    }
+
+    /* Replaces the kept items (e.g., after merging them with the ones of another FIFO) */
+    void set_kept_items(std::vector<T>&& items) {
+        kept_items = std::move(items);
+    }
+
+    /* Number of items with the predicate dropped because they had no item within the distance */
+    size_t get_number_dropped() const {
+        return dropped;
+    }
+
+    /* Item of the given age (0 is the newest), age must be smaller than the size and the number of inserted items */
+    T get_newest(const size_t age) const {
+        return get_item((head - age) & ring_mask);
+    }
+
+    /* Tells if the item of the given age is kept, the age must be smaller than the size */
+    bool is_newest_kept(const size_t age) const {
+        if (!slot_flags.empty()) {
+            return !(slot_flags[(head - age) & ring_mask] & SLOT_PENDING);
+        }
+        return !(pending & (uint64_t(1) << age));
+    }
+
+    /* Tells if the item of the given age satisfied the predicate when inserted, the age must be smaller than the size */
+    bool is_newest_pred(const size_t age) const {
+        return is_pred(age);
+    }
+
+    /* Memory allocated with the FIFO besides the kept items (ring of the large FIFOs, positions, flags) */
+    size_t get_heap_memory() const {
+        return wide_items.capacity() * sizeof(T) + positions.capacity() * sizeof(uint64_t) + slot_flags.capacity();
+    }
+
 private:
-    class FIFOItem {
-    public:
-        FIFOItem(T item) : item(item), kept(false) {}
-        T item;
-        bool kept;
-    };
-
-    inline void keep_end(size_t start) {
-        for (size_t i = start; i < items.size(); ++i) {
-            if (!items[i].kept) {
-                kept_items.push_back(items[i].item);
-                items[i].kept = true;
-            }
+    static constexpr uint8_t SLOT_PENDING = 1;
+    static constexpr uint8_t SLOT_PRED = 2;
+
+    /* Tells if the item of the given age satisfies the predicate, the age must be smaller than the size */
+    bool is_pred(const size_t age) const {
+        if (!slot_flags.empty()) {
+            return slot_flags[(head - age) & ring_mask] & SLOT_PRED;
+        }
+        return pred_mask & (uint64_t(1) << age);
+    }
+
+    bool is_within_distance(const size_t age, const uint64_t from) const {
+        const uint64_t other = positions[(head - age) & ring_mask];
+        if (other == NO_POSITION || (other >> 32) != (from >> 32)) {
+            return false;
         }
+        return ((other > from) ? other - from : from - other) <= max_distance;
     }
 
-    inline void keep() {
-        for (size_t i = 0; i < items.size(); ++i) {
-            if (!items[i].kept) {
-                kept_items.push_back(items[i].item);
-                items[i].kept = true;
+    /* Keeps the item of the given age and the items of its window within the distance, the positions
+     * are in order so the items within the distance are contiguous around the item */
+    inline void keep_within_distance(const size_t age) {
+        const uint64_t from = positions[(head - age) & ring_mask];
+        size_t oldest = age;
+        while (oldest < age + mid && is_within_distance(oldest + 1, from)) {
+            oldest++;
+        }
+        size_t newest = age;
+        while (newest > 0 && newest + mid > age && is_within_distance(newest - 1, from)) {
+            newest--;
+        }
+        if (oldest == newest && drop_isolated) {
+            dropped++;
+            return;
+        }
+        keep_ages(oldest, newest);
+    }
+
+    /* Keeps the items not kept yet from the oldest to the newest age (included) */
+    inline void keep_ages(const size_t oldest, const size_t newest) {
+        if (slot_flags.empty()) {
+            const uint64_t older = (oldest >= 63) ? ~uint64_t(0) : (uint64_t(1) << (oldest + 1)) - 1;
+            keep(pending & older & ~((uint64_t(1) << newest) - 1));
+            return;
+        }
+        for (size_t age = oldest + 1; age-- > newest;) {
+            uint8_t& flags = slot_flags[(head - age) & ring_mask];
+            if (flags & SLOT_PENDING) {
+                kept_items.push_back(get_item((head - age) & ring_mask));
+                flags &= ~SLOT_PENDING;
             }
         }
     }
 
+    T get_item(const size_t slot) const {
+        return wide_items.empty() ? storage.get(slot) : wide_items[slot];
+    }
+
+    void set_item(const size_t slot, const T& item) {
+        if (wide_items.empty()) {
+            storage.set(slot, item);
+        } else {
+            wide_items[slot] = item;
+        }
+    }
+
+    /* Appends the items not kept yet given by the mask (by age) directly, oldest first */
+    inline void keep(uint64_t to_keep) {
+        if (!to_keep) {
+            return;
+        }
+        pending &= ~to_keep;
+        while (to_keep) {
+            const size_t age = 63 - __builtin_clzll(to_keep);
+            kept_items.push_back(get_item((head - age) & ring_mask));
+            to_keep &= ~(uint64_t(1) << age);
+        }
+    }
+
 protected:
     size_t size;
     size_t mid;
-    /// @brief FIFO Items
-    std::deque<FIFOItem> items;
+    /// @brief Maximum distance between the middle item and the kept items (0 disables)
+    uint32_t max_distance;
+    bool drop_isolated;
+    size_t dropped = 0;
+    /// @brief Positions of the items (by slot) if there is a maximum distance
+    std::vector<uint64_t> positions;
+    /// @brief FIFO Items, the newest is in slot "head"
+    FifoStorage<T, CAPACITY> storage;
+    /// @brief FIFO Items of the FIFOs larger than the capacity (empty otherwise)
+    std::vector<T> wide_items;
+    /// @brief Pending and predicate flags of the items (by slot) of the FIFOs larger than the masks (empty otherwise)
+    std::vector<uint8_t> slot_flags;
+    size_t ring_mask = CAPACITY - 1;
+    size_t head = 0;
+    bool started = false;
+    uint64_t window_mask = 0;
+    /// @brief Items not kept yet (by age)
+    uint64_t pending = 0;
+    /// @brief Items satisfying the predicate (by age)
+    uint64_t pred_mask = 0;
     /// @brief Kept items surrounding predicate
     std::vector<T> kept_items;
     /// @brief Predicate that tells us when to keep
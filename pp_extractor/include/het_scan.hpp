@@ -0,0 +1,285 @@
+#ifndef __HET_SCAN_HPP__
+#define __HET_SCAN_HPP__
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HET_SCAN_X86 1
+#else
+#define HET_SCAN_X86 0
+#endif
+
+/**
+ * @brief Kernels that scan the diploid GT (and PP) arrays of a record for
+ *        samples [begin, end) in a single pass and output :
+ *        - The compact list of het sample indices (alleles differ)
+ *        - Per het, if the PP is below threshold (NaN/missing are not)
+ *        - The number of alt (allele 1) alleles
+ *
+ *        The GT arrays are in BCF encoding, alleles are compared as
+ *        bcf_gt_allele() does, i.e., (gt >> 1) - 1, ignoring the phase bit.
+ *
+ *        The vectorized kernels are compiled with target attributes and
+ *        selected at runtime given the CPU, so no special flags are needed.
+ */
+namespace het_scan {
+
+/* Encoded allele 1 once the phase bit is shifted out, bcf_gt_allele(x) == 1 */
+constexpr int ALT_ALLELE_SHIFTED = 2;
+
+typedef size_t (*kernel_fn)(const int *gt, const float *pp, size_t begin, size_t end, float pp_threshold,
+                            uint32_t *het_idx, uint8_t *low_pp, size_t *alt_count);
+
+template <bool EMIT_HETS, bool COUNT_ALT>
+static inline size_t scan_scalar_tail(const int *gt, const float *pp, size_t begin, size_t end, float pp_threshold,
+                                      uint32_t *het_idx, uint8_t *low_pp, size_t& n_hets, size_t& alt) {
+    for (size_t i = begin; i < end; ++i) {
+        const int a0 = gt[i*2] >> 1;
+        const int a1 = gt[i*2+1] >> 1;
+        if constexpr (COUNT_ALT) {
+            alt += (a0 == ALT_ALLELE_SHIFTED) + (a1 == ALT_ALLELE_SHIFTED);
+        }
+        if constexpr (EMIT_HETS) {
+            if (a0 != a1) {
+                het_idx[n_hets] = i;
+                /* Comparison is false for NaN (missing PP) */
+                low_pp[n_hets] = pp ? (pp[i] < pp_threshold) : 0;
+                n_hets++;
+            }
+        }
+    }
+    return n_hets;
+}
+
+template <bool EMIT_HETS, bool COUNT_ALT>
+static size_t scan_scalar(const int *gt, const float *pp, size_t begin, size_t end, float pp_threshold,
+                          uint32_t *het_idx, uint8_t *low_pp, size_t *alt_count) {
+    size_t n_hets = 0;
+    size_t alt = 0;
+    scan_scalar_tail<EMIT_HETS, COUNT_ALT>(gt, pp, begin, end, pp_threshold, het_idx, low_pp, n_hets, alt);
+    if constexpr (COUNT_ALT) {
+        *alt_count = alt;
+    }
+    return n_hets;
+}
+
+#if HET_SCAN_X86
+/* 4 samples per iteration, SSE2 de-interleave and compares, popcount for alt alleles */
+template <bool EMIT_HETS, bool COUNT_ALT>
+__attribute__((target("sse4.2,popcnt")))
+static size_t scan_sse42(const int *gt, const float *pp, size_t begin, size_t end, float pp_threshold,
+                         uint32_t *het_idx, uint8_t *low_pp, size_t *alt_count) {
+    size_t n_hets = 0;
+    size_t alt = 0;
+    const __m128i alt_allele = _mm_set1_epi32(ALT_ALLELE_SHIFTED);
+    const __m128 threshold = _mm_set1_ps(pp_threshold);
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        const __m128 g0 = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)(gt + i*2)));
+        const __m128 g1 = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)(gt + i*2 + 4)));
+        /* First and second alleles of samples i..i+3 */
+        const __m128i a0 = _mm_srai_epi32(_mm_castps_si128(_mm_shuffle_ps(g0, g1, _MM_SHUFFLE(2, 0, 2, 0))), 1);
+        const __m128i a1 = _mm_srai_epi32(_mm_castps_si128(_mm_shuffle_ps(g0, g1, _MM_SHUFFLE(3, 1, 3, 1))), 1);
+        if constexpr (COUNT_ALT) {
+            alt += _mm_popcnt_u32(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(a0, alt_allele))));
+            alt += _mm_popcnt_u32(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(a1, alt_allele))));
+        }
+        if constexpr (EMIT_HETS) {
+            uint32_t hets = ~_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(a0, a1))) & 0xf;
+            if (hets) {
+                /* Ordered compare, false for NaN (missing PP) */
+                const uint32_t low = pp ? _mm_movemask_ps(_mm_cmplt_ps(_mm_loadu_ps(pp + i), threshold)) : 0;
+                while (hets) {
+                    const uint32_t b = __builtin_ctz(hets);
+                    het_idx[n_hets] = i + b;
+                    low_pp[n_hets] = (low >> b) & 1;
+                    n_hets++;
+                    hets &= hets - 1;
+                }
+            }
+        }
+    }
+    scan_scalar_tail<EMIT_HETS, COUNT_ALT>(gt, pp, i, end, pp_threshold, het_idx, low_pp, n_hets, alt);
+    if constexpr (COUNT_ALT) {
+        *alt_count = alt;
+    }
+    return n_hets;
+}
+
+/* 8 samples per iteration */
+template <bool EMIT_HETS, bool COUNT_ALT>
+__attribute__((target("avx2,popcnt")))
+static size_t scan_avx2(const int *gt, const float *pp, size_t begin, size_t end, float pp_threshold,
+                        uint32_t *het_idx, uint8_t *low_pp, size_t *alt_count) {
+    size_t n_hets = 0;
+    size_t alt = 0;
+    const __m256i alt_allele = _mm256_set1_epi32(ALT_ALLELE_SHIFTED);
+    const __m256 threshold = _mm256_set1_ps(pp_threshold);
+    size_t i = begin;
+    for (; i + 8 <= end; i += 8) {
+        const __m256 g0 = _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i*)(gt + i*2)));
+        const __m256 g1 = _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i*)(gt + i*2 + 8)));
+        /* The in-lane shuffle gives samples in order 0,1,4,5,2,3,6,7 the permute restores 0..7 */
+        const __m256i a0 = _mm256_srai_epi32(_mm256_permute4x64_epi64(
+            _mm256_castps_si256(_mm256_shuffle_ps(g0, g1, _MM_SHUFFLE(2, 0, 2, 0))), _MM_SHUFFLE(3, 1, 2, 0)), 1);
+        const __m256i a1 = _mm256_srai_epi32(_mm256_permute4x64_epi64(
+            _mm256_castps_si256(_mm256_shuffle_ps(g0, g1, _MM_SHUFFLE(3, 1, 3, 1))), _MM_SHUFFLE(3, 1, 2, 0)), 1);
+        if constexpr (COUNT_ALT) {
+            alt += _mm_popcnt_u32(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(a0, alt_allele))));
+            alt += _mm_popcnt_u32(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(a1, alt_allele))));
+        }
+        if constexpr (EMIT_HETS) {
+            uint32_t hets = ~_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(a0, a1))) & 0xff;
+            if (hets) {
+                /* Ordered non-signaling compare, false for NaN (missing PP) */
+                const uint32_t low = pp ? _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(pp + i), threshold, _CMP_LT_OQ)) : 0;
+                while (hets) {
+                    const uint32_t b = __builtin_ctz(hets);
+                    het_idx[n_hets] = i + b;
+                    low_pp[n_hets] = (low >> b) & 1;
+                    n_hets++;
+                    hets &= hets - 1;
+                }
+            }
+        }
+    }
+    scan_scalar_tail<EMIT_HETS, COUNT_ALT>(gt, pp, i, end, pp_threshold, het_idx, low_pp, n_hets, alt);
+    if constexpr (COUNT_ALT) {
+        *alt_count = alt;
+    }
+    return n_hets;
+}
+#endif
+
+enum class Isa { SCALAR, SSE42, AVX2 };
+
+static inline Isa best_isa() {
+#if HET_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return Isa::AVX2;
+    }
+    if (__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt")) {
+        return Isa::SSE42;
+    }
+#endif
+    return Isa::SCALAR;
+}
+
+template <bool EMIT_HETS, bool COUNT_ALT>
+static inline kernel_fn select_kernel(Isa isa) {
+#if HET_SCAN_X86
+    switch (isa) {
+        case Isa::AVX2: return scan_avx2<EMIT_HETS, COUNT_ALT>;
+        case Isa::SSE42: return scan_sse42<EMIT_HETS, COUNT_ALT>;
+        default: break;
+    }
+#endif
+    return scan_scalar<EMIT_HETS, COUNT_ALT>;
+}
+
+static inline const char* isa_name(Isa isa) {
+    switch (isa) {
+        case Isa::AVX2: return "AVX2";
+        case Isa::SSE42: return "SSE4.2";
+        default: return "scalar";
+    }
+}
+
+} /* namespace het_scan */
+
+/**
+ * @brief Holds the output buffers of the het scan kernels and the kernels
+ *        selected for the CPU, one per thread
+ */
+class HetScanner {
+public:
+    HetScanner() : HetScanner(het_scan::best_isa()) {}
+    HetScanner(het_scan::Isa isa) :
+        isa(isa),
+        scan_hets(het_scan::select_kernel<true, false>(isa)),
+        scan_hets_count_alt(het_scan::select_kernel<true, true>(isa)),
+        count_alt(het_scan::select_kernel<false, true>(isa)) {}
+
+    /* Scans samples [begin, end), pp can be NULL (no low PP flags), alt alleles are counted if requested */
+    void scan(const int *gt, const float *pp, size_t begin, size_t end, float pp_threshold, bool with_alt_count) {
+        const size_t n = end > begin ? end - begin : 0;
+        if (het_idx.size() < n) {
+            het_idx.resize(n);
+            low_pp.resize(n);
+        }
+        alt_count = 0;
+        if (with_alt_count) {
+            n_hets = scan_hets_count_alt(gt, pp, begin, end, pp_threshold, het_idx.data(), low_pp.data(), &alt_count);
+        } else {
+            n_hets = scan_hets(gt, pp, begin, end, pp_threshold, het_idx.data(), low_pp.data(), NULL);
+        }
+    }
+
+    /* Scans only the listed samples (sorted) in [begin, end), the others are homozygous reference,
+     * e.g., the carriers of a sparse record, so the cost is the one of the carriers */
+    void scan_listed(const int *gt, const float *pp, const std::vector<uint32_t>& samples, size_t begin, size_t end, float pp_threshold, bool with_alt_count) {
+        const auto first = std::lower_bound(samples.begin(), samples.end(), begin);
+        const auto last = std::lower_bound(first, samples.end(), end);
+        if (het_idx.size() < size_t(last - first)) {
+            het_idx.resize(last - first);
+            low_pp.resize(last - first);
+        }
+        n_hets = 0;
+        alt_count = 0;
+        for (auto it = first; it != last; ++it) {
+            const size_t i = *it;
+            const int a0 = gt[i*2] >> 1;
+            const int a1 = gt[i*2+1] >> 1;
+            if (with_alt_count) {
+                alt_count += (a0 == het_scan::ALT_ALLELE_SHIFTED) + (a1 == het_scan::ALT_ALLELE_SHIFTED);
+            }
+            if (a0 != a1) {
+                het_idx[n_hets] = i;
+                /* Comparison is false for NaN (missing PP) */
+                low_pp[n_hets] = pp ? (pp[i] < pp_threshold) : 0;
+                n_hets++;
+            }
+        }
+    }
+
+    /* Het samples of another scan of the same record, with the low PP flags of another threshold */
+    void rethreshold(const HetScanner& scanned, const float *pp, float pp_threshold) {
+        n_hets = scanned.n_hets;
+        alt_count = scanned.alt_count;
+        if (het_idx.size() < n_hets) {
+            het_idx.resize(n_hets);
+            low_pp.resize(n_hets);
+        }
+        std::copy(scanned.het_idx.begin(), scanned.het_idx.begin() + n_hets, het_idx.begin());
+        for (size_t k = 0; k < n_hets; ++k) {
+            /* Comparison is false for NaN (missing PP) */
+            low_pp[k] = pp ? (pp[het_idx[k]] < pp_threshold) : 0;
+        }
+    }
+
+    /* Only counts the alt alleles of samples [begin, end) */
+    size_t count_alt_alleles(const int *gt, size_t begin, size_t end) const {
+        size_t alt = 0;
+        count_alt(gt, NULL, begin, end, 0.0, NULL, NULL, &alt);
+        return alt;
+    }
+
+    const het_scan::Isa isa;
+    std::vector<uint32_t> het_idx;
+    std::vector<uint8_t> low_pp;
+    size_t n_hets = 0;
+    size_t alt_count = 0;
+
+protected:
+    het_scan::kernel_fn scan_hets;
+    het_scan::kernel_fn scan_hets_count_alt;
+    het_scan::kernel_fn count_alt;
+};
+
+#endif /* __HET_SCAN_HPP__ */
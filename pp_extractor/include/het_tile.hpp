@@ -0,0 +1,144 @@
+#ifndef __HET_TILE_HPP__
+#define __HET_TILE_HPP__
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "het_info.hpp"
+
+/**
+ * @brief Tile of up to L records by the samples of an extraction range, holds
+ *        the het sites of the records compactly in record order (variant
+ *        major). The tile is transposed in blocks of S samples, so that the
+ *        het sites are handed over sample by sample (sample major) with the
+ *        per sample state (FIFO, counters) of a block staying in cache.
+ *        The position of each record is given with the het sites.
+ */
+class HetTile {
+public:
+    static constexpr uint8_t LOW_PP = 1;
+    static constexpr uint8_t NON_SNP = 2;
+
+    HetTile(size_t max_records, size_t block_samples, size_t begin, size_t end) :
+        max_records(std::max(max_records, size_t(1))),
+        block_samples(std::max(block_samples, size_t(1))),
+        begin(begin),
+        end(end) {
+        record_begin.reserve(this->max_records + 1);
+        record_positions.reserve(this->max_records);
+        record_begin.push_back(0);
+        block_counts.resize(this->block_samples + 1);
+    }
+
+    /* Adds a het site of the current record, samples must be given in increasing order */
+    inline void put(const size_t sample, const HetInfo& hi, const bool low_pp, const bool non_snp) {
+        samples.push_back(sample);
+        hets.push_back(hi);
+        flags.push_back((low_pp ? LOW_PP : 0) | (non_snp ? NON_SNP : 0));
+    }
+
+    /* Closes the current record at the given position, returns true if the tile is full */
+    bool end_record(const uint64_t position = 0) {
+        record_begin.push_back(samples.size());
+        record_positions.push_back(position);
+        return n_records() == max_records;
+    }
+
+    size_t n_records() const {
+        return record_begin.size() - 1;
+    }
+
+    /**
+     * @brief Transposes the tile and calls f(sample, hets, flags, positions, n)
+     *        for each sample with het sites, in sample order, the hets of a
+     *        sample are in record order. The tile is emptied.
+     */
+    template <typename F>
+    void transpose(F f) {
+        const size_t n_rec = n_records();
+        cursors.assign(record_begin.begin(), record_begin.end() - 1);
+        for (size_t block_start = begin; block_start < end; block_start += block_samples) {
+            const size_t block_end = std::min(block_start + block_samples, end);
+            const size_t block_size = block_end - block_start;
+
+            /* Count the het sites per sample of the block */
+            std::fill(block_counts.begin(), block_counts.begin() + block_size + 1, 0);
+            size_t total = 0;
+            for (size_t r = 0; r < n_rec; ++r) {
+                size_t c = cursors[r];
+                const size_t c_end = record_begin[r+1];
+                while (c < c_end && samples[c] < block_end) {
+                    block_counts[samples[c] - block_start + 1]++;
+                    c++;
+                }
+                total += c - cursors[r];
+            }
+            if (!total) {
+                continue;
+            }
+
+            /* Offsets per sample */
+            for (size_t i = 0; i < block_size; ++i) {
+                block_counts[i+1] += block_counts[i];
+            }
+            transposed_hets.resize(total);
+            transposed_flags.resize(total);
+            transposed_positions.resize(total);
+
+            /* Scatter, records in order so that the hets of a sample stay in record order */
+            for (size_t r = 0; r < n_rec; ++r) {
+                size_t c = cursors[r];
+                const size_t c_end = record_begin[r+1];
+                while (c < c_end && samples[c] < block_end) {
+                    const size_t pos = block_counts[samples[c] - block_start]++;
+                    transposed_hets[pos] = hets[c];
+                    transposed_flags[pos] = flags[c];
+                    transposed_positions[pos] = record_positions[r];
+                    c++;
+                }
+                cursors[r] = c;
+            }
+
+            /* The counts are now the end offsets of each sample */
+            size_t pos = 0;
+            for (size_t i = 0; i < block_size; ++i) {
+                const size_t n = block_counts[i] - pos;
+                if (n) {
+                    f(block_start + i, &transposed_hets[pos], &transposed_flags[pos], &transposed_positions[pos], n);
+                }
+                pos = block_counts[i];
+            }
+        }
+        clear();
+    }
+
+    void clear() {
+        samples.clear();
+        hets.clear();
+        flags.clear();
+        record_begin.resize(1);
+        record_positions.clear();
+    }
+
+    const size_t max_records;
+    const size_t block_samples;
+    const size_t begin;
+    const size_t end;
+
+protected:
+    /* Het sites in record order */
+    std::vector<uint32_t> samples;
+    std::vector<HetInfo> hets;
+    std::vector<uint8_t> flags;
+    std::vector<size_t> record_begin;
+    std::vector<uint64_t> record_positions;
+
+    /* Transposition of a block */
+    std::vector<size_t> cursors;
+    std::vector<size_t> block_counts;
+    std::vector<HetInfo> transposed_hets;
+    std::vector<uint8_t> transposed_flags;
+    std::vector<uint64_t> transposed_positions;
+};
+
+#endif /* __HET_TILE_HPP__ */
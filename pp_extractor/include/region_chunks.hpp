@@ -0,0 +1,77 @@
+#ifndef __REGION_CHUNKS_HPP__
+#define __REGION_CHUNKS_HPP__
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "hts.h"
+#include "vcf.h"
+
+/* Genomic chunk of an indexed BCF, the records starting in [beg, end) (0 based) */
+class RegionChunk {
+public:
+    /* Largest position of a BCF record */
+    static constexpr hts_pos_t MAX_POS = INT32_MAX;
+
+    RegionChunk(const std::string& contig, hts_pos_t beg, hts_pos_t end) : contig(contig), beg(beg), end(end) {}
+
+    /* Region string for htslib (1 based, inclusive), the records overlapping it are returned */
+    std::string to_region() const {
+        return contig + ":" + std::to_string(beg + 1) + "-" + std::to_string(end);
+    }
+
+    bool contains(const bcf1_t *line) const {
+        return line->pos >= beg && line->pos < end;
+    }
+
+    std::string contig;
+    hts_pos_t beg;
+    hts_pos_t end;
+};
+
+/**
+ * @brief Splits the contigs with records of an indexed BCF in chunks_per_contig
+ *        chunks of equal length (from the contig length in the header, a single
+ *        chunk if it is missing). The chunks are in the order of the contigs in
+ *        the index, which must be the order of the contigs in the file.
+ */
+inline std::vector<RegionChunk> plan_region_chunks(const std::string& filename, const size_t chunks_per_contig) {
+    htsFile *fp = hts_open(filename.c_str(), "r");
+    if (!fp) {
+        std::cerr << "Failed to open file : " << filename << std::endl;
+        throw "Failed to open file";
+    }
+    bcf_hdr_t *hdr = bcf_hdr_read(fp);
+    hts_idx_t *idx = bcf_index_load(filename.c_str());
+    if (!hdr || !idx) {
+        std::cerr << "Could not load the index of " << filename << ", an indexed BCF is required (bcftools index)" << std::endl;
+        if (hdr) {
+            bcf_hdr_destroy(hdr);
+        }
+        hts_close(fp);
+        throw "Index required";
+    }
+
+    std::vector<RegionChunk> chunks;
+    int n_contigs = 0;
+    const char **contigs = bcf_index_seqnames(idx, hdr, &n_contigs);
+    for (int c = 0; c < n_contigs; ++c) {
+        const int rid = bcf_hdr_name2id(hdr, contigs[c]);
+        const hts_pos_t length = (rid >= 0) ? hdr->id[BCF_DT_CTG][rid].val->info[0] : 0;
+        const size_t n_chunks = length ? std::max(size_t(1), chunks_per_contig) : 1;
+        for (size_t i = 0; i < n_chunks; ++i) {
+            const hts_pos_t beg = (length * i) / n_chunks;
+            // Records past the length in the header belong to the last chunk
+            const hts_pos_t end = (i == n_chunks - 1) ? RegionChunk::MAX_POS : (length * (i + 1)) / n_chunks;
+            chunks.emplace_back(contigs[c], beg, end);
+        }
+    }
+    free(contigs);
+    hts_idx_destroy(idx);
+    bcf_hdr_destroy(hdr);
+    hts_close(fp);
+    return chunks;
+}
+
+#endif /* __REGION_CHUNKS_HPP__ */
@@ -0,0 +1,167 @@
+#ifndef __REGION_FINGERPRINTS_HPP__
+#define __REGION_FINGERPRINTS_HPP__
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "vcf.h"
+
+/* Records of a region (bin of region_size bp of a contig), VCF line of the first one and hash of their data */
+class RegionFingerprint {
+public:
+    std::string contig;
+    uint32_t bin = 0;
+    uint64_t first_line = 0;
+    uint64_t n_records = 0;
+    uint64_t hash = 0;
+
+    uint64_t end_line() const {
+        return first_line + n_records;
+    }
+
+    std::string key() const {
+        return contig + ":" + std::to_string(bin);
+    }
+
+    bool same_records(const RegionFingerprint& other) const {
+        return n_records == other.n_records && hash == other.hash;
+    }
+};
+
+/**
+ * @brief Fingerprints of the regions of an extracted VCF/BCF and of the
+ *        extraction parameters. They are saved next to the binary file so
+ *        that when the VCF/BCF is regenerated only the regions that changed
+ *        are extracted again (see PPExtractTraversal::traverse_update_no_destroy).
+ *
+ *        Text file : a version line, the region size, the parameters hash,
+ *        then one region per line (contig, bin, first line, number of
+ *        records, hash of the records), in the order of the VCF/BCF.
+ */
+class RegionFingerprints {
+public:
+    static constexpr const char* VERSION_LINE = "pp_extract region fingerprints v1";
+    static constexpr const char* SUFFIX = ".fp";
+    static constexpr uint32_t DEFAULT_REGION_SIZE = 1000000;
+
+    static std::string default_filename(const std::string& binary_filename) {
+        return binary_filename + SUFFIX;
+    }
+
+    RegionFingerprints(const uint32_t region_size = DEFAULT_REGION_SIZE, const uint64_t parameters_hash = 0) :
+        region_size(region_size ? region_size : DEFAULT_REGION_SIZE),
+        parameters_hash(parameters_hash) {}
+
+    /* FNV-1a like hash by 64-bit words (the record data is large), the tail bytes are added one by one */
+    static uint64_t hash_bytes(uint64_t h, const void *data, const size_t n) {
+        const char *p = static_cast<const char*>(data);
+        size_t i = 0;
+        for (; i + sizeof(uint64_t) <= n; i += sizeof(uint64_t)) {
+            uint64_t w;
+            memcpy(&w, p + i, sizeof(w));
+            h ^= w;
+            h *= 0x100000001b3ULL;
+            h ^= h >> 29;
+        }
+        for (; i < n; ++i) {
+            h ^= (uint8_t)p[i];
+            h *= 0x100000001b3ULL;
+        }
+        return h;
+    }
+
+    static uint64_t hash_string(const std::string& s) {
+        return hash_bytes(0xcbf29ce484222325ULL, s.data(), s.size());
+    }
+
+    /**
+     * @brief Adds a record at the given VCF line, the hash covers its position
+     *        and its raw data (INFO, FORMAT and sample fields as read). The
+     *        records must be sorted, the regions follow the order of the file.
+     */
+    void add_record(const bcf_hdr_t *hdr, const bcf1_t *line, const uint64_t vcf_line) {
+        const uint32_t bin = line->pos / region_size;
+        if (regions.empty() || regions.back().bin != bin || line->rid != last_rid) {
+            RegionFingerprint fp;
+            fp.contig = bcf_hdr_id2name(hdr, line->rid);
+            fp.bin = bin;
+            fp.first_line = vcf_line;
+            fp.hash = 0xcbf29ce484222325ULL;
+            if (!region_index.emplace(fp.key(), regions.size()).second) {
+                std::cerr << "Records of region " << fp.key() << " are not contiguous, the VCF/BCF should be sorted" << std::endl;
+                throw "Unsorted records";
+            }
+            regions.push_back(fp);
+            last_rid = line->rid;
+        }
+        auto& fp = regions.back();
+        const int64_t pos = line->pos;
+        fp.hash = hash_bytes(fp.hash, &pos, sizeof(pos));
+        fp.hash = hash_bytes(fp.hash, line->shared.s, line->shared.l);
+        fp.hash = hash_bytes(fp.hash, line->indiv.s, line->indiv.l);
+        fp.n_records++;
+    }
+
+    uint64_t number_of_records() const {
+        return regions.empty() ? 0 : regions.back().end_line() - regions.front().first_line;
+    }
+
+    /* Index of the region with the same contig and bin, -1 if there is none */
+    int64_t find(const RegionFingerprint& fp) const {
+        auto it = region_index.find(fp.key());
+        return it == region_index.end() ? -1 : it->second;
+    }
+
+    void save(const std::string& filename) const {
+        std::ofstream ofs(filename);
+        if (!ofs.is_open()) {
+            std::cerr << "Cannot open file " << filename << std::endl;
+            throw "Cannot open file";
+        }
+        ofs << VERSION_LINE << "\n" << region_size << "\n" << std::hex << parameters_hash << std::dec << "\n";
+        for (const auto& fp : regions) {
+            ofs << fp.contig << "\t" << fp.bin << "\t" << fp.first_line << "\t" << fp.n_records << "\t"
+                << std::hex << fp.hash << std::dec << "\n";
+        }
+    }
+
+    static RegionFingerprints load(const std::string& filename) {
+        std::ifstream ifs(filename);
+        if (!ifs.is_open()) {
+            std::cerr << "Cannot open the fingerprints file " << filename << std::endl;
+            throw "Cannot open file";
+        }
+        std::string line;
+        std::getline(ifs, line);
+        if (line != VERSION_LINE) {
+            std::cerr << "File " << filename << " is not a fingerprints file" << std::endl;
+            throw "Wrong fingerprints file";
+        }
+        uint32_t region_size = 0;
+        uint64_t parameters_hash = 0;
+        ifs >> region_size >> std::hex >> parameters_hash >> std::dec;
+        RegionFingerprints fps(region_size, parameters_hash);
+        RegionFingerprint fp;
+        while (ifs >> fp.contig >> fp.bin >> fp.first_line >> fp.n_records >> std::hex >> fp.hash >> std::dec) {
+            fps.region_index.emplace(fp.key(), fps.regions.size());
+            fps.regions.push_back(fp);
+        }
+        return fps;
+    }
+
+    uint32_t region_size;
+    uint64_t parameters_hash;
+    std::vector<RegionFingerprint> regions;
+
+protected:
+    std::unordered_map<std::string, size_t> region_index;
+    int32_t last_rid = -1;
+};
+
+#endif /* __REGION_FINGERPRINTS_HPP__ */
@@ -0,0 +1,456 @@
+#ifndef __SELECTION_HPP__
+#define __SELECTION_HPP__
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "vcf.h"
+
+/* Values of a record the selection expressions can use, see SelectionExpression */
+class SelectionRecord {
+public:
+    enum Field : uint8_t { AF, MAF, AC, AN, POS, SNP, INDEL, PP, NUM_FIELDS };
+
+    static bool is_float(const Field field) {
+        return field == AF || field == MAF || field == PP;
+    }
+
+    double values[NUM_FIELDS] = {};
+    /* Result of the expression when it only uses record fields */
+    bool selected = false;
+    bool in_regions = true;
+};
+
+/**
+ * @brief Selection expression on the het sites, e.g., "AF<0.01 && SNP" or
+ *        "PP<0.9 || AC<=2", compiled once into a postfix program.
+ *
+ *        Fields : AF, MAF, AC, AN (INFO fields, computed from the genotypes
+ *        if missing), POS (1 based), SNP, INDEL (flags) and PP (FORMAT/PP of
+ *        the sample). Operators : < <= > >= == != && || ! and parentheses.
+ */
+class SelectionExpression {
+public:
+    SelectionExpression(const std::string& expression) : expression(expression) {
+        pos = 0;
+        parse_or();
+        skip_spaces();
+        if (pos != expression.size()) {
+            error("unexpected character");
+        }
+        for (const auto& op : program) {
+            if (op.code == PUSH_FIELD && op.field == SelectionRecord::PP) {
+                uses_sample_fields = true;
+            }
+        }
+    }
+
+    /* Evaluates the expression, the PP of the sample is given separately */
+    bool evaluate(const SelectionRecord& record, const float pp = NAN) const {
+        double stack[MAX_STACK];
+        size_t top = 0;
+        for (const auto& op : program) {
+            switch (op.code) {
+                case PUSH_CONST: stack[top++] = op.value; break;
+                case PUSH_FIELD: stack[top++] = (op.field == SelectionRecord::PP) ? pp : record.values[op.field]; break;
+                case NOT: stack[top-1] = !stack[top-1]; break;
+                default: {
+                    const double b = stack[--top];
+                    const double a = stack[top-1];
+                    stack[top-1] = apply(op.code, a, b);
+                }
+            }
+        }
+        return stack[0] != 0;
+    }
+
+    const std::string expression;
+    /* The expression uses PP, it has to be evaluated for each het site */
+    bool uses_sample_fields = false;
+
+protected:
+    enum OpCode : uint8_t { PUSH_CONST, PUSH_FIELD, NOT, LT, LE, GT, GE, EQ, NE, AND, OR };
+
+    class Op {
+    public:
+        OpCode code;
+        SelectionRecord::Field field;
+        double value;
+    };
+
+    static constexpr size_t MAX_STACK = 64;
+
+    static double apply(const OpCode code, const double a, const double b) {
+        switch (code) {
+            case LT: return a < b;
+            case LE: return a <= b;
+            case GT: return a > b;
+            case GE: return a >= b;
+            case EQ: return a == b;
+            case NE: return a != b;
+            case AND: return (a != 0) && (b != 0);
+            case OR: return (a != 0) || (b != 0);
+            default: return 0;
+        }
+    }
+
+    void emit(const OpCode code, const SelectionRecord::Field field = SelectionRecord::NUM_FIELDS, const double value = 0) {
+        program.push_back({code, field, value});
+        depth += (code == PUSH_CONST || code == PUSH_FIELD) ? 1 : (code == NOT) ? 0 : -1;
+        if (depth >= MAX_STACK) {
+            error("expression too deep");
+        }
+    }
+
+    void skip_spaces() {
+        while (pos < expression.size() && std::isspace((unsigned char)expression[pos])) {
+            pos++;
+        }
+    }
+
+    bool accept(const char *token) {
+        skip_spaces();
+        const size_t n = strlen(token);
+        if (expression.compare(pos, n, token) == 0) {
+            pos += n;
+            return true;
+        }
+        return false;
+    }
+
+    void parse_or() {
+        parse_and();
+        while (accept("||") || accept("|")) {
+            parse_and();
+            emit(OR);
+        }
+    }
+
+    void parse_and() {
+        parse_unary();
+        while (accept("&&") || accept("&")) {
+            parse_unary();
+            emit(AND);
+        }
+    }
+
+    void parse_unary() {
+        if (accept("!=")) {
+            error("unexpected operator");
+        }
+        if (accept("!")) {
+            parse_unary();
+            emit(NOT);
+            return;
+        }
+        if (accept("(")) {
+            parse_or();
+            if (!accept(")")) {
+                error("missing closing parenthesis");
+            }
+            return;
+        }
+        parse_comparison();
+    }
+
+    void parse_comparison() {
+        parse_value();
+        static const std::pair<const char*, OpCode> comparisons[] = {
+            {"<=", LE}, {">=", GE}, {"==", EQ}, {"!=", NE}, {"<", LT}, {">", GT}, {"=", EQ}
+        };
+        for (const auto& c : comparisons) {
+            if (accept(c.first)) {
+                parse_value();
+                // Fields stored as float are compared to the float of the constant, e.g., AF=0.01 is not below 0.01
+                Op& a = program[program.size() - 2];
+                Op& b = program.back();
+                if (a.code == PUSH_CONST && b.code == PUSH_FIELD && SelectionRecord::is_float(b.field)) {
+                    a.value = float(a.value);
+                }
+                if (b.code == PUSH_CONST && a.code == PUSH_FIELD && SelectionRecord::is_float(a.field)) {
+                    b.value = float(b.value);
+                }
+                emit(c.second);
+                return;
+            }
+        }
+    }
+
+    void parse_value() {
+        skip_spaces();
+        const char *begin = expression.c_str() + pos;
+        char *end = NULL;
+        const double value = strtod(begin, &end);
+        if (end != begin && (std::isdigit((unsigned char)*begin) || *begin == '.' || *begin == '-')) {
+            pos += end - begin;
+            emit(PUSH_CONST, SelectionRecord::NUM_FIELDS, value);
+            return;
+        }
+
+        size_t name_end = pos;
+        while (name_end < expression.size() &&
+               (std::isalnum((unsigned char)expression[name_end]) || expression[name_end] == '_' || expression[name_end] == '/')) {
+            name_end++;
+        }
+        std::string name = expression.substr(pos, name_end - pos);
+        for (const char *prefix : {"INFO/", "FORMAT/", "FMT/"}) {
+            if (name.rfind(prefix, 0) == 0) {
+                name = name.substr(strlen(prefix));
+            }
+        }
+        static const std::pair<const char*, SelectionRecord::Field> fields[] = {
+            {"AF", SelectionRecord::AF}, {"MAF", SelectionRecord::MAF}, {"AC", SelectionRecord::AC},
+            {"AN", SelectionRecord::AN}, {"POS", SelectionRecord::POS}, {"SNP", SelectionRecord::SNP},
+            {"INDEL", SelectionRecord::INDEL}, {"PP", SelectionRecord::PP}
+        };
+        for (const auto& f : fields) {
+            if (name == f.first) {
+                pos = name_end;
+                emit(PUSH_FIELD, f.second);
+                return;
+            }
+        }
+        error(name.empty() ? "expected a value" : "unknown field " + name);
+    }
+
+    void error(const std::string& message) const {
+        std::cerr << "Error in selection expression \"" << expression << "\" at position " << pos << " : " << message << std::endl;
+        throw "Bad selection expression";
+    }
+
+    size_t pos = 0;
+    size_t depth = 0;
+    std::vector<Op> program;
+};
+
+/**
+ * @brief Selection of the het sites to rephase : an expression, and optionally
+ *        a list of samples and a list of regions. Selected het sites are
+ *        extracted as if they had a low PP, the others as if phased.
+ */
+class GenotypeSelection {
+public:
+    GenotypeSelection(const std::string& expression) {
+        if (!expression.empty()) {
+            this->expression = std::make_unique<SelectionExpression>(expression);
+        }
+    }
+
+    /* Samples from a file (one per line) or a comma separated list */
+    void set_samples(const std::string& samples) {
+        sample_names.clear();
+        for (const auto& s : read_list(samples)) {
+            sample_names.insert(s);
+        }
+        use_samples = true;
+    }
+
+    /* Regions from a file (CHROM, BEG, END, tab separated, 1 based inclusive) or a comma separated list (CHROM:BEG-END or CHROM) */
+    void set_regions(const std::string& regions) {
+        this->regions.clear();
+        for (auto r : read_list(regions)) {
+            std::replace(r.begin(), r.end(), '\t', ' ');
+            std::string contig = r;
+            hts_pos_t beg = 1;
+            hts_pos_t end = INT64_MAX;
+            std::istringstream iss(r);
+            if (r.find(' ') != std::string::npos) {
+                if (!(iss >> contig >> beg >> end)) {
+                    region_error(r);
+                }
+            } else if (r.rfind(':') != std::string::npos) {
+                const size_t colon = r.rfind(':');
+                const size_t dash = r.find('-', colon);
+                contig = r.substr(0, colon);
+                try {
+                    beg = std::stoll(r.substr(colon + 1, dash - colon - 1));
+                    if (dash != std::string::npos) {
+                        end = std::stoll(r.substr(dash + 1));
+                    }
+                } catch (...) {
+                    region_error(r);
+                }
+            }
+            this->regions[contig].push_back({beg, end});
+        }
+        for (auto& r : this->regions) {
+            std::sort(r.second.begin(), r.second.end());
+        }
+        use_regions = true;
+    }
+
+    /* Maps the sample list to the samples of the header */
+    void set_header(const bcf_hdr_t *hdr) {
+        std::vector<std::string> input_samples;
+        for (int i = 0; i < bcf_hdr_nsamples(hdr); ++i) {
+            input_samples.push_back(hdr->samples[i]);
+        }
+        set_samples(input_samples);
+    }
+
+    /* Maps the sample list to the samples of the input given by name (e.g., the ones of an XSI file) */
+    void set_samples(const std::vector<std::string>& input_samples) {
+        sample_mask.assign(input_samples.size(), !use_samples);
+        size_t found = 0;
+        if (use_samples) {
+            for (size_t i = 0; i < sample_mask.size(); ++i) {
+                if (sample_names.count(input_samples[i])) {
+                    sample_mask[i] = 1;
+                    found++;
+                }
+            }
+            if (found != sample_names.size()) {
+                std::cerr << "Warning " << sample_names.size() - found << " samples of the selection are not in the input" << std::endl;
+            }
+        }
+    }
+
+    /* Evaluates the record part of the selection, thread safe, if the carriers are given (sorted) the GT of the other samples are not read */
+    void begin_record(const bcf_hdr_t *hdr, bcf1_t *line, const int *gt_arr, const size_t n_samples, SelectionRecord& record,
+                      const std::vector<uint32_t> *carriers = NULL) const {
+        auto& v = record.values;
+        const bool non_snp = strlen(line->d.allele[0]) > 1 || strlen(line->d.allele[1]) > 1;
+        v[SelectionRecord::SNP] = !non_snp;
+        v[SelectionRecord::INDEL] = non_snp;
+        v[SelectionRecord::POS] = line->pos + 1;
+
+        int *pi = NULL;
+        int ni = 0;
+        float *pf = NULL;
+        int nf = 0;
+        int ac = -1;
+        int an = -1;
+        if (bcf_get_info_int32(hdr, line, "AC", &pi, &ni) > 0) {
+            ac = pi[0];
+        }
+        if (bcf_get_info_int32(hdr, line, "AN", &pi, &ni) > 0) {
+            an = pi[0];
+        }
+        if (ac < 0 || an < 0) {
+            // Count the alleles in the genotypes (diploid)
+            int gt_ac = 0;
+            int gt_an = 0;
+            auto count = [&](const size_t i) {
+                if (gt_arr[i] != bcf_int32_vector_end && !bcf_gt_is_missing(gt_arr[i])) {
+                    gt_an++;
+                    gt_ac += bcf_gt_allele(gt_arr[i]) > 0;
+                }
+            };
+            if (carriers) {
+                // The other samples are homozygous reference
+                gt_an = (n_samples - carriers->size()) * 2;
+                for (const auto s : *carriers) {
+                    count(s * 2);
+                    count(s * 2 + 1);
+                }
+            } else {
+                for (size_t i = 0; i < n_samples * 2; ++i) {
+                    count(i);
+                }
+            }
+            ac = (ac < 0) ? gt_ac : ac;
+            an = (an < 0) ? gt_an : an;
+        }
+        float af = (an > 0) ? float(ac) / an : 0.0f;
+        if (bcf_get_info_float(hdr, line, "AF", &pf, &nf) > 0 && !std::isnan(pf[0])) {
+            af = pf[0];
+        }
+        v[SelectionRecord::AC] = ac;
+        v[SelectionRecord::AN] = an;
+        v[SelectionRecord::AF] = af;
+        v[SelectionRecord::MAF] = std::min(af, 1.0f - af);
+        if (pi) {
+            free(pi);
+        }
+        if (pf) {
+            free(pf);
+        }
+
+        record.in_regions = !use_regions || in_regions(bcf_hdr_id2name(hdr, line->rid), line->pos + 1);
+        record.selected = record.in_regions && (!expression || (!expression->uses_sample_fields && expression->evaluate(record)));
+    }
+
+    /* Selection of the het site of a sample, after begin_record() */
+    bool select(const SelectionRecord& record, const size_t sample, const float pp) const {
+        if (!sample_mask[sample] || !record.in_regions) {
+            return false;
+        }
+        if (expression && expression->uses_sample_fields) {
+            return expression->evaluate(record, pp);
+        }
+        return record.selected;
+    }
+
+    std::string to_string() const {
+        std::string s = expression ? expression->expression : "all het sites";
+        if (use_samples) {
+            s += ", " + std::to_string(sample_names.size()) + " samples";
+        }
+        if (use_regions) {
+            s += ", regions on " + std::to_string(regions.size()) + " contigs";
+        }
+        return s;
+    }
+
+protected:
+    bool in_regions(const char *contig, const hts_pos_t pos) const {
+        auto it = regions.find(contig);
+        if (it == regions.end()) {
+            return false;
+        }
+        for (const auto& r : it->second) {
+            if (r.first > pos) {
+                break;
+            }
+            if (pos <= r.second) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static std::vector<std::string> read_list(const std::string& list) {
+        std::vector<std::string> items;
+        std::ifstream ifs(list);
+        std::string item;
+        if (ifs.is_open()) {
+            while (std::getline(ifs, item)) {
+                if (!item.empty() && item[0] != '#') {
+                    items.push_back(item);
+                }
+            }
+        } else {
+            std::istringstream iss(list);
+            while (std::getline(iss, item, ',')) {
+                if (!item.empty()) {
+                    items.push_back(item);
+                }
+            }
+        }
+        return items;
+    }
+
+    static void region_error(const std::string& region) {
+        std::cerr << "Cannot parse selection region : " << region << std::endl;
+        throw "Bad selection region";
+    }
+
+    std::unique_ptr<SelectionExpression> expression;
+    bool use_samples = false;
+    std::unordered_set<std::string> sample_names;
+    std::vector<uint8_t> sample_mask;
+    bool use_regions = false;
+    std::map<std::string, std::vector<std::pair<hts_pos_t, hts_pos_t> > > regions;
+};
+
+#endif /* __SELECTION_HPP__ */
@@ -0,0 +1,89 @@
+#ifndef __SHARD_WORKERS_HPP__
+#define __SHARD_WORKERS_HPP__
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Fixed set of threads, each owning a shard (index), that all run the
+ *        same job when it is dispatched. Only one job is in flight at a time,
+ *        dispatching a new job waits for the previous one to be done, so the
+ *        caller can prepare the next job while the current one runs.
+ */
+class ShardWorkers {
+public:
+    ShardWorkers(size_t n_shards) : n_shards(n_shards), done(n_shards) {
+        for (size_t i = 0; i < n_shards; ++i) {
+            threads.emplace_back(&ShardWorkers::run, this, i);
+        }
+    }
+
+    ~ShardWorkers() {
+        {
+            std::unique_lock<std::mutex> lk(mutex);
+            cv_done.wait(lk, [&]{ return done == n_shards; });
+            stop = true;
+        }
+        cv_job.notify_all();
+        for (auto& t : threads) {
+            t.join();
+        }
+    }
+
+    size_t size() const {
+        return n_shards;
+    }
+
+    /* Waits for the previous job to finish and launches the given job on all shards */
+    void dispatch(std::function<void(size_t)> new_job) {
+        {
+            std::unique_lock<std::mutex> lk(mutex);
+            cv_done.wait(lk, [&]{ return done == n_shards; });
+            job = new_job;
+            done = 0;
+            generation++;
+        }
+        cv_job.notify_all();
+    }
+
+    /* Waits for the current job to finish on all shards */
+    void wait() {
+        std::unique_lock<std::mutex> lk(mutex);
+        cv_done.wait(lk, [&]{ return done == n_shards; });
+    }
+
+private:
+    void run(size_t shard) {
+        size_t seen_generation = 0;
+        std::unique_lock<std::mutex> lk(mutex);
+        while (true) {
+            cv_job.wait(lk, [&]{ return stop || generation != seen_generation; });
+            if (stop) {
+                return;
+            }
+            seen_generation = generation;
+            auto current_job = job;
+            lk.unlock();
+            current_job(shard);
+            lk.lock();
+            if (++done == n_shards) {
+                cv_done.notify_all();
+            }
+        }
+    }
+
+    const size_t n_shards;
+    size_t done;
+    size_t generation = 0;
+    bool stop = false;
+    std::function<void(size_t)> job;
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable cv_job;
+    std::condition_variable cv_done;
+};
+
+#endif /* __SHARD_WORKERS_HPP__ */
@@ -0,0 +1,228 @@
+#ifndef __SPILL_HPP__
+#define __SPILL_HPP__
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "het_info.hpp"
+#include "fs.hpp"
+
+/**
+ * @brief Spills the kept het infos of the samples to run files in a temporary
+ *        directory so that the memory used by the extraction stays bounded.
+ *
+ *        A run holds, for each sample in order, the number of het infos and
+ *        the het infos kept since the previous run. Since the records are
+ *        extracted in order, the het infos of a sample are the concatenation
+ *        of its het infos in each run (in run order) and the ones still in
+ *        memory, so merging is streamed sample by sample from all the runs.
+ *
+ *        The runs are merged as in a log-structured merge : when the last
+ *        MERGE_RUNS runs have the same level they are merged into a single
+ *        run of the next level, so every spilled het info is rewritten once
+ *        per level (logarithmic in the number of spills) and there are at
+ *        most MERGE_RUNS - 1 runs per level open for the final merge.
+ *
+ *        Run file : uint32_t number of samples, then per sample a uint32_t
+ *        number of het infos followed by the het infos (HetInfo[]).
+ */
+class HetInfoSpiller {
+public:
+    /* Number of runs of the same level merged into a run of the next level, limits the number of open files */
+    static constexpr size_t MERGE_RUNS = 16;
+
+    HetInfoSpiller(const std::string& parent_dir, const size_t n_samples) :
+        n_samples(n_samples),
+        spilled_per_sample(n_samples, 0) {
+        static_assert(sizeof(HetInfo) == 4 * sizeof(uint32_t), "HetInfo is written as is");
+        std::string dir_template = (fs::path(parent_dir) / "pp_extract_spill_XXXXXX").string();
+        if (!mkdtemp(dir_template.data())) {
+            std::cerr << "Cannot create temporary directory in " << parent_dir << std::endl;
+            throw "Cannot create temporary directory";
+        }
+        dir = dir_template;
+    }
+
+    HetInfoSpiller(const HetInfoSpiller&) = delete;
+    HetInfoSpiller& operator=(const HetInfoSpiller&) = delete;
+
+    ~HetInfoSpiller() {
+        readers.clear();
+        std::error_code ec;
+        fs::remove_all(dir, ec);
+    }
+
+    /* Writes a run with the het infos given by get_items(sample) for all the samples */
+    template <typename GetItems>
+    void spill(GetItems get_items) {
+        const std::string filename = new_run_filename();
+        std::fstream ofs(filename, std::ios_base::binary | std::ios_base::out | std::ios_base::trunc);
+        if (!ofs.is_open()) {
+            std::cerr << "Cannot open file " << filename << std::endl;
+            throw "Cannot open spill file";
+        }
+        write_u32(ofs, n_samples);
+        for (size_t i = 0; i < n_samples; ++i) {
+            const std::vector<HetInfo>& items = get_items(i);
+            write_u32(ofs, items.size());
+            ofs.write(reinterpret_cast<const char*>(items.data()), items.size() * sizeof(HetInfo));
+            spilled_per_sample[i] += items.size();
+            total_spilled += items.size();
+        }
+        ofs.close();
+        if (ofs.fail()) {
+            std::cerr << "Failed to write spill file " << filename << std::endl;
+            throw "Failed to write spill file";
+        }
+        runs.push_back({filename, 0});
+        while (runs.size() >= MERGE_RUNS && runs[runs.size() - MERGE_RUNS].level == runs.back().level) {
+            merge_last_runs();
+        }
+    }
+
+    size_t n_runs() const {
+        return runs.size();
+    }
+
+    size_t spilled(const size_t sample) const {
+        return spilled_per_sample[sample];
+    }
+
+    size_t get_total_spilled() const {
+        return total_spilled;
+    }
+
+    /* Opens the runs for a merge, the spilled het infos are then copied sample by sample (in order) */
+    void start_merge() {
+        open_runs(0);
+    }
+
+    /* Copies the spilled het infos of the next sample from all runs to the stream */
+    template <typename OStream>
+    void copy_next_sample(OStream& os) {
+        counts.resize(readers.size());
+        for (size_t r = 0; r < readers.size(); ++r) {
+            counts[r] = read_u32(*readers[r]);
+        }
+        copy_counted(os);
+    }
+
+    /* Closes the runs opened by start_merge() */
+    void end_merge() {
+        readers.clear();
+    }
+
+protected:
+    class SpillRun {
+    public:
+        std::string filename;
+        size_t level;
+    };
+
+    /* Opens the runs from the given one to the last one */
+    void open_runs(const size_t first) {
+        readers.clear();
+        for (size_t r = first; r < runs.size(); ++r) {
+            readers.push_back(std::make_unique<std::ifstream>(runs[r].filename, std::ios_base::binary));
+            if (!readers.back()->is_open()) {
+                std::cerr << "Cannot open spill file " << runs[r].filename << std::endl;
+                throw "Cannot open spill file";
+            }
+            if (read_u32(*readers.back()) != n_samples) {
+                std::cerr << "Spill file " << runs[r].filename << " does not match the number of samples" << std::endl;
+                throw "Spill file error";
+            }
+        }
+    }
+
+    /* Copies the het infos of the current sample of the open runs, their numbers are in counts */
+    template <typename OStream>
+    void copy_counted(OStream& os) {
+        for (size_t r = 0; r < readers.size(); ++r) {
+            auto& reader = readers[r];
+            size_t n = counts[r];
+            while (n) {
+                const size_t chunk = std::min(n, BUFFER_ITEMS);
+                buffer.resize(chunk);
+                reader->read(reinterpret_cast<char*>(buffer.data()), chunk * sizeof(HetInfo));
+                if (!*reader) {
+                    std::cerr << "Spill file is truncated" << std::endl;
+                    throw "Spill file error";
+                }
+                os.write(reinterpret_cast<const char*>(buffer.data()), chunk * sizeof(HetInfo));
+                n -= chunk;
+            }
+        }
+    }
+
+    /* Merges the last MERGE_RUNS runs (same level) into a single run of the next level */
+    void merge_last_runs() {
+        const size_t first = runs.size() - MERGE_RUNS;
+        const std::string filename = new_run_filename();
+        std::fstream ofs(filename, std::ios_base::binary | std::ios_base::out | std::ios_base::trunc);
+        if (!ofs.is_open()) {
+            std::cerr << "Cannot open file " << filename << std::endl;
+            throw "Cannot open spill file";
+        }
+        open_runs(first);
+        write_u32(ofs, n_samples);
+        for (size_t i = 0; i < n_samples; ++i) {
+            uint32_t n = 0;
+            counts.resize(readers.size());
+            for (size_t r = 0; r < readers.size(); ++r) {
+                counts[r] = read_u32(*readers[r]);
+                n += counts[r];
+            }
+            write_u32(ofs, n);
+            copy_counted(ofs);
+        }
+        readers.clear();
+        ofs.close();
+        if (ofs.fail()) {
+            std::cerr << "Failed to write spill file " << filename << std::endl;
+            throw "Failed to write spill file";
+        }
+        const size_t level = runs.back().level + 1;
+        for (size_t r = first; r < runs.size(); ++r) {
+            fs::remove(runs[r].filename);
+        }
+        runs.resize(first);
+        runs.push_back({filename, level});
+    }
+
+    std::string new_run_filename() {
+        return (fs::path(dir) / ("run_" + std::to_string(run_counter++) + ".bin")).string();
+    }
+
+    static void write_u32(std::fstream& ofs, const uint32_t value) {
+        ofs.write(reinterpret_cast<const char*>(&value), sizeof(uint32_t));
+    }
+
+    static uint32_t read_u32(std::ifstream& ifs) {
+        uint32_t value = 0;
+        ifs.read(reinterpret_cast<char*>(&value), sizeof(uint32_t));
+        if (!ifs) {
+            std::cerr << "Spill file is truncated" << std::endl;
+            throw "Spill file error";
+        }
+        return value;
+    }
+
+    static constexpr size_t BUFFER_ITEMS = 4096;
+    const size_t n_samples;
+    std::string dir;
+    /* The levels do not increase from the first (oldest) run to the last one */
+    std::vector<SpillRun> runs;
+    size_t run_counter = 0;
+    std::vector<uint32_t> spilled_per_sample;
+    size_t total_spilled = 0;
+    std::vector<std::unique_ptr<std::ifstream> > readers;
+    std::vector<uint32_t> counts;
+    std::vector<HetInfo> buffer;
+};
+
+#endif /* __SPILL_HPP__ */
@@ -0,0 +1,130 @@
+#ifndef __XSI_INPUT_HPP__
+#define __XSI_INPUT_HPP__
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "vcf.h"
+#include "xcf.hpp"
+#include "accessor.hpp"
+#include "fs.hpp"
+
+/* Accessors that can decode the genotypes of the carriers only, for the records sparse in the XSI file */
+template <typename A, typename = void>
+struct HasCarrierGenotypes : std::false_type {};
+template <typename A>
+struct HasCarrierGenotypes<A, std::void_t<decltype(std::declval<A&>().fill_carrier_genotypes(
+    std::declval<int32_t*>(), size_t(0), size_t(0), size_t(0), std::declval<std::vector<uint32_t>&>()))> > : std::true_type {};
+
+/**
+ * @brief Reader of XSI (xSqueezeIt) files. The variant sites and the other
+ *        fields (INFO, FORMAT e.g., PP) are read from the variant BCF of the
+ *        XSI file, the genotypes are decoded by the xSqueezeIt accessor in
+ *        the same BCF encoding as bcf_get_genotypes(). For the rare records
+ *        stored sparse in the XSI file, if the accessor can, only the
+ *        genotypes of the carriers are decoded (see get_carriers()).
+ */
+class XsiReader {
+public:
+    /* Suffix of the variant BCF written by xSqueezeIt next to the XSI file */
+    static constexpr const char* VARIANTS_SUFFIX = "_var.bcf";
+
+    /* The variant BCF is <filename>_var.bcf unless given */
+    XsiReader(const std::string& filename, const std::string& variants_filename = "") :
+        filename(filename),
+        variants_filename(variants_filename.empty() ? filename + VARIANTS_SUFFIX : variants_filename) {
+        for (auto& f : {this->filename, this->variants_filename}) {
+            if (!fs::exists(f)) {
+                std::cerr << "File : " << f << " does not exist !" << std::endl;
+                throw "File does not exist";
+            }
+        }
+        accessor = std::make_unique<Accessor>(this->filename);
+        initialize_bcf_file_reader(variants, this->variants_filename);
+
+        n_samples = accessor->get_sample_list().size();
+        // The FORMAT fields of the variant BCF, if any, are for the samples of the XSI file
+        const size_t n_variant_samples = bcf_hdr_nsamples(get_header());
+        if (n_variant_samples && n_variant_samples != n_samples) {
+            std::cerr << "The variant file " << this->variants_filename << " has " << n_variant_samples
+                      << " samples and the XSI file " << this->filename << " has " << n_samples << std::endl;
+            destroy_bcf_file_reader(variants);
+            throw "XSI samples mismatch";
+        }
+    }
+
+    ~XsiReader() {
+        destroy_bcf_file_reader(variants);
+    }
+
+    bcf_hdr_t *get_header() const {
+        return variants.sr->readers[0].header;
+    }
+
+    size_t get_n_samples() const {
+        return n_samples;
+    }
+
+    std::vector<std::string> get_sample_names() const {
+        return accessor->get_sample_list();
+    }
+
+    /**
+     * @brief Reads the next variant site and decodes its genotypes in the GT
+     *        array of bcf_fri (reallocated as needed, as htslib does)
+     */
+    bool next_line(bcf_file_reader_info_t& bcf_fri) {
+        if (!bcf_next_line(variants)) {
+            return false;
+        }
+        bcf1_t *line = variants.line;
+        bcf_unpack(line, BCF_UN_STR);
+
+        const int ngt = n_samples * PLOIDY;
+        if (bcf_fri.size_gt_arr < ngt) {
+            bcf_fri.gt_arr = (int*)realloc(bcf_fri.gt_arr, ngt * sizeof(int));
+            bcf_fri.size_gt_arr = ngt;
+        }
+        carriers_only = false;
+        if constexpr (HasCarrierGenotypes<Accessor>::value) {
+            carriers_only = accessor->fill_carrier_genotypes(bcf_fri.gt_arr, ngt, line->n_allele, variants.line_num - 1, carriers);
+        }
+        if (!carriers_only) {
+            accessor->fill_genotype_array(bcf_fri.gt_arr, ngt, line->n_allele, variants.line_num - 1);
+        }
+
+        bcf_fri.line = line;
+        bcf_fri.ngt = ngt;
+        bcf_fri.line_num = variants.line_num;
+        return true;
+    }
+
+    /**
+     * @brief Samples (sorted) of the current record not homozygous reference
+     *        if only their genotypes were decoded, the GT array of the other
+     *        samples is not set, they are homozygous reference. NULL if the
+     *        genotypes of all the samples were decoded.
+     */
+    const std::vector<uint32_t>* get_carriers() const {
+        return carriers_only ? &carriers : NULL;
+    }
+
+protected:
+    static constexpr size_t PLOIDY = 2;
+
+    std::string filename;
+    std::string variants_filename;
+    std::unique_ptr<Accessor> accessor;
+    bcf_file_reader_info_t variants;
+    size_t n_samples = 0;
+    std::vector<uint32_t> carriers;
+    bool carriers_only = false;
+};
+
+#endif /* __XSI_INPUT_HPP__ */
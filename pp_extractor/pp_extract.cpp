@@ -1,14 +1,69 @@
+#include <fstream>
 #include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
 #include "CLI11.hpp"
 #include "fifo.hpp"
 #include "extractors.hpp"
 #include "time.hpp"
 
+/* Output file and the parameters of its extraction, "out.bin" or "out.bin:fifo=5,pp=0.99,maf=0.001" */
+class OutputSpec {
+public:
+    OutputSpec(const std::string& spec, const size_t fifo_size, const float maf_threshold) :
+        filename(spec),
+        fifo_size(fifo_size),
+        pp_threshold(PPExtractTraversal::DEFAULT_PP_THRESHOLD),
+        maf_threshold(maf_threshold) {
+        // Parameters follow the last colon, if it has any, otherwise the colon is part of the file name
+        const size_t colon = spec.rfind(':');
+        if (colon == std::string::npos || spec.find('=', colon) == std::string::npos) {
+            return;
+        }
+        filename = spec.substr(0, colon);
+        std::stringstream ss(spec.substr(colon + 1));
+        std::string param;
+        while (std::getline(ss, param, ',')) {
+            const size_t eq = param.find('=');
+            const std::string key = param.substr(0, eq);
+            const std::string value = (eq == std::string::npos) ? "" : param.substr(eq + 1);
+            try {
+                if (key == "fifo") {
+                    this->fifo_size = std::stoul(value);
+                } else if (key == "pp") {
+                    pp_threshold = std::stof(value);
+                } else if (key == "maf") {
+                    this->maf_threshold = std::stof(value);
+                } else {
+                    throw std::invalid_argument(key);
+                }
+            } catch (const std::exception&) {
+                std::cerr << "Bad parameter \"" << param << "\" for output " << spec << ", expected fifo=, pp= or maf=" << std::endl;
+                throw "Bad output parameter";
+            }
+        }
+    }
+
+    std::string filename;
+    size_t fifo_size;
+    float pp_threshold;
+    float maf_threshold;
+};
+
 class GlobalAppOptions {
 public:
     GlobalAppOptions() {
         app.add_option("-f,--file", filename, "Input file name");
-        app.add_option("-o,--output", ofname, "Output file name");
+        app.add_option("-o,--output", ofnames, "Output file name, \"-\" for stdout with --stream, can be given several times, "
+                                               "each as name:fifo=5,pp=0.99,maf=0.001 to extract with other parameters in the same pass");
+        app.add_flag("--xsi", xsi, "Input file is an XSI (xSqueezeIt) file, the variant sites and PP are read from its variant BCF");
+        app.add_option("--xsi-variants", xsi_variants, "Variant BCF of the XSI file, default is <file>_var.bcf");
+        app.add_flag("--stream", stream, "Write the streaming layout (offset table at the end), can be piped");
+        app.add_flag("--sample-table", sample_table, "Write a sample table (original IDs and names of the samples) after the offset table, not with --stream");
+        app.add_option("--skip-index", skip_interval, "Write a skip index with a checkpoint every this many het sites (e.g., 256) for the queries by VCF line range,\n"
+                       "    not with --stream or --max-memory, default is 0 (none)");
+        app.add_flag("--checksums", checksums, "Write the CRC32C checksums of the sample blocks, not with --stream");
         app.add_option("-s,--start", start, "Starting sample position");
         app.add_option("-e,--end", end, "End sample position (excluded)");
         app.add_option("-p,--progress", progress, "Number of VCF lines to show progress");
@@ -16,16 +71,46 @@ public:
         app.add_flag("--pp-from-af", pp_from_af, "Generate PP score from allele frequency INFO field");
         app.add_option("--maf-threshold", maf_threshold, "MAF threshold for PP score from MAF");
         app.add_flag("--extract-pp1-singletons", extract_pp1_singletons, "Workaround for singletons with PP of 1.0");
-        app.add_option("--fifo-size", fifo_size, "FIFO size (number of hets extracted centered on het of interest)");
+        app.add_option("--fifo-size", fifo_size, "FIFO size (number of hets extracted centered on het of interest), odd");
         app.add_option("--main-var-vcf", main_var_vcf, "Main var VCF if input file is split VCF");
         app.add_flag("-v,--verbose", verbose, "Will show progress and other messages");
         app.add_flag("--map-from-main-var-vcf", map_from_main_var_vcf, "Use the UID of the variant in the main var VCF");
+        app.add_option("--main-var-index", main_var_index, "Variant line index of the main var VCF (see var_line_index), default is the main var VCF name with .lidx appended if it exists");
+        app.add_option("-t,--threads", n_threads, "Number of threads extracting the samples, default is 1, set to 0 for auto");
+        app.add_flag("--pipeline", pipeline, "Decode the records in a separate stage ahead of the extraction");
+        app.add_option("--decode-threads", decode_threads, "Pipeline: Number of htslib threads decompressing the input, default is 2");
+        app.add_option("--ring-size", ring_size, "Pipeline: Number of decoded records buffered between the stages, default is 16");
+        app.add_option("--tile-records", tile_records, "Buffer the het sites of this many records and extract them sample by sample, default is 0 (disabled)");
+        app.add_option("--tile-samples", tile_samples, "Tiles: Number of samples transposed together, default is 2048");
+        app.add_option("--max-memory", max_memory_mb, "Memory limit in MB, kept het sites are spilled to disk above it, default is 0 (no limit)");
+        app.add_option("--tmp-dir", tmp_dir, "Directory for the spilled het sites, default is the system temporary directory");
+        app.add_option("--select", select, "Extract the het sites selected by the expression instead of the ones with a low PP, e.g., \"AF<0.01 && SNP\" or \"PP<0.9 || AC<=2\" "
+                                           "(fields AF, MAF, AC, AN, POS, SNP, INDEL, PP)");
+        app.add_option("--select-samples", select_samples, "Only select het sites of these samples, file with one sample per line or comma separated list");
+        app.add_option("--select-regions", select_regions, "Only select het sites in these regions, file (CHROM, BEG, END, tab separated) or comma separated list of CHROM:BEG-END");
+        app.add_option("--samples-file", samples_file, "Only decode and extract the samples of this file (one name per line), the sample IDs in the output are the ones of the input");
+        app.add_option("--keep-distance", keep_distance, "Only keep the het sites within this distance (bp) of the low PP ones, up to the FIFO size, use the --max-distance of phase_caller, default is 0 (whole FIFO)");
+        app.add_flag("--drop-isolated", drop_isolated, "With --keep-distance, don't extract the low PP het sites without het site within the distance (they cannot be rephased)");
+        app.add_option("--regions-threads", regions_threads, "Extract an indexed BCF by genomic chunks on this many threads, default is 0 (disabled)");
+        app.add_flag("--fingerprints", fingerprints, "Write the fingerprints of the regions of the input next to the output (<output>.fp), for --update");
+        app.add_option("--fingerprint-region-size", fingerprint_region_size, "Size (bp) of the regions of the fingerprints, default is 1000000");
+        app.add_option("--stats", stats, "Write the time of the extraction stages, throughput and keep rates as JSON to this file at the end");
+        app.add_option("--status-file", status_file, "Rewrite the progress, ETA (indexed input) and statistics as JSON to this file periodically");
+        app.add_option("--status-interval", status_interval, "Seconds between the updates of the status file, default is 10");
+        app.add_option("--update", update, "Previous output (with fingerprints) of an older version of the input, only the changed regions are extracted again, implies --fingerprints");
     }
 
     CLI::App app{"PP Extractor app"};
     std::string filename = "-";
-    std::string ofname = "-";
+    std::vector<std::string> ofnames;
+    bool stream = false;
+    bool sample_table = false;
+    uint32_t skip_interval = 0;
+    bool checksums = false;
+    bool xsi = false;
+    std::string xsi_variants = "";
     std::string main_var_vcf = "";
+    std::string main_var_index = "";
     size_t start = 0;
     size_t end = -1;
     size_t progress = 0;
@@ -37,6 +122,27 @@ public:
     bool verbose = false;
     bool show_number = false;
     bool map_from_main_var_vcf = false;
+    size_t n_threads = 1;
+    bool pipeline = false;
+    size_t decode_threads = 2;
+    size_t ring_size = 16;
+    size_t tile_records = 0;
+    size_t tile_samples = 2048;
+    size_t max_memory_mb = 0;
+    std::string tmp_dir = "";
+    size_t regions_threads = 0;
+    std::string select = "";
+    std::string select_samples = "";
+    std::string select_regions = "";
+    std::string samples_file = "";
+    uint32_t keep_distance = 0;
+    bool drop_isolated = false;
+    bool fingerprints = false;
+    uint32_t fingerprint_region_size = RegionFingerprints::DEFAULT_REGION_SIZE;
+    std::string update = "";
+    std::string stats = "";
+    std::string status_file = "";
+    double status_interval = ExtractionStats::DEFAULT_STATUS_INTERVAL;
 };
 
 GlobalAppOptions global_app_options;
@@ -48,53 +154,285 @@ int main(int argc, char**argv) {
     auto& start = global_app_options.start;
     auto& end = global_app_options.end;
     auto& filename = global_app_options.filename;
-    auto& ofname = global_app_options.ofname;
+    auto& ofnames = global_app_options.ofnames;
     CLI11_PARSE(app, argc, argv);
 
     if (filename.compare("-") == 0) {
         std::cerr << "No filename given, will read from stdin\n";
     }
 
-    if (ofname.compare("-") == 0) {
+    if (ofnames.empty()) {
+        ofnames.push_back("-");
+    }
+
+    std::vector<OutputSpec> outputs;
+    try {
+        for (const auto& ofname : ofnames) {
+            outputs.emplace_back(ofname, global_app_options.fifo_size, global_app_options.maf_threshold);
+        }
+    } catch (const char*) {
+        exit(app.exit(CLI::CallForHelp()));
+    }
+
+    size_t outputs_to_stdout = 0;
+    for (const auto& output : outputs) {
+        outputs_to_stdout += output.filename.compare("-") == 0;
+    }
+    if (outputs_to_stdout && !global_app_options.stream) {
         std::cerr << "Requires output filename\n";
         exit(app.exit(CLI::CallForHelp()));
     }
+    if (outputs_to_stdout > 1) {
+        std::cerr << "Only one output can go to stdout\n";
+        exit(app.exit(CLI::CallForHelp()));
+    }
+    if (global_app_options.sample_table && global_app_options.stream) {
+        std::cerr << "The sample table is not written in the streaming layout, convert the output with bin_convert --sample-table\n";
+        exit(app.exit(CLI::CallForHelp()));
+    }
+    if (global_app_options.skip_interval && (global_app_options.stream || global_app_options.max_memory_mb)) {
+        // The checkpoints are taken from the het sites in memory before the sample blocks are written
+        std::cerr << "The skip index is not written in the streaming layout or with --max-memory, convert the output with bin_convert --skip-index\n";
+        exit(app.exit(CLI::CallForHelp()));
+    }
+    if (global_app_options.checksums && global_app_options.stream) {
+        std::cerr << "The checksums are not written in the streaming layout, convert the output with bin_convert --checksums\n";
+        exit(app.exit(CLI::CallForHelp()));
+    }
+
+    // The binary goes to stdout, messages are redirected to stderr
+    std::ostream stdout_stream(std::cout.rdbuf());
+    if (outputs_to_stdout) {
+        std::cout.rdbuf(std::cerr.rdbuf());
+    }
+
+    for (auto& output : outputs) {
+        if (!(output.fifo_size & 1)) {
+            std::cerr << "Warning the FIFO size must be odd\n";
+            output.fifo_size++;
+            std::cerr << "FIFO size of " << output.filename << " updated to " << output.fifo_size << std::endl;
+        }
+    }
+
+    if (global_app_options.n_threads == 0) {
+        global_app_options.n_threads = std::thread::hardware_concurrency();
+        std::cerr << "Setting number of threads to " << global_app_options.n_threads << std::endl;
+    }
+
+    if (global_app_options.regions_threads) {
+        // The region chunks are extracted from line 0 and single threaded, then folded in memory
+        if (global_app_options.main_var_vcf != "" || global_app_options.main_var_index != "" ||
+            global_app_options.pipeline || global_app_options.max_memory_mb || global_app_options.n_threads > 1 ||
+            global_app_options.keep_distance) {
+            std::cerr << "--regions-threads cannot be used with --main-var-vcf, --main-var-index, --pipeline, --max-memory, --threads or --keep-distance" << std::endl;
+            exit(app.exit(CLI::CallForHelp()));
+        }
+        if (filename.compare("-") == 0) {
+            std::cerr << "--regions-threads requires an indexed input file" << std::endl;
+            exit(app.exit(CLI::CallForHelp()));
+        }
+    }
+
+    if (global_app_options.xsi) {
+        // The records are read in place from the variant BCF, by the traversal thread
+        if (global_app_options.pipeline || global_app_options.regions_threads || global_app_options.n_threads > 1 ||
+            global_app_options.samples_file != "") {
+            std::cerr << "--xsi cannot be used with --pipeline, --regions-threads, --threads or --samples-file" << std::endl;
+            exit(app.exit(CLI::CallForHelp()));
+        }
+        if (filename.compare("-") == 0) {
+            std::cerr << "--xsi requires an input file" << std::endl;
+            exit(app.exit(CLI::CallForHelp()));
+        }
+    }
+
+    if (global_app_options.update != "") {
+        global_app_options.fingerprints = true;
+        // The previous het sites are spliced in memory, the records are read twice
+        if (global_app_options.pipeline || global_app_options.max_memory_mb || global_app_options.n_threads > 1) {
+            std::cerr << "--update cannot be used with --pipeline, --max-memory or --threads" << std::endl;
+            exit(app.exit(CLI::CallForHelp()));
+        }
+        if (filename.compare("-") == 0) {
+            std::cerr << "--update requires an input file" << std::endl;
+            exit(app.exit(CLI::CallForHelp()));
+        }
+    }
+
+    if (global_app_options.fingerprints) {
+        // The fingerprints are of the records of the input at their VCF line, written next to the single output
+        if (global_app_options.regions_threads || global_app_options.xsi || global_app_options.samples_file != "" ||
+            global_app_options.main_var_vcf != "" || global_app_options.main_var_index != "") {
+            std::cerr << "--fingerprints cannot be used with --regions-threads, --xsi, --samples-file, --main-var-vcf or --main-var-index" << std::endl;
+            exit(app.exit(CLI::CallForHelp()));
+        }
+        if (outputs.size() > 1 || outputs.front().filename.compare("-") == 0) {
+            std::cerr << "--fingerprints requires a single output file" << std::endl;
+            exit(app.exit(CLI::CallForHelp()));
+        }
+    }
+
+    if (global_app_options.samples_file != "" && (start != 0 || end != size_t(-1))) {
+        // The sample positions would be the ones of the subset, not of the input
+        std::cerr << "--samples-file cannot be used with --start or --end" << std::endl;
+        exit(app.exit(CLI::CallForHelp()));
+    }
 
-    if (!(global_app_options.fifo_size & 1)) {
-        std::cerr << "Warning the FIFO size must be odd\n";
-        global_app_options.fifo_size++;
-        std::cerr << "FIFO size updated to " << global_app_options.fifo_size << std::endl;
+    if (outputs.size() > 1 && (global_app_options.n_threads > 1 || global_app_options.regions_threads)) {
+        // The configurations extract the records one after the other on the traversal thread
+        std::cerr << "Several outputs cannot be extracted with --threads or --regions-threads" << std::endl;
+        exit(app.exit(CLI::CallForHelp()));
     }
 
-    PPExtractTraversal ppet(start, end, global_app_options.fifo_size,
+    PPExtractTraversal ppet(start, end, outputs.front().fifo_size,
                             global_app_options.pp_from_maf,
-                            global_app_options.pp_from_af);
+                            global_app_options.pp_from_af,
+                            outputs.front().pp_threshold);
 
     if (global_app_options.pp_from_maf || global_app_options.pp_from_af) {
-        ppet.set_maf_threshold(global_app_options.maf_threshold);
+        ppet.set_maf_threshold(outputs.front().maf_threshold);
     }
 
     if (global_app_options.extract_pp1_singletons) {
         ppet.set_extract_acan();
     }
 
-    if (global_app_options.map_from_main_var_vcf) {
+    if (global_app_options.drop_isolated && !global_app_options.keep_distance) {
+        std::cerr << "--drop-isolated requires --keep-distance" << std::endl;
+        exit(app.exit(CLI::CallForHelp()));
+    }
+    // Before the other outputs are added, they keep the het sites within the same distance
+    ppet.set_keep_distance(global_app_options.keep_distance, global_app_options.drop_isolated);
+
+    if (global_app_options.samples_file != "") {
+        try {
+            ppet.set_samples_file(global_app_options.samples_file);
+        } catch (const char*) {
+            exit(app.exit(CLI::CallForHelp()));
+        }
+    }
+
+    if (global_app_options.select != "" || global_app_options.select_samples != "" || global_app_options.select_regions != "") {
+        try {
+            auto selection = std::make_shared<GenotypeSelection>(global_app_options.select);
+            if (global_app_options.select_samples != "") {
+                selection->set_samples(global_app_options.select_samples);
+            }
+            if (global_app_options.select_regions != "") {
+                selection->set_regions(global_app_options.select_regions);
+            }
+            ppet.set_selection(selection);
+        } catch (const char*) {
+            exit(app.exit(CLI::CallForHelp()));
+        }
+    }
+
+    // The other outputs are extracted from the same decoded records, the memory limit is shared
+    const size_t max_memory = global_app_options.max_memory_mb * 1024 * 1024 / outputs.size();
+    for (size_t i = 1; i < outputs.size(); ++i) {
+        auto& c = ppet.add_configuration(outputs[i].fifo_size, outputs[i].pp_threshold, outputs[i].maf_threshold);
+        c.set_tiling(global_app_options.tile_records, global_app_options.tile_samples);
+        c.set_max_memory(max_memory, global_app_options.tmp_dir);
+    }
+
+    auto& main_var_index = global_app_options.main_var_index;
+    if (main_var_index == "" && global_app_options.main_var_vcf != "") {
+        main_var_index = VarLineIndex::find_default_index(global_app_options.main_var_vcf);
+    }
+
+    if (main_var_index != "") {
+        ppet.use_line_index(main_var_index, global_app_options.map_from_main_var_vcf);
+    } else if (global_app_options.map_from_main_var_vcf) {
         ppet.use_map(global_app_options.main_var_vcf);
     } else if (global_app_options.main_var_vcf != "") {
         ppet.set_search_line_counter(global_app_options.main_var_vcf);
     }
 
+    if (global_app_options.fingerprints) {
+        // After the settings, they are part of the fingerprints
+        ppet.set_fingerprints(global_app_options.fingerprint_region_size);
+    }
+
+    if (global_app_options.stats != "" || global_app_options.status_file != "") {
+        // The ETA needs the number of records from the index of the input
+        const int64_t expected_records = (filename.compare("-") == 0 || global_app_options.xsi) ? -1 : count_indexed_records(filename);
+        ppet.enable_stats(global_app_options.status_file, global_app_options.status_interval, expected_records);
+    }
+
     std::cout << "Extracting...\n" << std::endl;
 
     ppet.set_progress(global_app_options.progress);
+    ppet.set_threads(global_app_options.n_threads);
+    ppet.set_tiling(global_app_options.tile_records, global_app_options.tile_samples);
+    ppet.set_max_memory(max_memory, global_app_options.tmp_dir);
 
     // Main work
-    ppet.traverse_no_destroy(filename);
+    auto extraction_begin_time = std::chrono::steady_clock::now();
+    if (global_app_options.xsi) {
+        try {
+            ppet.traverse_xsi_no_destroy(filename, global_app_options.xsi_variants);
+        } catch (const char*) {
+            exit(-1);
+        }
+    } else if (global_app_options.update != "") {
+        try {
+            ppet.traverse_update_no_destroy(filename, global_app_options.update);
+        } catch (const char*) {
+            exit(-1);
+        }
+    } else if (global_app_options.regions_threads) {
+        try {
+            ppet.traverse_regions_no_destroy(filename, global_app_options.regions_threads);
+        } catch (const char*) {
+            exit(-1);
+        }
+    } else if (global_app_options.pipeline) {
+        try {
+            ppet.traverse_pipelined_no_destroy(filename, global_app_options.decode_threads, global_app_options.ring_size);
+        } catch (const char*) {
+            exit(-1);
+        }
+        ppet.show_pipeline_info();
+    } else {
+        ppet.traverse_no_destroy(filename);
+    }
     ppet.finalize();
+    ppet.show_throughput(extraction_begin_time, std::chrono::steady_clock::now());
 
-    ppet.show_info();
+    for (size_t i = 0; i < outputs.size(); ++i) {
+        PPExtractTraversal& extraction = i ? ppet.get_configuration(i-1) : ppet;
+        const std::string& ofname = outputs[i].filename;
+        if (outputs.size() > 1) {
+            std::cout << "Output " << ofname << " (FIFO size " << outputs[i].fifo_size << ", PP threshold " << outputs[i].pp_threshold
+                      << ", MAF threshold " << outputs[i].maf_threshold << ")" << std::endl;
+        }
 
-    ppet.write_to_file(ofname);
+        extraction.show_info();
+
+        if (ofname.compare("-") == 0) {
+            extraction.write_to_stream(stdout_stream);
+        } else if (global_app_options.stream) {
+            std::ofstream ofs(ofname, std::ios_base::binary | std::ios_base::out | std::ios_base::trunc);
+            if (!ofs.is_open()) {
+                std::cerr << "Cannot open file " << ofname << std::endl;
+                exit(-1);
+            }
+            extraction.write_to_stream(ofs);
+        } else {
+            extraction.write_to_file(ofname, global_app_options.sample_table, global_app_options.skip_interval, global_app_options.checksums);
+        }
+    }
+
+    if (global_app_options.status_file != "") {
+        ppet.write_stats(global_app_options.status_file);
+    }
+    if (global_app_options.stats != "") {
+        ppet.write_stats(global_app_options.stats);
+    }
+
+    if (global_app_options.fingerprints) {
+        ppet.write_fingerprints(RegionFingerprints::default_filename(outputs.front().filename));
+    }
 
     std::cout << "Done !" << std::endl;
 
@@ -27,6 +27,8 @@ int main(int argc, char**argv) {
     app.add_option("-s,--sample", sample, "Sample index");
     bool igv = false;
     app.add_flag("--igv", igv, "Outputs IGV batch file (requires output file name)");
+    std::string region;
+    app.add_option("-r,--region", region, "Only show the het sites in the region CHROM:BEG-END (1 based, inclusive)");
 
     CLI11_PARSE(app, argc, argv);
 
@@ -62,8 +64,18 @@ int main(int argc, char**argv) {
     // Per sample info
 
     //himm.print_positions(sample);
-    std::vector<HetInfo> v;
-    himm.fill_het_info(v, sample);
+    uint32_t begin_line = 0;
+    uint32_t end_line = -1;
+    if (!region.empty()) {
+        try {
+            vars.find_vcf_lines_of_region(region, begin_line, end_line);
+        } catch (const char *e) {
+            exit(-1);
+        }
+        std::cout << "Region " << region << " : VCF lines [" << begin_line << ", " << end_line << ")" << std::endl;
+    }
+    // Binary search by VCF line (with the skip index if any), the rest of the sample block is not read
+    const HetInfoSpan v = himm.get_span_of_nth_in_lines(sample, begin_line, end_line);
 
     if (igv) {
         std::ofstream ofs(ofname);
@@ -79,8 +91,8 @@ int main(int argc, char**argv) {
         //ofs << "load TODO VCF" << std::endl;
         ofs << "viewaspairs" << std::endl;
         ofs << "snapshotDirectory ~/snap" << std::endl;
-        for (auto hi : v) {
-            ofs << vars.vars[hi.vcf_line].to_vcfotographer_string() << std::endl;
+        for (const auto hi : v) {
+            ofs << vars.vars[hi.vcf_line()].to_vcfotographer_string() << std::endl;
             ofs << "snapshot" << std::endl;
         }
         ofs.flush();
@@ -89,9 +101,9 @@ int main(int argc, char**argv) {
         std::cout << "Successfully wrote the file " << ofname << std::endl;
     } else {
         std::cout << "---" << std::endl;
-        for (auto hi : v) {
-            std::cout << vars.vars[hi.vcf_line].to_string() << "\t";
-            std::cout << hi.to_string() << std::endl;
+        for (const auto hi : v) {
+            std::cout << vars.vars[hi.vcf_line()].to_string() << "\t";
+            std::cout << hi.to_het_info().to_string() << std::endl;
         }
     }
 
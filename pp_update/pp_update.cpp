@@ -1,5 +1,6 @@
 #include <iostream>
 #include <cmath>
+#include <memory>
 #include "vcf.h"
 #include "hts.h"
 #include "synced_bcf_reader.h"
@@ -7,6 +8,7 @@
 #include "CLI11.hpp"
 #include "het_info.hpp"
 #include "het_info_loader.hpp"
+#include "var_line_index.hpp"
 #include "time.hpp"
 #include "git_rev.h"
 
@@ -19,6 +21,7 @@ public:
         app.add_option("-o,--output", ofname, "Output file name");
         app.add_option("-b,--binary-file", bfname, "Binary file name");
         app.add_option("--main-var-vcf", main_var_vcf, "Main var VCF if input file is split VCF");
+        app.add_option("--main-var-index", main_var_index, "Variant line index of the main var VCF (see var_line_index), default is the main var VCF name with .lidx appended if it exists");
         app.add_flag("-v,--verbose", verbose, "Will show progress and other messages");
         app.add_flag("--no-pp", nopp, "Don't write/update the PP field");
     }
@@ -28,6 +31,7 @@ public:
     std::string ofname = "-";
     std::string bfname = "-";
     std::string main_var_vcf = "";
+    std::string main_var_index = "";
     bool verbose = false;
     bool nopp = false;
 };
@@ -57,18 +61,11 @@ void insert_in_work(std::map<size_t, VCFLineWork>& work, HetInfo& hi, size_t id)
 void fill_work_from_himm(std::map<size_t, VCFLineWork>& work, HetInfoMemoryMap& himm) {
     // For all samples
     for (size_t i = 0; i < himm.num_samples; ++i) {
-        // Get Het variants
-        std::vector<HetInfo> his;
-        himm.fill_het_info(his, i);
-
-        // For all het variants
-        for (auto& hi : his) {
-            // If it has been rephased (>1.0)
-            if (!std::isnan(hi.pp) && hi.pp > 1.0) {
-                // Insert in work
-                insert_in_work(work, hi, i);
-            }
-        }
+        // For all het variants that have been rephased (>1.0), only the PP is read for the others
+        himm.for_each_if_pp(i, [](const float pp) { return !std::isnan(pp) && pp > 1.0; }, [&](HetInfo hi) {
+            // Insert in work
+            insert_in_work(work, hi, i);
+        });
     }
 }
 
@@ -88,6 +85,18 @@ public:
             exit(-1); // Change this
         }
 
+        // This is for split VCF/BCFs, the index gives the line of the first record
+        if (line_index) /* [[unlikely]] */ {
+            const int64_t line_in_index = line_index->find(header, line);
+            if (line_in_index < 0) {
+                std::cerr << "Could not find VCF record in variant line index " << line_index->filename << std::endl;
+                throw "vcf line counter error";
+            }
+            line_counter = line_in_index;
+            // Records should be contiguous
+            line_index.reset();
+        }
+
         // This is for split VCF/BCFs
         if (search_line_value) /* [[unlikely]] */ {
             // Load global variant file (in scope to release it after, takes some time)
@@ -174,6 +183,11 @@ public:
         }
     }
 
+    void use_line_index(const std::string& index_filename) {
+        std::cout << "Using the variant line index " << index_filename << std::endl;
+        line_index = std::make_unique<VarLineIndex>(index_filename);
+    }
+
     void print_stats() const {
         std::cout << "Rephase targets              : " << rephase_targets << std::endl;
         std::cout << "With phase informative reads : " << number_with_pir << std::endl;
@@ -190,6 +204,7 @@ protected:
 
     bool search_line_value = false;
     std::string search_in_file;
+    std::unique_ptr<VarLineIndex> line_index;
 
     size_t rephase_targets = 0;
     size_t number_with_pir = 0;
@@ -234,7 +249,14 @@ int main(int argc, char**argv) {
 
     PPUpdateTransformer pput(work);
 
-    if (global_app_options.main_var_vcf != "") {
+    auto& main_var_index = global_app_options.main_var_index;
+    if (main_var_index == "" && global_app_options.main_var_vcf != "") {
+        main_var_index = VarLineIndex::find_default_index(global_app_options.main_var_vcf);
+    }
+
+    if (main_var_index != "") {
+        pput.use_line_index(main_var_index);
+    } else if (global_app_options.main_var_vcf != "") {
         pput.set_search_line_counter(global_app_options.main_var_vcf);
     }
 
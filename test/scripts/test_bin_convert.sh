@@ -0,0 +1,62 @@
+#!/bin/bash
+
+if ! command -v realpath &> /dev/null
+then
+    realpath() {
+        [[ $1 = /* ]] && echo "$1" || echo "$PWD/${1#./}"
+    }
+fi
+
+# Get the path of this script
+SCRIPTPATH=$(realpath  $(dirname "$0"))
+
+BINFILE=""
+
+POSITIONAL=()
+while [[ $# -gt 0 ]]
+do
+key="$1"
+
+case $key in
+    -b|--bin-file)
+    BINFILE="$2"
+    shift # past argument
+    shift # past value
+    ;;
+    *)    # unknown option
+    POSITIONAL+=("$1") # save it in an array for later
+    shift # past argument
+    ;;
+esac
+done
+set -- "${POSITIONAL[@]}" # restore positional parameters
+
+if [ -z "${BINFILE}" ]
+then
+    echo "Specify a binary file with --bin-file, -b <filename>"
+    exit 1
+fi
+
+echo "BINFILE         = ${BINFILE}"
+
+TMPDIR=$(mktemp -d -t pp_XXXXXX) || { echo "Failed to create temporary directory"; exit 1; }
+
+echo "Temporary directory : ${TMPDIR}"
+
+function exit_fail_rm_tmp {
+    echo "Removing directory : ${TMPDIR}"
+    rm -r ${TMPDIR}
+    exit 1
+}
+
+BIN_CONVERT="${SCRIPTPATH}"/../../bin_tools/bin_convert
+
+# Converted with the given options, then back to the original layout without the optional sections
+"${BIN_CONVERT}" "$@" -b "${BINFILE}" -o ${TMPDIR}/converted.bin || { echo "Failed to convert ${BINFILE}"; exit_fail_rm_tmp; }
+"${BIN_CONVERT}" --to 1 --drop-sections -b ${TMPDIR}/converted.bin -o ${TMPDIR}/back.bin || { echo "Failed to convert back ${BINFILE}"; exit_fail_rm_tmp; }
+cmp "${BINFILE}" ${TMPDIR}/back.bin || { echo "[KO] The file converted back and the original file are different"; exit_fail_rm_tmp; }
+
+echo "[OK] The file converted back and the original file are the same"
+
+rm -r $TMPDIR
+exit 0
@@ -0,0 +1,98 @@
+#!/bin/bash
+
+if ! command -v realpath &> /dev/null
+then
+    realpath() {
+        [[ $1 = /* ]] && echo "$1" || echo "$PWD/${1#./}"
+    }
+fi
+
+# Get the path of this script
+SCRIPTPATH=$(realpath  $(dirname "$0"))
+
+BINFILE=""
+SAMPLE=0
+
+POSITIONAL=()
+while [[ $# -gt 0 ]]
+do
+key="$1"
+
+case $key in
+    -b|--bin-file)
+    BINFILE="$2"
+    shift # past argument
+    shift # past value
+    ;;
+    -s|--sample)
+    SAMPLE="$2"
+    shift
+    shift
+    ;;
+    *)    # unknown option
+    POSITIONAL+=("$1") # save it in an array for later
+    shift # past argument
+    ;;
+esac
+done
+set -- "${POSITIONAL[@]}" # restore positional parameters
+
+if [ -z "${BINFILE}" ]
+then
+    echo "Specify a binary file with --bin-file, -b <filename>"
+    exit 1
+fi
+
+echo "BINFILE         = ${BINFILE}"
+echo "SAMPLE          = ${SAMPLE}"
+
+TMPDIR=$(mktemp -d -t pp_XXXXXX) || { echo "Failed to create temporary directory"; exit 1; }
+
+echo "Temporary directory : ${TMPDIR}"
+
+function exit_fail_rm_tmp {
+    echo "Removing directory : ${TMPDIR}"
+    rm -r ${TMPDIR}
+    exit 1
+}
+
+BIN_CONVERT="${SCRIPTPATH}"/../../bin_tools/bin_convert
+
+# Flips the lowest bit of the last byte of the sample block (the offset table follows the 8 bytes of the header,
+# the sections are before the sample blocks so the last one ends with the file)
+function flip_last_byte_of_sample {
+    local NUM_SAMPLES=$(od -A n -t u4 -j 4 -N 4 "$1" | tr -d ' ')
+    local NEXT_OFFSET=$(stat -c %s "$1")
+    if [ $((SAMPLE + 1)) -lt ${NUM_SAMPLES} ]
+    then
+        NEXT_OFFSET=$(od -A n -t u8 -j $((8 + 8 * (SAMPLE + 1))) -N 8 "$1" | tr -d ' ')
+    fi
+    local POSITION=$((NEXT_OFFSET - 1))
+    local BYTE=$(od -A n -t u1 -j ${POSITION} -N 1 "$1" | tr -d ' ')
+    printf "$(printf '\\%03o' $((BYTE ^ 1)))" | dd of="$1" bs=1 seek=${POSITION} conv=notrunc 2> /dev/null
+}
+
+# Converted with the checksums and the given options, the file passes the integrity checks
+"${BIN_CONVERT}" --checksums "$@" -b "${BINFILE}" -o ${TMPDIR}/checksums.bin || { echo "Failed to convert ${BINFILE}"; exit_fail_rm_tmp; }
+"${BIN_CONVERT}" --to 1 --drop-sections -t 4 -b ${TMPDIR}/checksums.bin -o ${TMPDIR}/back.bin || { echo "[KO] The file with checksums fails the integrity checks"; exit_fail_rm_tmp; }
+cmp "${BINFILE}" ${TMPDIR}/back.bin || { echo "[KO] The file converted back and the original file are different"; exit_fail_rm_tmp; }
+
+# The same flipped byte is only detected with the checksums
+"${BIN_CONVERT}" "$@" -b "${BINFILE}" -o ${TMPDIR}/no_checksums.bin || { echo "Failed to convert ${BINFILE}"; exit_fail_rm_tmp; }
+flip_last_byte_of_sample ${TMPDIR}/no_checksums.bin
+"${BIN_CONVERT}" --to 1 -b ${TMPDIR}/no_checksums.bin -o ${TMPDIR}/back_no_checksums.bin || { echo "[KO] The flipped byte is detected without the checksums"; exit_fail_rm_tmp; }
+
+flip_last_byte_of_sample ${TMPDIR}/checksums.bin
+for THREADS in 1 4
+do
+    if "${BIN_CONVERT}" --to 1 -t ${THREADS} -b ${TMPDIR}/checksums.bin -o ${TMPDIR}/back_corrupted.bin
+    then
+        echo "[KO] The flipped byte of sample ${SAMPLE} is not detected with ${THREADS} thread(s)"
+        exit_fail_rm_tmp
+    fi
+done
+
+echo "[OK] The file with checksums passes the integrity checks and the flipped byte is detected"
+
+rm -r $TMPDIR
+exit 0
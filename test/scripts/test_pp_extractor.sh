@@ -11,8 +11,12 @@ fi
 SCRIPTPATH=$(realpath  $(dirname "$0"))
 
 FILENAME=""
-REFERENCE=""
+REFERENCES=()
 unset -v FIFO_SIZE
+INDEXED_COPY=false
+XSI_COPY=false
+UPDATE_UNCHANGED=false
+UPDATE_FROM=""
 
 POSITIONAL=()
 while [[ $# -gt 0 ]]
@@ -28,7 +32,7 @@ case $key in
     shift # past value
     ;;
     -r|--reference)
-    REFERENCE="$2"
+    REFERENCES+=("$2")
     shift # past argument
     shift # past value
     ;;
@@ -37,6 +41,23 @@ case $key in
     shift
     shift
     ;;
+    --indexed-copy)
+    INDEXED_COPY=true
+    shift
+    ;;
+    --xsi-copy)
+    XSI_COPY=true
+    shift
+    ;;
+    --update-unchanged)
+    UPDATE_UNCHANGED=true
+    shift
+    ;;
+    --update-from)
+    UPDATE_FROM="$2"
+    shift
+    shift
+    ;;
     *)    # unknown option
     POSITIONAL+=("$1") # save it in an array for later
     shift # past argument
@@ -51,9 +72,9 @@ then
     exit 1
 fi
 
-if [ -z "${REFERENCE}" ]
+if [ ${#REFERENCES[@]} -eq 0 ]
 then
-    echo "Specify a filename with --reference, -r <filename>"
+    echo "Specify a filename with --reference, -r <filename>[:<output parameters>] (can be given several times)"
     exit 1
 fi
 
@@ -63,7 +84,7 @@ then
 fi
 
 echo "FILENAME        = ${FILENAME}"
-echo "REFERENCE       = ${REFERENCE}"
+echo "REFERENCE       = ${REFERENCES[@]}"
 
 TMPDIR=$(mktemp -d -t pp_XXXXXX) || { echo "Failed to create temporary directory"; exit 1; }
 
@@ -77,10 +98,76 @@ function exit_fail_rm_tmp {
 
 OUTPUTNAME="$(basename "${FILENAME}")".bin
 
-"${SCRIPTPATH}"/../../pp_extractor/pp_extract ${FIFO_ARG} ${FIFO_SIZE} -f "${FILENAME}" -o ${TMPDIR}/"${OUTPUTNAME}" || { echo "Failed to extract ${FILENAME}"; exit_fail_rm_tmp; }
-cmp "${REFERENCE}" ${TMPDIR}/"${OUTPUTNAME}" || { echo "[KO] Output file and reference are different"; exit_fail_rm_tmp; }
+# Extracts an indexed BCF copy of the input (e.g., for --regions-threads), the records of each contig are shifted
+# to start at 1 and the contig length is the span of its records, so that the region chunks split the records
+if [ "${INDEXED_COPY}" = true ]
+then
+    awk 'BEGIN { FS = OFS = "\t" }
+        NR == FNR { if (!/^#/) { if (!($1 in first)) first[$1] = $2; last[$1] = $2 } next }
+        /^##contig=/ { id = $0; sub(/^##contig=<ID=/, "", id); sub(/[,>].*/, "", id)
+                       if (id in first) sub(/length=[0-9]+/, "length=" (last[id] - first[id] + 1))
+                       print; next }
+        /^#/ { print; next }
+        { $2 = $2 - first[$1] + 1; print }' "${FILENAME}" "${FILENAME}" | bcftools view -Ob -o ${TMPDIR}/indexed_copy.bcf || { echo "Failed to copy ${FILENAME}"; exit_fail_rm_tmp; }
+    bcftools index ${TMPDIR}/indexed_copy.bcf || { echo "Failed to index the copy of ${FILENAME}"; exit_fail_rm_tmp; }
+    FILENAME=${TMPDIR}/indexed_copy.bcf
+fi
+
+# Extracts an XSI (xSqueezeIt) copy of the input with --xsi
+if [ "${XSI_COPY}" = true ]
+then
+    bcftools view -Ob -o ${TMPDIR}/xsi_copy.bcf "${FILENAME}" || { echo "Failed to copy ${FILENAME}"; exit_fail_rm_tmp; }
+    "${SCRIPTPATH}"/../../xSqueezeIt/xsqueezeit -c -f ${TMPDIR}/xsi_copy.bcf -o ${TMPDIR}/xsi_copy.xsi || { echo "Failed to compress the copy of ${FILENAME}"; exit_fail_rm_tmp; }
+    FILENAME=${TMPDIR}/xsi_copy.xsi
+    XSI_ARG=--xsi
+fi
+
+# One output per reference, extracted in a single pass, with the parameters after the reference name if any
+# (e.g., -r micro_ref_3.bin:fifo=3)
+OUTPUT_ARGS=()
+for I in ${!REFERENCES[@]}
+do
+    PARAMETERS=""
+    if [[ "${REFERENCES[$I]}" == *:* ]]
+    then
+        PARAMETERS=":${REFERENCES[$I]#*:}"
+    fi
+    OUTPUT_ARGS+=(-o ${TMPDIR}/${I}_"${OUTPUTNAME}${PARAMETERS}")
+done
+
+# Updates a previous extraction of the same input (nothing changed), the output and its fingerprints must be the
+# ones of the full extraction
+if [ "${UPDATE_UNCHANGED}" = true ]
+then
+    "${SCRIPTPATH}"/../../pp_extractor/pp_extract ${FIFO_ARG} ${FIFO_SIZE} "$@" --fingerprints -f "${FILENAME}" -o ${TMPDIR}/previous.bin || { echo "Failed to extract ${FILENAME}"; exit_fail_rm_tmp; }
+    UPDATE_ARGS=(--update ${TMPDIR}/previous.bin)
+fi
+
+# Updates the extraction of a previous version of the input (changed, deleted and inserted records), the output
+# and its fingerprints must be the ones of the full extraction of the input
+if ! [ -z "${UPDATE_FROM}" ]
+then
+    "${SCRIPTPATH}"/../../pp_extractor/pp_extract ${FIFO_ARG} ${FIFO_SIZE} "$@" --fingerprints -f "${UPDATE_FROM}" -o ${TMPDIR}/previous.bin || { echo "Failed to extract ${UPDATE_FROM}"; exit_fail_rm_tmp; }
+    "${SCRIPTPATH}"/../../pp_extractor/pp_extract ${FIFO_ARG} ${FIFO_SIZE} "$@" --fingerprints -f "${FILENAME}" -o ${TMPDIR}/full.bin || { echo "Failed to extract ${FILENAME}"; exit_fail_rm_tmp; }
+    UPDATE_ARGS=(--update ${TMPDIR}/previous.bin)
+fi
+
+"${SCRIPTPATH}"/../../pp_extractor/pp_extract ${FIFO_ARG} ${FIFO_SIZE} ${XSI_ARG} "$@" "${UPDATE_ARGS[@]}" -f "${FILENAME}" "${OUTPUT_ARGS[@]}" || { echo "Failed to extract ${FILENAME}"; exit_fail_rm_tmp; }
+if [ "${UPDATE_UNCHANGED}" = true ]
+then
+    cmp ${TMPDIR}/previous.bin.fp ${TMPDIR}/0_"${OUTPUTNAME}".fp || { echo "[KO] Fingerprints of the update and of the full extraction are different"; exit_fail_rm_tmp; }
+fi
+if ! [ -z "${UPDATE_FROM}" ]
+then
+    cmp ${TMPDIR}/full.bin ${TMPDIR}/0_"${OUTPUTNAME}" || { echo "[KO] Output of the update and of the full extraction are different"; exit_fail_rm_tmp; }
+    cmp ${TMPDIR}/full.bin.fp ${TMPDIR}/0_"${OUTPUTNAME}".fp || { echo "[KO] Fingerprints of the update and of the full extraction are different"; exit_fail_rm_tmp; }
+fi
+for I in ${!REFERENCES[@]}
+do
+    cmp "${REFERENCES[$I]%%:*}" ${TMPDIR}/${I}_"${OUTPUTNAME}" || { echo "[KO] Output file and reference are different"; exit_fail_rm_tmp; }
+done
 
-echo "[OK] The extracted file and reference are the same"
+echo "[OK] The extracted files and references are the same"
 
 rm -r $TMPDIR
 exit 0
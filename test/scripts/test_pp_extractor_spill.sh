@@ -0,0 +1,98 @@
+#!/bin/bash
+
+if ! command -v realpath &> /dev/null
+then
+    realpath() {
+        [[ $1 = /* ]] && echo "$1" || echo "$PWD/${1#./}"
+    }
+fi
+
+# Get the path of this script
+SCRIPTPATH=$(realpath  $(dirname "$0"))
+
+FILENAME=""
+COPIES=1
+WIDTH=1
+MAX_MEMORY=1
+
+POSITIONAL=()
+while [[ $# -gt 0 ]]
+do
+key="$1"
+
+case $key in
+    -f|--filename)
+    FILENAME="$2"
+    shift # past argument
+    shift # past value
+    ;;
+    -c|--copies)
+    COPIES="$2"
+    shift
+    shift
+    ;;
+    -w|--width)
+    WIDTH="$2"
+    shift
+    shift
+    ;;
+    -m|--max-memory)
+    MAX_MEMORY="$2"
+    shift
+    shift
+    ;;
+    *)    # unknown option
+    POSITIONAL+=("$1") # save it in an array for later
+    shift # past argument
+    ;;
+esac
+done
+set -- "${POSITIONAL[@]}" # restore positional parameters
+
+if [ -z "${FILENAME}" ]
+then
+    echo "Specify a filename with --filename, -f <filename>"
+    exit 1
+fi
+
+echo "FILENAME        = ${FILENAME}"
+echo "COPIES          = ${COPIES}"
+echo "WIDTH           = ${WIDTH}"
+echo "MAX MEMORY (MB) = ${MAX_MEMORY}"
+
+TMPDIR=$(mktemp -d -t pp_XXXXXX) || { echo "Failed to create temporary directory"; exit 1; }
+
+echo "Temporary directory : ${TMPDIR}"
+
+function exit_fail_rm_tmp {
+    echo "Removing directory : ${TMPDIR}"
+    rm -r ${TMPDIR}
+    exit 1
+}
+
+PP_EXTRACT="${SCRIPTPATH}"/../../pp_extractor/pp_extract
+
+# The records are repeated COPIES times (shifted by 1 Mbp) and the samples WIDTH times (suffixed by the copy),
+# so that the kept het sites exceed the memory limit
+awk -v copies=${COPIES} -v width=${WIDTH} 'BEGIN { FS = OFS = "\t" }
+    /^##/ { print; next }
+    /^#/ { line = $1; for (i = 2; i <= 9; ++i) line = line OFS $i
+           for (w = 0; w < width; ++w) for (i = 10; i <= NF; ++i) line = line OFS $i (w ? "_" w : "")
+           print line; next }
+    { records[n++] = $0 }
+    END { for (c = 0; c < copies; ++c) for (r = 0; r < n; ++r) {
+              split(records[r], f, "\t"); line = f[1] OFS (f[2] + c * 1000000)
+              for (i = 3; i <= 9; ++i) line = line OFS f[i]
+              for (w = 0; w < width; ++w) for (i = 10; i in f; ++i) line = line OFS f[i]
+              print line } }' "${FILENAME}" > ${TMPDIR}/large.vcf || { echo "Failed to generate the VCF file"; exit_fail_rm_tmp; }
+
+# The het sites spilled to disk and merged back give the same file as the ones kept in memory
+"${PP_EXTRACT}" "$@" -f ${TMPDIR}/large.vcf -o ${TMPDIR}/memory.bin > /dev/null || { echo "Failed to extract ${TMPDIR}/large.vcf"; exit_fail_rm_tmp; }
+"${PP_EXTRACT}" "$@" --max-memory ${MAX_MEMORY} --tmp-dir ${TMPDIR} -p 100000000 -f ${TMPDIR}/large.vcf -o ${TMPDIR}/spilled.bin > ${TMPDIR}/spilled.log || { echo "Failed to extract ${TMPDIR}/large.vcf with a memory limit"; exit_fail_rm_tmp; }
+grep -q "Spilled kept het infos" ${TMPDIR}/spilled.log || { echo "[KO] Nothing was spilled to disk, increase the copies or width"; exit_fail_rm_tmp; }
+cmp ${TMPDIR}/memory.bin ${TMPDIR}/spilled.bin || { echo "[KO] Output file with spilled het sites and output file in memory are different"; exit_fail_rm_tmp; }
+
+echo "[OK] The extracted file with spilled het sites and the one in memory are the same"
+
+rm -r $TMPDIR
+exit 0
@@ -0,0 +1,108 @@
+#!/bin/bash
+
+if ! command -v realpath &> /dev/null
+then
+    realpath() {
+        [[ $1 = /* ]] && echo "$1" || echo "$PWD/${1#./}"
+    }
+fi
+
+# Get the path of this script
+SCRIPTPATH=$(realpath  $(dirname "$0"))
+
+FILENAME=""
+BINFILE=""
+REGION=""
+
+POSITIONAL=()
+while [[ $# -gt 0 ]]
+do
+key="$1"
+
+case $key in
+    -f|--filename)
+    FILENAME="$2"
+    shift # past argument
+    shift # past value
+    ;;
+    -b|--bin-file)
+    BINFILE="$2"
+    shift # past argument
+    shift # past value
+    ;;
+    -r|--region)
+    REGION="$2"
+    shift
+    shift
+    ;;
+    *)    # unknown option
+    POSITIONAL+=("$1") # save it in an array for later
+    shift # past argument
+    ;;
+esac
+done
+set -- "${POSITIONAL[@]}" # restore positional parameters
+
+if [ -z "${FILENAME}" ]
+then
+    echo "Specify a filename with --filename, -f <filename>"
+    exit 1
+fi
+
+if [ -z "${BINFILE}" ]
+then
+    echo "Specify a binary file with --bin-file, -b <filename>"
+    exit 1
+fi
+
+if [ -z "${REGION}" ]
+then
+    echo "Specify a region with --region, -r CHROM:BEG-END"
+    exit 1
+fi
+
+echo "FILENAME        = ${FILENAME}"
+echo "BINFILE         = ${BINFILE}"
+echo "REGION          = ${REGION}"
+
+TMPDIR=$(mktemp -d -t pp_XXXXXX) || { echo "Failed to create temporary directory"; exit 1; }
+
+echo "Temporary directory : ${TMPDIR}"
+
+function exit_fail_rm_tmp {
+    echo "Removing directory : ${TMPDIR}"
+    rm -r ${TMPDIR}
+    exit 1
+}
+
+BINPATH="${SCRIPTPATH}"/../..
+
+# The binary file is converted with the remaining options if any (e.g., --skip-index 2)
+if [ $# -gt 0 ]
+then
+    "${BINPATH}"/bin_tools/bin_convert "$@" -b "${BINFILE}" -o ${TMPDIR}/converted.bin || { echo "Failed to convert ${BINFILE}"; exit_fail_rm_tmp; }
+    BINFILE=${TMPDIR}/converted.bin
+fi
+
+CHROM=${REGION%%:*}
+BEG=${REGION#*:}
+BEG=${BEG%-*}
+END=${REGION##*-}
+
+# Number of samples, second uint32_t of the header
+NUM_SAMPLES=$(od -A n -t u4 -j 4 -N 4 "${BINFILE}" | tr -d ' ')
+
+# The het sites of the region (VCF line range search) are the ones of the whole sample in the region
+for SAMPLE in $(seq 0 $((NUM_SAMPLES - 1)))
+do
+    "${BINPATH}"/pp_extractor/pp_show -f "${FILENAME}" -b "${BINFILE}" -s ${SAMPLE} > ${TMPDIR}/all.txt || { echo "Failed to show sample ${SAMPLE}"; exit_fail_rm_tmp; }
+    "${BINPATH}"/pp_extractor/pp_show -f "${FILENAME}" -b "${BINFILE}" -s ${SAMPLE} -r "${REGION}" > ${TMPDIR}/region.txt || { echo "Failed to show region of sample ${SAMPLE}"; exit_fail_rm_tmp; }
+    sed '1,/^---$/d' ${TMPDIR}/all.txt | awk -v c="${CHROM}" -v b=${BEG} -v e=${END} '$1 == c && $2 >= b && $2 <= e' > ${TMPDIR}/expected.txt
+    sed '1,/^---$/d' ${TMPDIR}/region.txt > ${TMPDIR}/found.txt
+    cmp ${TMPDIR}/expected.txt ${TMPDIR}/found.txt || { echo "[KO] Het sites of the region of sample ${SAMPLE} are different"; exit_fail_rm_tmp; }
+done
+
+echo "[OK] The het sites of the region are the same for the ${NUM_SAMPLES} samples"
+
+rm -r $TMPDIR
+exit 0
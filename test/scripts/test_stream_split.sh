@@ -0,0 +1,93 @@
+#!/bin/bash
+
+if ! command -v realpath &> /dev/null
+then
+    realpath() {
+        [[ $1 = /* ]] && echo "$1" || echo "$PWD/${1#./}"
+    }
+fi
+
+# Get the path of this script
+SCRIPTPATH=$(realpath  $(dirname "$0"))
+
+FILENAME=""
+REFERENCE=""
+SPLIT_SIZE=""
+
+POSITIONAL=()
+while [[ $# -gt 0 ]]
+do
+key="$1"
+
+case $key in
+    -f|--filename)
+    FILENAME="$2"
+    shift # past argument
+    shift # past value
+    ;;
+    -r|--reference)
+    REFERENCE="$2"
+    shift # past argument
+    shift # past value
+    ;;
+    -n|--split-size)
+    SPLIT_SIZE="$2"
+    shift
+    shift
+    ;;
+    *)    # unknown option
+    POSITIONAL+=("$1") # save it in an array for later
+    shift # past argument
+    ;;
+esac
+done
+set -- "${POSITIONAL[@]}" # restore positional parameters
+
+if [ -z "${FILENAME}" ]
+then
+    echo "Specify a filename with --filename, -f <filename>"
+    exit 1
+fi
+
+if [ -z "${REFERENCE}" ]
+then
+    echo "Specify a filename with --reference, -r <filename>"
+    exit 1
+fi
+
+if [ -z "${SPLIT_SIZE}" ]
+then
+    echo "Specify a split size with --split-size, -n <size>"
+    exit 1
+fi
+
+echo "FILENAME        = ${FILENAME}"
+echo "REFERENCE       = ${REFERENCE}"
+echo "SPLIT SIZE      = ${SPLIT_SIZE}"
+
+TMPDIR=$(mktemp -d -t pp_XXXXXX) || { echo "Failed to create temporary directory"; exit 1; }
+
+echo "Temporary directory : ${TMPDIR}"
+
+function exit_fail_rm_tmp {
+    echo "Removing directory : ${TMPDIR}"
+    rm -r ${TMPDIR}
+    exit 1
+}
+
+BINPATH="${SCRIPTPATH}"/../..
+
+# The streaming layout is piped to the splitter, the reference is split from its memory map
+set -o pipefail
+"${BINPATH}"/pp_extractor/pp_extract --stream "$@" -f "${FILENAME}" -o - | "${BINPATH}"/bin_tools/bin_splitter --stdin -n ${SPLIT_SIZE} -o ${TMPDIR}/stream || { echo "Failed to extract and split ${FILENAME}"; exit_fail_rm_tmp; }
+"${BINPATH}"/bin_tools/bin_splitter -b "${REFERENCE}" -n ${SPLIT_SIZE} -o ${TMPDIR}/reference || { echo "Failed to split ${REFERENCE}"; exit_fail_rm_tmp; }
+
+for SUBFILE in ${TMPDIR}/reference_*
+do
+    cmp "${SUBFILE}" ${TMPDIR}/stream_"${SUBFILE##*_}" || { echo "[KO] Split stream and split reference are different"; exit_fail_rm_tmp; }
+done
+
+echo "[OK] The split stream and split reference are the same"
+
+rm -r $TMPDIR
+exit 0